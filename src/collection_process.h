@@ -46,6 +46,42 @@ public:
     virtual void printVersion() throw () = 0;
 };
 
+/**
+ * Estimate of the drift of the logger clock, built from successive readings
+ * of the clock and persisted in the working directory. It predicts the
+ * offset of the logger clock so that the clock check can be skipped while
+ * the offset stays well within MAX_TIME_OFFSET.
+ */
+class ClockDriftModel {
+public:
+    ClockDriftModel();
+    void   load(const string& path);
+    void   save(const string& path) const;
+    void   addReading(const ClockReading& reading);
+    void   adjust(double secs);
+    bool   isCheckDue(double now, int maxInterval) const;
+    double predictOffset(double now) const;
+    /** Returns true once the drift rate was estimated */
+    bool   hasDriftRate() const { return numReadings__ > 1; }
+    /** Returns the drift of the logger clock in seconds per second */
+    double getDriftRate() const { return driftRate__; }
+
+private:
+    double refTime__;         // Host time of the reference reading
+    double refOffset__;       // Offset of the logger clock at refTime__
+    double refRoundTrip__;    // Round trip of the reference reading
+    double driftRate__;       // Change in offset per second, averaged
+    double lastCheck__;       // Host time of the last clock reading
+    int    numReadings__;     // Readings the drift rate is based on
+};
+
+// Shortest interval between readings used to estimate the drift (seconds)
+#define MIN_DRIFT_INTERVAL  3600
+// Number of drift estimates averaged
+#define DRIFT_AVG_READINGS  4
+// Margin kept between the predicted offset and MAX_TIME_OFFSET (seconds)
+#define CLOCK_CHECK_MARGIN  0.5
+
 /**
  * Implementation of the DataCollectionProcess interface for collectinng data from
  * a PakBus (2005) protocol based datalogger.
@@ -66,6 +102,11 @@ protected :
     void checkLoggerTime() throw (AppException);
     void initSession(int nTry) throw (AppException);
     void collect() throw (AppException);
+    void fetchFiles() throw (AppException);
+    void sendFiles() throw (AppException);
+    void syncFiles() throw (AppException);
+    void getValues() throw (AppException);
+    void tail() throw (AppException);
     void closeSession() throw ();
     void exitHandler(int signum) throw ();
 
@@ -80,6 +121,11 @@ private:
     string           lockFilePath__;
     bool             optDebug__;
     bool             optCleanAppCache__;
+    vector<string>   optFetchFiles__;
+    vector<string>   optSendFiles__;
+    bool             optSyncFiles__;
+    vector<string>   optGetValues__;
+    int              optTailSecs__;
     bool             executionComplete__;
     bool             loggerTimeCheckComplete__;
     stringstream     msgstrm;
@@ -357,8 +357,52 @@ void CommInpCfg :: loadDataOutputConfig (const xmlNodePtr node)
                             tbl_opt.TableSpan = 3600;
                         }
                     }
+
+                    // Optional comma separated list of fields to collect
+                    tbl_opt.FieldNames.clear();
+                    properties = (char *)xmlGetProp (tnode, 
+                            (const xmlChar*)"fields");
+                    if (properties != NULL) {
+                        stringstream fieldStrm (properties);
+                        string fieldName;
+                        while (getline (fieldStrm, fieldName, ',')) {
+                            size_t beg = fieldName.find_first_not_of(" \t");
+                            size_t end = fieldName.find_last_not_of(" \t");
+                            if (beg != string::npos) {
+                                tbl_opt.FieldNames.push_back(
+                                        fieldName.substr(beg, end - beg + 1));
+                            }
+                        }
+                    }
+
+                    // Number of newest records to collect first when 
+                    // catching up with a backlog
+                    properties = (char *)xmlGetProp (tnode, 
+                            (const xmlChar*)"catch_up_records");
+                    if (properties == NULL) {
+                        tbl_opt.CatchUpRecords = 0;
+                    }
+                    else {
+                        long catch_up = strtol(properties, &dummy, 10);
+                        tbl_opt.CatchUpRecords = (catch_up > 0) ? 
+                                (uint4)catch_up : 0;
+                    }
+
+                    properties = (char *)xmlGetProp (tnode, 
+                            (const xmlChar*)"tail");
+                    tbl_opt.Tail = (properties != NULL) && !xmlStrcasecmp(
+                            (const xmlChar*)properties, (const xmlChar*)"true");
+
                     dataOpt__.Tables.push_back (tbl_opt);
                 } 
+                else if (!xmlStrcasecmp(tnode->name, 
+                            (const xmlChar *)"qc_rule")) {
+                    dataOpt__.QcRules.push_back (loadQcRule (tnode));
+                }
+                else if (!xmlStrcasecmp(tnode->name, 
+                            (const xmlChar *)"aggregate")) {
+                    dataOpt__.Aggregates.push_back (loadAggregate (tnode));
+                }
                 tnode = tnode->next;
             }
         }
@@ -371,6 +415,171 @@ void CommInpCfg :: loadDataOutputConfig (const xmlNodePtr node)
     }
 }
 
+/**
+ * Function to load a QC rule for a field of a table, given with attributes
+ * as in <qc_rule table="..." field="..." min="..." max="..." max_step="..." 
+ * stuck_records="..." missing="..."/>. Only the checks given are enabled, 
+ * the missing value sentinel defaults to -9999.
+ *
+ * @param node: Pointer to the <qc_rule> node in the XML configuration file.
+ * @return The QC rule.
+ */
+QcRule CommInpCfg :: loadQcRule (const xmlNodePtr node) throw (AppException)
+{
+    QcRule rule;
+    char  *properties, *dummy;
+
+    properties = (char *)xmlGetProp (node, (const xmlChar*)"table");
+    if (properties != NULL) {
+        rule.TableName = properties;
+    }
+    properties = (char *)xmlGetProp (node, (const xmlChar*)"field");
+    if (properties != NULL) {
+        rule.FieldName = properties;
+    }
+    if (rule.TableName.empty() || rule.FieldName.empty()) {
+        throw AppException(__FILE__, __LINE__, 
+                "Incomplete input for QC rule, table and field are required");
+    }
+
+    if ((properties = (char *)xmlGetProp (node, (const xmlChar*)"min"))) {
+        rule.Min = strtod(properties, &dummy);
+        rule.Checks |= QC_BELOW_MIN;
+    }
+    if ((properties = (char *)xmlGetProp (node, (const xmlChar*)"max"))) {
+        rule.Max = strtod(properties, &dummy);
+        rule.Checks |= QC_ABOVE_MAX;
+    }
+    if ((properties = (char *)xmlGetProp (node, (const xmlChar*)"max_step"))) {
+        rule.MaxStep = strtod(properties, &dummy);
+        rule.Checks |= QC_STEP;
+    }
+    properties = (char *)xmlGetProp (node, (const xmlChar*)"stuck_records");
+    if (properties != NULL) {
+        long records = strtol(properties, &dummy, 10);
+        if (records > 1) {
+            rule.StuckRecords = (uint4)records;
+            rule.Checks |= QC_STUCK;
+        }
+    }
+    if ((properties = (char *)xmlGetProp (node, (const xmlChar*)"missing"))) {
+        rule.Missing = strtod(properties, &dummy);
+    }
+    return rule;
+}
+
+/**
+ * Function to load a table derived from a collected table, holding the 
+ * statistics of its fields over consecutive windows, as in 
+ * <aggregate table="..." name="..." interval_secs="..."> with the fields 
+ * aggregated given as <field name="..." stats="mean,min,max,std"/> and 
+ * <wind speed="..." direction="..."/>. The mean is computed by default.
+ *
+ * @param node: Pointer to the <aggregate> node in the XML configuration file.
+ * @return The configuration of the derived table.
+ */
+AggregateOpt CommInpCfg :: loadAggregate (const xmlNodePtr node) 
+        throw (AppException)
+{
+    AggregateOpt opt;
+    char  *properties, *dummy;
+    stringstream msgstrm;
+
+    properties = (char *)xmlGetProp (node, (const xmlChar*)"table");
+    if (properties != NULL) {
+        opt.TableName = properties;
+    }
+    properties = (char *)xmlGetProp (node, (const xmlChar*)"name");
+    if (properties != NULL) {
+        opt.Name = properties;
+    }
+    properties = (char *)xmlGetProp (node, (const xmlChar*)"interval_secs");
+    if (properties != NULL) {
+        long interval = strtol(properties, &dummy, 10);
+        opt.Interval = (interval > 0) ? (int)interval : 0;
+    }
+    if (opt.TableName.empty() || opt.Name.empty() || (opt.Interval == 0)) {
+        throw AppException(__FILE__, __LINE__, "Incomplete input for "
+                "aggregate, table, name and interval_secs are required");
+    }
+    if (opt.Name == opt.TableName) {
+        throw AppException(__FILE__, __LINE__, 
+                "Aggregate must be named differently from its table");
+    }
+
+    for (xmlNodePtr fnode = node->xmlChildrenNode; fnode != NULL; 
+            fnode = fnode->next) {
+        AggregateField field;
+
+        if (!xmlStrcasecmp(fnode->name, (const xmlChar *)"field")) {
+            properties = (char *)xmlGetProp (fnode, (const xmlChar*)"name");
+            if (properties != NULL) {
+                field.FieldName = properties;
+            }
+
+            properties = (char *)xmlGetProp (fnode, (const xmlChar*)"stats");
+            if (properties == NULL) {
+                field.Stats = AGG_MEAN;
+            }
+            else {
+                stringstream statStrm (properties);
+                string stat;
+                while (getline (statStrm, stat, ',')) {
+                    size_t beg = stat.find_first_not_of(" \t");
+                    size_t end = stat.find_last_not_of(" \t");
+                    if (beg == string::npos) {
+                        continue;
+                    }
+                    stat = stat.substr(beg, end - beg + 1);
+                    if (stat == "mean") {
+                        field.Stats |= AGG_MEAN;
+                    }
+                    else if (stat == "min") {
+                        field.Stats |= AGG_MIN;
+                    }
+                    else if (stat == "max") {
+                        field.Stats |= AGG_MAX;
+                    }
+                    else if (stat == "std") {
+                        field.Stats |= AGG_STD;
+                    }
+                    else {
+                        msgstrm << "Unknown statistic " << stat 
+                                << " for aggregate " << opt.Name;
+                        throw AppException(__FILE__, __LINE__, 
+                                msgstrm.str().c_str());
+                    }
+                }
+            }
+        }
+        else if (!xmlStrcasecmp(fnode->name, (const xmlChar *)"wind")) {
+            properties = (char *)xmlGetProp (fnode, (const xmlChar*)"speed");
+            if (properties != NULL) {
+                field.FieldName = properties;
+            }
+            properties = (char *)xmlGetProp (fnode, 
+                    (const xmlChar*)"direction");
+            if (properties != NULL) {
+                field.DirectionField = properties;
+            }
+            field.Stats = AGG_WIND;
+            if (field.DirectionField.empty()) {
+                field.FieldName.clear();
+            }
+        }
+        else {
+            continue;
+        }
+
+        if (field.FieldName.empty() || (field.Stats == 0)) {
+            msgstrm << "Incomplete input for a field of aggregate " << opt.Name;
+            throw AppException(__FILE__, __LINE__, msgstrm.str().c_str());
+        }
+        opt.Fields.push_back(field);
+    }
+    return opt;
+}
+
 /**
  * Function to load the PakBus address information of the target device from 
  * the input configuration file.
@@ -406,6 +615,25 @@ void CommInpCfg :: loadPakbusConfig (const xmlNodePtr node)
                     (uint2)strtol(xmlNodeGetNormContent(cnode),&dummy, 10);
             validator.setInputStatusOk("security_code");
         }
+        else if(!xmlStrcasecmp(cnode->name, 
+                    (const xmlChar *)"max_pending_requests") ) {
+            bmp5Opt__.MaxPendingRequests = 
+                    (int)strtol(xmlNodeGetNormContent(cnode), &dummy, 10);
+            if (bmp5Opt__.MaxPendingRequests <= 0) {
+                bmp5Opt__.MaxPendingRequests = DEFAULT_MAX_PENDING_REQUESTS;
+            }
+        }
+        else if(!xmlStrcasecmp(cnode->name, 
+                    (const xmlChar *)"predict_last_record") ) {
+            bmp5Opt__.PredictLastRecord = !xmlStrcasecmp(
+                    (const xmlChar *)xmlNodeGetNormContent(cnode), 
+                    (const xmlChar *)"true");
+        }
+        else if(!xmlStrcasecmp(cnode->name, 
+                    (const xmlChar *)"max_clock_check_interval") ) {
+            bmp5Opt__.MaxClockCheckInterval = 
+                    (int)strtol(xmlNodeGetNormContent(cnode), &dummy, 10);
+        }
         cnode = cnode->next;
     }
     if (validator.validateInputs() == false) {
@@ -107,6 +107,9 @@ class CommInpCfg {
         /** Returns a reference to the PBAddr structure containing PakBus
             address information. */
         PBAddr&  getPakbusAddr () { return pbAddr__; };
+        /** Returns a reference to the BMP5Opt structure containing options
+            for BMP5 transactions. */
+        const BMP5Opt& getBMP5Opt () { return bmp5Opt__; };
         void     dirSetup() throw (AppException);
         int      redirectLog();
 
@@ -116,6 +119,9 @@ class CommInpCfg {
         void loadSerialConfig (const xmlNodePtr node) 
                 throw (AppException);
         void loadDataOutputConfig (const xmlNodePtr node) throw (AppException);
+        QcRule loadQcRule (const xmlNodePtr node) throw (AppException);
+        AggregateOpt loadAggregate (const xmlNodePtr node) 
+                throw (AppException);
         void loadPakbusConfig (const xmlNodePtr node) 
                 throw (AppException);
 
@@ -123,6 +129,7 @@ class CommInpCfg {
         auto_ptr<DataSource> dataSource__;
         DataOutputConfig  dataOpt__;
         PBAddr   pbAddr__;
+        BMP5Opt  bmp5Opt__;
 };
 
 #endif
@@ -0,0 +1,593 @@
+/**
+ * @file pb5_aggregate.cpp
+ * Implements the aggregation of the records of a collected table into
+ * derived tables, holding statistics of its fields over fixed windows.
+ */
+#include <string>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <limits>
+#include <log4cpp/Category.hh>
+#include "pb5.h"
+#include "utils.h"
+using namespace std;
+using namespace log4cpp;
+
+static const double DEG_PER_RAD = 180.0/M_PI;
+
+// Value of a sample the logger could not measure, FP2 NaN and overflow
+// codes included
+static const double LOGGER_MISSING = -9999;
+
+/**
+ * Function to reset the statistics of an accumulator for a new window.
+ */
+void Accumulator :: reset()
+{
+    Count = 0;
+    Mean = 0;
+    M2 = 0;
+    Min = HUGE_VAL;
+    Max = -HUGE_VAL;
+    SumSin = 0;
+    SumCos = 0;
+}
+
+/**
+ * Function to add a value to the statistics. The mean and the sum of the
+ * squared differences are updated incrementally (Welford), which keeps the
+ * variance of samples with a large offset accurate.
+ */
+void Accumulator :: add(double value)
+{
+    Count++;
+    double delta = value - Mean;
+    Mean += delta/Count;
+    M2 += delta*(value - Mean);
+    if (value < Min) {
+        Min = value;
+    }
+    if (value > Max) {
+        Max = value;
+    }
+}
+
+/**
+ * Function to add a direction to the sums of its unit vector.
+ */
+void Accumulator :: addDirection(double degrees)
+{
+    SumSin += sin(degrees/DEG_PER_RAD);
+    SumCos += cos(degrees/DEG_PER_RAD);
+}
+
+/**
+ * Function to get a sample of a numeric column as a double.
+ */
+static double getNumber(const RecordColumn& column, uint4 idx)
+{
+    switch (column.Kind) {
+        case SAMPLE_UINT   : return column.Uints[idx];
+        case SAMPLE_INT    : return column.Ints[idx];
+        case SAMPLE_FLOAT  : return column.Floats[idx];
+        case SAMPLE_DOUBLE : return column.Doubles[idx];
+        default            : return numeric_limits<double>::quiet_NaN();
+    }
+}
+
+/**
+ * Function to get the kind of the samples of a collected field of a table,
+ * from its decode plan.
+ */
+static byte getColumnKind(const Table& tbl, int idx)
+{
+    vector<DecodeOp>::const_iterator op;
+    for (op = tbl.DecodePlan.begin(); op != tbl.DecodePlan.end(); op++) {
+        if ((idx >= op->FirstField) && (idx < op->FirstField + op->NumFields)) {
+            return op->Kind;
+        }
+    }
+    return SAMPLE_NONE;
+}
+
+static bool isNumericKind(byte kind)
+{
+    return (kind == SAMPLE_UINT) || (kind == SAMPLE_INT) ||
+           (kind == SAMPLE_FLOAT) || (kind == SAMPLE_DOUBLE);
+}
+
+/**
+ * Function to get the missing value sentinel of a collected field of a
+ * table, from its QC rule, or the logger sentinel if it has none.
+ */
+static double getMissing(const Table& tbl, int idx)
+{
+    vector<QcCheck>::const_iterator check;
+    for (check = tbl.QcPlan.begin(); check != tbl.QcPlan.end(); check++) {
+        if (check->Column == idx) {
+            return check->Rule.Missing;
+        }
+    }
+    return LOGGER_MISSING;
+}
+
+/**
+ * Function to tell whether a sample is missing: NaN or infinite, which
+ * IEEE4 fields decode NaN to, the logger sentinel or the sentinel of the
+ * field.
+ */
+static bool isMissing(double value, double missing)
+{
+    return !(fabs(value) < HUGE_VAL) || (value == LOGGER_MISSING) ||
+           (value == missing);
+}
+
+/**
+ * Constructor for a TableAggregator. The fields are mapped to the records
+ * of the table aggregated from once its layout is known, see compile().
+ *
+ * @param opt: Configuration of the derived table.
+ * @param tblDataMgr: TableDataManager providing the output configuration
+ *                    to the writer of the derived table.
+ */
+TableAggregator :: TableAggregator(const AggregateOpt& opt,
+        const TableDataManager* tblDataMgr) : opt__(opt),
+        writer__(TableDataWriterFactory::getInstance().getWriter(
+                TableDataWriterFactory::ASCII)),
+        writing__(false), layoutSig__((uint2)0), windowEnd__((uint4)0),
+        loadedSig__((uint2)0)
+{
+    table__.TblName = opt.Name;
+    table__.TblTimeInterval.sec = opt.Interval;
+    writer__->setTableDataManager(tblDataMgr);
+}
+
+/**
+ * Destructor closes the data file of the derived table. The window in
+ * progress is kept by saveState(), to be continued by the next run.
+ */
+TableAggregator :: ~TableAggregator()
+{
+    if (writing__) {
+        try {
+            writer__->finishWrite(table__);
+        }
+        catch (StorageException& se) {
+            Category::getInstance("TableAggregator")
+                     .error("Failed to close the data file of " +
+                             table__.TblName);
+        }
+    }
+}
+
+/**
+ * Function to add a field of the derived table, holding a statistic of a
+ * field of the table aggregated from.
+ *
+ * @param var: Field aggregated.
+ * @param suffix: Appended to the name of the aggregated field.
+ * @param processing: Processing reported in the header of the data files.
+ * @param unit: Unit of the statistic, NULL for the unit of the field.
+ */
+void TableAggregator :: addField(const Field& var, const char* suffix,
+        const char* processing, const char* unit)
+{
+    Field stat;
+    stat.FieldType = 9;     // IEEE4
+    stat.FieldName = var.FieldName + suffix;
+    stat.Processing = processing;
+    stat.Unit = unit ? unit : var.Unit;
+    stat.Dimension = var.Dimension;
+    table__.field_list.push_back(stat);
+}
+
+/**
+ * Function to map the configured fields to the collected fields of the
+ * table aggregated from, and to build the fields of the derived table. It
+ * is called whenever the decode plan of the table is compiled. The window
+ * in progress is continued as long as the derived fields are unchanged,
+ * otherwise it is dropped and the data file of the derived table is
+ * published, so that the new one starts with a matching header.
+ *
+ * @param source: Table aggregated from, with its decode plan and QC plan
+ *                compiled.
+ */
+void TableAggregator :: compile(const Table& source)
+{
+    const vector<Field>& field_list = source.getCollectedFields();
+    vector<AggregateField>::const_iterator field;
+    stringstream msgstrm;
+    uint4  numAcc = 0;
+
+    inputs__.clear();
+    table__.field_list.clear();
+
+    for (field = opt__.Fields.begin(); field != opt__.Fields.end(); field++) {
+        AggregateInput input;
+        input.Stats = field->Stats;
+        input.Column = source.View.getFieldIndex(field->FieldName);
+        if (field->Stats & AGG_WIND) {
+            input.DirColumn = source.View.getFieldIndex(field->DirectionField);
+        }
+
+        if ((input.Column < 0) ||
+                ((field->Stats & AGG_WIND) && (input.DirColumn < 0))) {
+            msgstrm << "Ignoring " << field->FieldName << " in " << opt__.Name
+                    << ", the field is not collected from " << source.TblName;
+            Category::getInstance("TableAggregator").warn(msgstrm.str());
+            msgstrm.str("");
+            continue;
+        }
+
+        const Field& var = field_list[input.Column];
+        if (!isNumericKind(getColumnKind(source, input.Column)) ||
+                ((field->Stats & AGG_WIND) &&
+                (!isNumericKind(getColumnKind(source, input.DirColumn)) ||
+                (field_list[input.DirColumn].Dimension != var.Dimension)))) {
+            msgstrm << "Ignoring " << field->FieldName << " in " << opt__.Name
+                    << ", the field of " << source.TblName
+                    << " does not hold matching numbers";
+            Category::getInstance("TableAggregator").warn(msgstrm.str());
+            msgstrm.str("");
+            continue;
+        }
+
+        input.Samples = var.Dimension;
+        input.FirstAcc = numAcc;
+        input.Missing = getMissing(source, input.Column);
+        if (field->Stats & AGG_WIND) {
+            input.DirMissing = getMissing(source, input.DirColumn);
+        }
+        numAcc += input.Samples;
+        inputs__.push_back(input);
+
+        if (field->Stats & AGG_WIND) {
+            const Field& dir = field_list[input.DirColumn];
+            addField(var, "_S_WVT", "WVc", NULL);
+            addField(dir, "_D1_WVT", "WVc", "Deg");
+            addField(dir, "_SD1_WVT", "WVc", "Deg");
+            continue;
+        }
+        if (field->Stats & AGG_MEAN) {
+            addField(var, "_Avg", "Avg", NULL);
+        }
+        if (field->Stats & AGG_MIN) {
+            addField(var, "_Min", "Min", NULL);
+        }
+        if (field->Stats & AGG_MAX) {
+            addField(var, "_Max", "Max", NULL);
+        }
+        if (field->Stats & AGG_STD) {
+            addField(var, "_Std", "Std", NULL);
+        }
+    }
+
+    if (inputs__.empty()) {
+        Category::getInstance("TableAggregator")
+                 .warn("No fields to aggregate into " + opt__.Name);
+    }
+
+    uint2 prevSig = loadedSig__ ? loadedSig__ : layoutSig__;
+    string layout;
+    for (int idx = 0; idx < (int)table__.field_list.size(); idx++) {
+        msgstrm << table__.field_list[idx].FieldName << "("
+                << table__.field_list[idx].Dimension << ")";
+    }
+    layout = msgstrm.str();
+    layoutSig__ = CalcSig(layout.data(), layout.size(), 0xaaaa);
+
+    if (prevSig != layoutSig__) {
+        if (prevSig && table__.FirstSampleInFile) {
+            msgstrm.str("");
+            msgstrm << "Fields aggregated into " << opt__.Name
+                    << " changed, publishing its data file";
+            Category::getInstance("TableAggregator").notice(msgstrm.str());
+            try {
+                writer__->flush(table__);
+            }
+            catch (StorageException& se) {
+                Category::getInstance("TableAggregator")
+                         .error("Failed to publish the data file of " +
+                                 opt__.Name);
+            }
+            writing__ = false;
+            table__.NewFileTime = 0;
+            table__.FirstSampleInFile = 0;
+        }
+        windowEnd__ = 0;
+        accumulators__.assign(numAcc, Accumulator());
+    }
+    else if (loadedSig__ && (loadedAccumulators__.size() == numAcc)) {
+        accumulators__.swap(loadedAccumulators__);
+    }
+    else if (accumulators__.size() != numAcc) {
+        windowEnd__ = 0;
+        accumulators__.assign(numAcc, Accumulator());
+    }
+    loadedSig__ = 0;
+    loadedAccumulators__.clear();
+
+    windows__.Columns.resize(table__.field_list.size());
+    for (int idx = 0; idx < (int)table__.field_list.size(); idx++) {
+        RecordColumn& column = windows__.Columns[idx];
+        column.FieldPtr = &table__.field_list[idx];
+        column.Kind = SAMPLE_FLOAT;
+        column.Samples = table__.field_list[idx].Dimension;
+        column.Floats.clear();
+    }
+}
+
+/**
+ * Function to add a batch of records of the table aggregated from to the
+ * windows. Each window ends on a multiple of the interval, and holds the
+ * records timestamped after the end of the previous window, up to its own
+ * end. The windows completed by the batch are stored to the derived table.
+ * Records older than the window in progress are ignored, as are missing
+ * samples, see isMissing(). A wind vector is left out if either its speed
+ * or its direction is missing.
+ *
+ * @param batch: Records decoded into columns.
+ */
+void TableAggregator :: addBatch(const RecordBatch& batch)
+{
+    if (inputs__.empty() || (opt__.Interval <= 0)) {
+        return;
+    }
+
+    // The buffers of the windows are reused between batches
+    windows__.NumRecords = 0;
+    windows__.Times.clear();
+    windows__.Times.reserve(batch.NumRecords);
+    windows__.RecordNumbers.clear();
+    windows__.RecordNumbers.reserve(batch.NumRecords);
+    vector<RecordColumn>::iterator column;
+    for (column = windows__.Columns.begin(); column != windows__.Columns.end();
+            column++) {
+        column->Floats.clear();
+        column->Floats.reserve(batch.NumRecords * column->Samples);
+    }
+
+    uint4 interval = opt__.Interval;
+
+    for (int rec = 0; rec < batch.NumRecords; rec++) {
+        const NSec& recordTime = batch.Times[rec];
+        uint4 windowEnd = (recordTime.sec/interval) * interval;
+        if ((recordTime.sec % interval) || recordTime.nsec) {
+            windowEnd += interval;
+        }
+
+        if (windowEnd__ && (windowEnd < windowEnd__)) {
+            continue;
+        }
+        if (windowEnd != windowEnd__) {
+            if (windowEnd__) {
+                storeWindow();
+            }
+            windowEnd__ = windowEnd;
+        }
+
+        vector<AggregateInput>::const_iterator input;
+        for (input = inputs__.begin(); input != inputs__.end(); input++) {
+            const RecordColumn& values = batch.Columns[input->Column];
+            uint4 beg = rec * values.Samples;
+
+            for (uint4 idx = 0; idx < input->Samples; idx++) {
+                Accumulator& acc = accumulators__[input->FirstAcc + idx];
+                double value = getNumber(values, beg + idx);
+
+                if (input->Stats & AGG_WIND) {
+                    const RecordColumn& dirs = batch.Columns[input->DirColumn];
+                    double dir = getNumber(dirs, rec*dirs.Samples + idx);
+                    if (!isMissing(value, input->Missing) &&
+                            !isMissing(dir, input->DirMissing)) {
+                        acc.add(value);
+                        acc.addDirection(dir);
+                    }
+                }
+                else if (!isMissing(value, input->Missing)) {
+                    acc.add(value);
+                }
+            }
+        }
+    }
+
+    if (windows__.NumRecords) {
+        writeWindows();
+    }
+}
+
+/**
+ * Function to append the statistics of the window in progress to the
+ * windows waiting to be written, and reset the accumulators. The wind
+ * vector holds the mean speed, the unit vector mean direction and the
+ * standard deviation of the direction (Yamartino).
+ */
+void TableAggregator :: storeWindow()
+{
+    NSec windowTime;
+    windowTime.sec = windowEnd__;
+    windowTime.nsec = 0;
+
+    windows__.Times.push_back(windowTime);
+    windows__.RecordNumbers.push_back(table__.NextRecord++);
+    windows__.NumRecords++;
+    table__.LastRecordTime = windowTime;
+
+    const float nan = numeric_limits<float>::quiet_NaN();
+    vector<RecordColumn>::iterator column = windows__.Columns.begin();
+    vector<AggregateInput>::const_iterator input;
+
+    for (input = inputs__.begin(); input != inputs__.end(); input++) {
+        vector<Accumulator>::iterator first = accumulators__.begin()
+                + input->FirstAcc;
+        vector<Accumulator>::iterator last = first + input->Samples;
+        vector<Accumulator>::iterator acc;
+
+        if (input->Stats & AGG_WIND) {
+            for (acc = first; acc != last; acc++) {
+                double sa = acc->SumSin/acc->Count;
+                double ca = acc->SumCos/acc->Count;
+                double dir = atan2(sa, ca) * DEG_PER_RAD;
+                double eps = sqrt(max(0.0, 1 - (sa*sa + ca*ca)));
+                double sd = asin(min(eps, 1.0)) *
+                        (1 + (2/sqrt(3.0) - 1) * eps*eps*eps) * DEG_PER_RAD;
+                bool   empty = (acc->Count == 0);
+
+                column[0].Floats.push_back(empty ? nan : acc->Mean);
+                column[1].Floats.push_back(empty ? nan :
+                        ((dir < 0) ? dir + 360 : dir));
+                column[2].Floats.push_back(empty ? nan : sd);
+            }
+            column += 3;
+        }
+        else {
+            static const byte stats[] = {AGG_MEAN, AGG_MIN, AGG_MAX, AGG_STD};
+
+            for (int stat = 0; stat < 4; stat++) {
+                if (!(input->Stats & stats[stat])) {
+                    continue;
+                }
+                for (acc = first; acc != last; acc++) {
+                    double value = nan;
+                    if (acc->Count) {
+                        switch (stats[stat]) {
+                            case AGG_MEAN : value = acc->Mean; break;
+                            case AGG_MIN  : value = acc->Min; break;
+                            case AGG_MAX  : value = acc->Max; break;
+                            case AGG_STD  : value = sqrt(acc->M2/acc->Count);
+                                            break;
+                        }
+                    }
+                    column->Floats.push_back(value);
+                }
+                column++;
+            }
+        }
+
+        for (acc = first; acc != last; acc++) {
+            acc->reset();
+        }
+    }
+}
+
+/**
+ * Function to write the completed windows to the data file of the derived
+ * table. The file is kept open for the following windows. A failure is
+ * logged without interrupting the collection of the table aggregated from.
+ */
+void TableAggregator :: writeWindows()
+{
+    if (!writing__) {
+        try {
+            writer__->initWrite(table__);
+            writing__ = true;
+        }
+        catch (StorageException& se) {
+            Category::getInstance("TableAggregator")
+                     .error("Failed to store the windows of " + opt__.Name);
+            return;
+        }
+    }
+
+    try {
+        writer__->writeBatch(table__, windows__);
+    }
+    catch (exception& e) {
+        Category::getInstance("TableAggregator")
+                 .error("Failed to store the windows of " + opt__.Name);
+    }
+}
+
+/**
+ * Function to get a stamp of the data files written for the derived table,
+ * changing whenever a data file is opened or a new one is started.
+ */
+uint4 TableAggregator :: getFileStamp() const
+{
+    return writing__ ? table__.NewFileTime : 0;
+}
+
+/**
+ * Function to store the window in progress, so that it is continued after
+ * a restart. The state is kept as loaded as long as the fields aggregated
+ * are not known yet.
+ *
+ * @param path: Path of the state file.
+ */
+void TableAggregator :: saveState(const string& path) const
+{
+    ofstream state_fs(path.c_str(), ofstream::out);
+
+    if (!state_fs.is_open()) {
+        Category::getInstance("TableAggregator")
+                 .error("Failed to store the window in progress for " +
+                         opt__.Name);
+        return;
+    }
+
+    bool compiled = (layoutSig__ != 0);
+    const vector<Accumulator>& accumulators = compiled ? accumulators__ :
+            loadedAccumulators__;
+
+    state_fs.precision(17);
+    state_fs << "# WindowEnd, Layout, Accumulators(Count, Mean, M2, Min, Max, SumSin, SumCos)" << endl
+             << windowEnd__ << " " << (compiled ? layoutSig__ : loadedSig__)
+             << " " << accumulators.size() << endl;
+
+    vector<Accumulator>::const_iterator acc;
+    for (acc = accumulators.begin(); acc != accumulators.end(); acc++) {
+        state_fs << acc->Count << " " << acc->Mean << " " << acc->M2 << " "
+                 << (acc->Count ? acc->Min : 0) << " "
+                 << (acc->Count ? acc->Max : 0) << " "
+                 << acc->SumSin << " " << acc->SumCos << endl;
+    }
+    state_fs.close();
+}
+
+/**
+ * Function to load the window in progress stored by saveState(). It is
+ * continued by compile() if the fields aggregated did not change.
+ *
+ * @param path: Path of the state file.
+ */
+void TableAggregator :: loadState(const string& path)
+{
+    ifstream state_fs(path.c_str(), ios_base::in);
+    char     buf[256];
+    uint4    numAcc = 0;
+
+    loadedSig__ = 0;
+    loadedAccumulators__.clear();
+
+    if (!state_fs.is_open()) {
+        return;
+    }
+
+    state_fs.getline(buf, 256);
+    if (!(state_fs >> windowEnd__ >> loadedSig__ >> numAcc)) {
+        windowEnd__ = 0;
+        loadedSig__ = 0;
+        return;
+    }
+
+    Accumulator acc;
+    while ((loadedAccumulators__.size() < numAcc) &&
+            (state_fs >> acc.Count >> acc.Mean >> acc.M2 >> acc.Min >> acc.Max
+                      >> acc.SumSin >> acc.SumCos)) {
+        if (acc.Count == 0) {
+            acc.reset();
+        }
+        loadedAccumulators__.push_back(acc);
+    }
+
+    if (loadedAccumulators__.size() != numAcc) {
+        Category::getInstance("TableAggregator")
+                 .warn("Dropping the window in progress for " + opt__.Name +
+                       ", its state file is truncated");
+        windowEnd__ = 0;
+        loadedSig__ = 0;
+        loadedAccumulators__.clear();
+    }
+}
@@ -53,6 +53,8 @@ pakbuf :: pakbuf(int ibuflen, int obuflen) : devFd__(-1), traceCommEnabled__(fal
     // Setup streambuf pointers
     setp(obuf__, obuf__ + obufsize__);
     setg((char *)ibuf__, (char *)ibuf__, (char *)ibuf__);
+    firstReadTime__.tv_sec = 0;
+    firstReadTime__.tv_usec = 0;
     return;
 }
 
@@ -211,7 +213,19 @@ int pakbuf :: readFromDevice() throw (CommException)
     // break out of the while loop.
     
     while(1) {
-       if ( (nbytes = read (devFd__, read_ptr, 1024)) ){
+       // Never read past the end of the input buffer, several responses
+       // may be arriving back to back when requests are pipelined.
+       int room = ibufsize__ - (read_ptr - ibuf__);
+       if (room <= 0) {
+           Category::getInstance("I/O")
+                    .warn("Input buffer full, discarding remaining bytes");
+           if (nread) read_ptr--;
+           break;
+       }
+       if ( (nbytes = read (devFd__, read_ptr, min(1024, room))) > 0 ){
+           if (!nread) {
+               gettimeofday(&firstReadTime__, NULL);
+           }
            nread += nbytes;
            read_ptr += nbytes;
        }
@@ -224,7 +238,7 @@ int pakbuf :: readFromDevice() throw (CommException)
     split_sequence_to_packets ((char *)ibuf__, read_ptr);
     
     setg((char *)ibuf__, (char *)ibuf__, read_ptr);
-    deque<Packet>::iterator pack_queue_itr;
+    PacketQueue::iterator pack_queue_itr;
     for (pack_queue_itr = packetQueue__.begin(); pack_queue_itr != packetQueue__.end();
             pack_queue_itr++) {
         unquote_pack (*pack_queue_itr);
@@ -303,8 +317,9 @@ void pakbuf :: split_sequence_to_packets (char *beg, char *end)
 /**
  * This function takes a packet as an argument and checks for the
  * presence of the quote byte 0xbc. The value of the byte following 
- * the quote-byte is replaced with the appropriate value. The 
- * beginning and end pointer members of the packet is updated.
+ * the quote-byte is replaced with the appropriate value. The packet
+ * is unquoted in place, since it can only shrink. The beginning and 
+ * end pointer members of the packet is updated.
  *
  * @param pack: Reference to the PakBus packet to unquote.
  */
@@ -314,7 +329,6 @@ void pakbuf :: unquote_pack (Packet& pack)
     uint2 i = 0;
     uint2 j = 0;
     int   num_quotebytes = 0;
-    byte *tmpbuf = new byte[len];
     byte *pptr;
 
     // Write the received messages to the low-level log files before they are
@@ -322,32 +336,31 @@ void pakbuf :: unquote_pack (Packet& pack)
 
     traceComm(pack.begPacket, pack.endPacket, 'R');
 
-    // The bytes between the original beginning and end pointer of
-    // the packet is copied to a temporary buffer.
+    // The bytes between the original beginning and end pointer of the 
+    // packet are unquoted in place, the write index never passes the read 
+    // index.
 
     pptr = (byte *)pack.begPacket + 1;
-    memcpy ((char *)tmpbuf, (char *)pptr, len); 
 
     while (i < len) {
-        if (tmpbuf[i] == 0xbc) {
+        if ((pptr[i] == 0xbc) && (i + 1 < len)) {
             num_quotebytes++;
             i++;
-            if (tmpbuf[i] == 0xdd) {
-                *(pptr + j) = 0xbd;
+            if (pptr[i] == 0xdd) {
+                pptr[j] = 0xbd;
             }
-            else if (tmpbuf[i] == 0xdc) {
-                *(pptr + j) = 0xbc;
+            else if (pptr[i] == 0xdc) {
+                pptr[j] = 0xbc;
             }
             else {
-                *(pptr + j) = tmpbuf[i];
+                pptr[j] = pptr[i];
             }
             i++;
             j++;
         }
         else {
             // Just keep copying
-            *(pptr + j) = tmpbuf[i++];
-            j++;
+            pptr[j++] = pptr[i++];
         }
     }
     
@@ -355,7 +368,6 @@ void pakbuf :: unquote_pack (Packet& pack)
     // packet length by the number of quotebytes read
 
     pack.endPacket -= num_quotebytes;
-    delete [] tmpbuf;
     return;
 }
 
@@ -412,31 +424,42 @@ int pakbuf :: writeToDevice() throw (CommException)
  * Function to check and quote the contents of a PakBus packet.
  * If a PakBus packet contains the 0xbc or 0xbd sysbol, the character 0xbc
  * is inserted in their place followed by 0xdc or 0xdd respectively.
+ * The quote bytes are counted first, and the message is then expanded in
+ * place starting from its end.
  *
  * @param obuf: Pointer to the beginning of a PakBus packet.
  * @param msg_len: Length of the message to check for quote-bytes.
+ * @return Length of the quoted message.
  */
 int pakbuf :: quote_msg (char* seqbuf, int msg_len)
 {
-    int   tmp_idx = 1; 
-    int   count = 1;
-    byte* tmpbuf = new byte[msg_len];
+    byte* msg = (byte *)seqbuf;
+    int   num_quotebytes = 0;
+    int   src;
+    int   dst;
+
+    if (msg_len < 2) {
+        return msg_len;
+    }
+
+    // The SerSyncBytes at both ends of the message are not quoted
+    for (src = 1; src < msg_len - 1; src++) {
+        if ((msg[src] == 0xbc) || (msg[src] == 0xbd)) {
+            num_quotebytes++;
+        }
+    }
 
-    // Copy the input messages to a temporary buffer
-    memcpy ((char *)tmpbuf, seqbuf, msg_len);
+    dst = msg_len + num_quotebytes - 1;
+    msg[dst--] = msg[msg_len - 1]; // SerSyncByte at the end of msg
 
-    while (tmp_idx < (msg_len-1)) {
-        if ( (tmpbuf[tmp_idx] == 0xbc) || (tmpbuf[tmp_idx] == 0xbd) ) {
-            seqbuf[count] = (char) 0xbc; 
-            seqbuf[++count] = tmpbuf[tmp_idx] + 0x20;
+    for (src = msg_len - 2; (src >= 1) && (dst > src); src--) {
+        if ((msg[src] == 0xbc) || (msg[src] == 0xbd)) {
+            msg[dst--] = msg[src] + 0x20;
+            msg[dst--] = 0xbc;
         }
         else {
-            seqbuf[count] = tmpbuf[tmp_idx];
+            msg[dst--] = msg[src];
         }
-        count++;
-        tmp_idx++;
     }
-    seqbuf[count++] = tmpbuf[tmp_idx]; // Get the SerSyncByte at the end of msg
-    delete [] tmpbuf;
-    return count;
+    return msg_len + num_quotebytes;
 }
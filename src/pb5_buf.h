@@ -18,6 +18,8 @@
 #include <iostream>
 #include <fstream>
 #include <deque>
+#include <vector>
+#include <sys/time.h>
 #include "utils.h"
 using namespace std;
 
@@ -35,6 +37,36 @@ typedef struct {
     bool  Complete;
 } Packet;
 
+/**
+ * Queue of the packets found in the input buffer.
+ * The packets are kept in a vector that is reused between reads, so that
+ * queueing and dequeueing packets does not allocate memory once the vector
+ * has grown to the number of packets in a read.
+ */
+class PacketQueue {
+
+    public :
+        typedef vector<Packet>::iterator iterator;
+
+        PacketQueue () : head__(0) {}
+        /** Function to get the number of packets in the queue */
+        size_t   size () const { return packets__.size() - head__; }
+        bool     empty () const { return size() == 0; }
+        /** Function to access the packet at the front of the queue */
+        Packet&  front () { return packets__[head__]; }
+        iterator begin () { return packets__.begin() + head__; }
+        iterator end () { return packets__.end(); }
+        void     push_back (const Packet& pack) { packets__.push_back(pack); }
+        /** Function to remove the packet at the front of the queue */
+        void     pop_front () { if (++head__ == packets__.size()) clear(); }
+        /** Function to empty the queue, keeping the storage for reuse */
+        void     clear () { packets__.clear(); head__ = 0; }
+
+    private :
+        vector<Packet> packets__;
+        size_t         head__;
+};
+
 /**
  * I/O Buffer Object for handling PakBus communication.
  * This class is derived from the streambuf class in the standard
@@ -47,7 +79,7 @@ class pakbuf : public streambuf {
     public :
         pakbuf (int ibufsize, int obufsize);
         ~pakbuf ();
-        deque<Packet>* getPacketQueue () { return &packetQueue__; }
+        PacketQueue*   getPacketQueue () { return &packetQueue__; }
         int            readFromDevice() throw (CommException);
         int            writeToDevice() throw (CommException);
         void           writeRaw() throw (CommException);
@@ -57,6 +89,8 @@ class pakbuf : public streambuf {
         const char*    getobeg () { return pbase(); }
         inline void    setFd(int fd) { devFd__ = fd; }
         void           setHexLogDir(const string& dir);
+        /** Function to get the time the first bytes of the last read arrived */
+        const struct timeval& getFirstReadTime() const { return firstReadTime__; }
 
     protected : 
         void       split_sequence_to_packets (char *beg, char *end);
@@ -71,7 +105,8 @@ class pakbuf : public streambuf {
         int           ibufsize__;        // Input buffer size
         int           obufsize__;        // Output buffer size
         int           devFd__;          // Device file descriptor
-        deque<Packet> packetQueue__;     // Packet queue
+        PacketQueue   packetQueue__;     // Packet queue
+        struct timeval firstReadTime__;  // Arrival of the first bytes read
         ofstream      ioCommLog__;       // Output file stream for writing I/O byte
                                        // streams to log file
         bool          traceCommEnabled__;   // When set, low-level communication
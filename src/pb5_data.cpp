@@ -20,13 +20,22 @@
 #include <sstream>
 #include <string>
 #include <cmath>
+#include <limits>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <libxml2/libxml/parser.h>
 #include <libxml2/libxml/tree.h>
 #include <log4cpp/Category.hh>
 #include "pb5.h"
+#include "pb5_decode.h"
 #include "utils.h"
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
 using namespace std;
 using namespace log4cpp;
 
@@ -43,6 +52,9 @@ void NSec :: operator+=(NSec& timeVal)
         this->sec += 1;
         this->nsec = tmp - (uint4) 1E9;
     }
+    else {
+        this->nsec = tmp;
+    }
 }
 
 int nseccmp(const NSec& t1, const NSec& t2)
@@ -102,20 +114,27 @@ string GetFixedLenString (const byte *str_ptr, const Field& var)
     if (NULL == str_ptr) {
         return "";
     }
+    return string ((const char *)str_ptr, 
+            GetFixedLenStringSize (str_ptr, var.Dimension));
+}
 
-    int   count = 0;
-    char *ptr = (char *)str_ptr;
-    char *buf = new char[var.Dimension+1];
+/**
+ * Function to find the length of a fixed length string in a bytestream, 
+ * which ends at the first null, carriage return or newline character.
+ *
+ * @param str_ptr: Pointer to the byte sequence.
+ * @param dimension: Size of the field holding the string.
+ * @return Number of characters in the string.
+ */
+uint4 GetFixedLenStringSize (const byte *str_ptr, uint4 dimension)
+{
+    uint4 count = 0;
 
-    while ( (count < (int)var.Dimension) && 
-           ((*ptr != 0x0d) && (*ptr != '\n') && (*ptr != '\0')) ) {
-        buf[count++] = *ptr++;
+    while ((count < dimension) && (str_ptr[count] != 0x0d) && 
+            (str_ptr[count] != '\n') && (str_ptr[count] != '\0')) {
+        count++;
     }
-    buf[count] = '\0';
-
-    string str(buf);
-    delete [] buf;
-    return str;
+    return count;
 }
 
 /**
@@ -131,12 +150,76 @@ string GetFixedLenString (const byte *str_ptr, const Field& var)
  */
 float intBitsToFloat (uint4 bits)
 {
-    int s = ((bits >> 31) == 0) ? 1 : -1; 
-    int e = ((bits >> 23) & 0xff);
-    int m = (e == 0) ? 
-        (bits & 0x7fffff) << 1 :
-        (bits & 0x7fffff) | 0x800000;
-    return (s*m*pow(2.0, (e-150)));
+    // Infinity is returned for NaN and zero is unsigned, as it used to be 
+    // when the number was computed from the sign, mantissa and exponent
+    if ((bits & 0x7f800000) == 0x7f800000) {
+        bits &= 0xff800000;
+    }
+    else if ((bits & 0x7fffffff) == 0) {
+        bits = 0;
+    }
+    float num;
+    memcpy (&num, &bits, sizeof(num));
+    return num;
+}
+
+/**
+ * Function to obtain the bit pattern of a floating point number, the 
+ * reverse of intBitsToFloat(). The host is expected to store floating 
+ * point numbers in the IEEE-754 format.
+ *
+ * @param num: Input floating point number.
+ * @return uint4: equivalent bit pattern.
+ */
+uint4 floatToIntBits (float num)
+{
+    uint4 bits;
+    memcpy (&bits, &num, sizeof(bits));
+    return bits;
+}
+
+/**
+ * Function to add a record to a list of record gaps. A record adjacent to 
+ * a gap extends it, and two gaps are merged if the record fills the space
+ * between them. A record already listed is ignored.
+ *
+ * @param gaps: Gaps keyed by their first record.
+ * @param rec_nbr: Number of the record to add.
+ * @param attempts: Number of failed attempts to recover the record.
+ */
+void addRecordGap (map<uint4, RecordGap>& gaps, uint4 rec_nbr, int attempts)
+{
+    map<uint4, RecordGap>::iterator next = gaps.upper_bound(rec_nbr);
+    map<uint4, RecordGap>::iterator prev = next;
+    RecordGap gap;
+
+    gap.LastRecord = rec_nbr;
+    gap.Attempts = attempts;
+
+    if (prev != gaps.begin()) {
+        --prev;
+        if (prev->second.LastRecord >= rec_nbr) {
+            return;
+        }
+        if (prev->second.LastRecord + 1 == rec_nbr) {
+            prev->second.LastRecord = rec_nbr;
+            prev->second.Attempts = max(prev->second.Attempts, attempts);
+            if ((next != gaps.end()) && (next->first == rec_nbr + 1)) {
+                prev->second.LastRecord = next->second.LastRecord;
+                prev->second.Attempts = max(prev->second.Attempts, 
+                        next->second.Attempts);
+                gaps.erase(next);
+            }
+            return;
+        }
+    }
+
+    if ((next != gaps.end()) && (next->first == rec_nbr + 1)) {
+        gap.LastRecord = next->second.LastRecord;
+        gap.Attempts = max(attempts, next->second.Attempts);
+        gaps.erase(next);
+    }
+    gaps[rec_nbr] = gap;
 }
 
 /**
@@ -153,9 +236,10 @@ float intBitsToFloat (uint4 bits)
  */ 
 float GetFinalStorageFloat (uint2 unum)
 {
+    static const float divisor[4] = { 1.0f, 10.0f, 100.0f, 1000.0f };
     int   s = (unum >> 15) ? -1 : 1;
     int   factor = (unum & 0x6000) >> 13;
-    float abs_val = pow (10.0, -1*factor) * (unum & 0x1fff);
+    float abs_val = (float)(unum & 0x1fff) / divisor[factor];
     
     if (abs_val > 6999.0) {
         return -9999;
@@ -165,13 +249,134 @@ float GetFinalStorageFloat (uint2 unum)
     }
 }
 
+/**
+ * Function to decode an array of 2-byte final storage floating point 
+ * numbers, four at a time when built with SSSE3. The decimal divisor is 
+ * looked up with a byte shuffle, and the results match the ones of 
+ * GetFinalStorageFloat().
+ *
+ * @param src: Samples as stored in the record (MSB first).
+ * @param dst: Array to store the decoded numbers in.
+ * @param count: Number of samples.
+ */
+void decodeFinalStorageFloats (const byte* src, float* dst, uint4 count)
+{
+    uint4 idx = 0;
+#ifdef __SSSE3__
+    const __m128i swap = _mm_setr_epi8(1, 0, -1, -1, 3, 2, -1, -1, 
+            5, 4, -1, -1, 7, 6, -1, -1);
+    const __m128  divisors = _mm_setr_ps(1.0f, 10.0f, 100.0f, 1000.0f);
+    const __m128i bytes = _mm_set1_epi32(0x03020100);
+    const __m128i mantissa_mask = _mm_set1_epi32(0x1fff);
+    const __m128i factor_mask = _mm_set1_epi32(0x0c);
+    const __m128  max_val = _mm_set1_ps(6999.0f);
+    const __m128  overflow_val = _mm_set1_ps(-9999.0f);
+
+    for (; idx + 4 <= count; idx += 4) {
+        __m128i u = _mm_shuffle_epi8(
+                _mm_loadl_epi64((const __m128i *)(src + 2*idx)), swap);
+        // Byte offset of the divisor for each sample, replicated to the 
+        // four bytes of the lane
+        __m128i offset = _mm_and_si128(_mm_srli_epi32(u, 11), factor_mask);
+        offset = _mm_or_si128(offset, _mm_slli_epi32(offset, 8));
+        offset = _mm_or_si128(offset, _mm_slli_epi32(offset, 16));
+        __m128 divisor = _mm_castsi128_ps(_mm_shuffle_epi8(
+                _mm_castps_si128(divisors), _mm_add_epi32(offset, bytes)));
+
+        __m128 val = _mm_div_ps(
+                _mm_cvtepi32_ps(_mm_and_si128(u, mantissa_mask)), divisor);
+        __m128 overflow = _mm_cmpgt_ps(val, max_val);
+        val = _mm_xor_ps(val, _mm_castsi128_ps(_mm_slli_epi32(
+                _mm_srli_epi32(u, 15), 31)));
+        val = _mm_or_ps(_mm_and_ps(overflow, overflow_val), 
+                _mm_andnot_ps(overflow, val));
+        _mm_storeu_ps(dst + idx, val);
+    }
+#endif
+    for (; idx < count; idx++) {
+        dst[idx] = GetFinalStorageFloat((uint2)PBDeserialize(src + 2*idx, 2));
+    }
+}
+
+/**
+ * Function to decode an array of 4-byte IEEE floating point numbers (MSB 
+ * first), four at a time when built with SSSE3. The results match the ones
+ * of intBitsToFloat().
+ *
+ * @param src: Samples as stored in the record.
+ * @param dst: Array to store the decoded numbers in.
+ * @param count: Number of samples.
+ */
+void decodeIeee4Floats (const byte* src, float* dst, uint4 count)
+{
+    uint4 idx = 0;
+#ifdef __SSSE3__
+    const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 
+            11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i exp_mask = _mm_set1_epi32(0x7f800000);
+    const __m128i inf_mask = _mm_set1_epi32(0xff800000);
+    const __m128i abs_mask = _mm_set1_epi32(0x7fffffff);
+
+    for (; idx + 4 <= count; idx += 4) {
+        __m128i bits = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i *)(src + 4*idx)), swap);
+        __m128i special = _mm_cmpeq_epi32(_mm_and_si128(bits, exp_mask), 
+                exp_mask);
+        bits = _mm_andnot_si128(_mm_andnot_si128(inf_mask, special), bits);
+        __m128i zero = _mm_cmpeq_epi32(_mm_and_si128(bits, abs_mask), 
+                _mm_setzero_si128());
+        bits = _mm_andnot_si128(zero, bits);
+        _mm_storeu_ps(dst + idx, _mm_castsi128_ps(bits));
+    }
+#endif
+    for (; idx < count; idx++) {
+        dst[idx] = intBitsToFloat(PBDeserialize(src + 4*idx, 4));
+    }
+}
+
+/**
+ * Function to decode an array of unsigned integers (MSB first) of 1, 2 or 
+ * 4 bytes, four at a time for 2 and 4 byte integers when built with SSSE3.
+ *
+ * @param src: Samples as stored in the record.
+ * @param dst: Array to store the decoded numbers in.
+ * @param count: Number of samples.
+ * @param width: Bytes per sample.
+ */
+void decodeBigEndian (const byte* src, uint4* dst, uint4 count, int width)
+{
+    uint4 idx = 0;
+#ifdef __SSSE3__
+    if (width == 4) {
+        const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 
+                11, 10, 9, 8, 15, 14, 13, 12);
+        for (; idx + 4 <= count; idx += 4) {
+            _mm_storeu_si128((__m128i *)(dst + idx), _mm_shuffle_epi8(
+                    _mm_loadu_si128((const __m128i *)(src + 4*idx)), swap));
+        }
+    }
+    else if (width == 2) {
+        const __m128i swap = _mm_setr_epi8(1, 0, -1, -1, 3, 2, -1, -1, 
+                5, 4, -1, -1, 7, 6, -1, -1);
+        for (; idx + 4 <= count; idx += 4) {
+            _mm_storeu_si128((__m128i *)(dst + idx), _mm_shuffle_epi8(
+                    _mm_loadl_epi64((const __m128i *)(src + 2*idx)), swap));
+        }
+    }
+#endif
+    for (; idx < count; idx++) {
+        dst[idx] = PBDeserialize(src + width*idx, width);
+    }
+}
+
 /**
  * Constructor for the TableDataManager class. 
  *
  * @param data_opt: Reference to the DataOutputConfig structure that contains
  *                  various information for generating file headers. 
  */
-TableDataManager :: TableDataManager () : tblDataWriter__(new AsciiWriter)
+TableDataManager :: TableDataManager () : tdfSignature__((uint2)0), 
+        tblDataWriter__(new AsciiWriter)
 { 
     tblDataWriter__->setTableDataManager(this);
 }
@@ -188,6 +393,27 @@ void TableDataManager :: setTableDataWriter(TableDataWriter* dataWriter)
     return; 
 }
 
+/**
+ * Register a consumer to inspect the records received for every table. The
+ * inspector is not owned by the TableDataManager, and must be removed 
+ * before it is destroyed.
+ *
+ * @param inspector: Pointer to the RecordInspector object.
+ */
+void TableDataManager :: addRecordInspector(RecordInspector* inspector)
+{
+    if (find(inspectors__.begin(), inspectors__.end(), inspector) == 
+            inspectors__.end()) {
+        inspectors__.push_back(inspector);
+    }
+}
+
+void TableDataManager :: removeRecordInspector(RecordInspector* inspector)
+{
+    inspectors__.erase(remove(inspectors__.begin(), inspectors__.end(), 
+            inspector), inspectors__.end());
+}
+
 const DLProgStats& TableDataManager :: getProgStats() const
 {
     return dataLoggerProgStats__;
@@ -199,6 +425,89 @@ void TableDataManager :: setProgStats(DLProgStats& progStats)
     return; 
 }
 
+/**
+ * Function to load the programming statistics saved by an earlier session.
+ * The cache is only valid for the table definitions file it was saved 
+ * with, and for SESSION_CACHE_MAX_AGE seconds. BuildTDF() must be called
+ * before.
+ *
+ * @return SUCCESS | FAILURE.
+ */
+int TableDataManager :: loadSessionCache ()
+{
+    string cache_file = dataOutputConfig__.WorkingPath + "/.working/session";
+    struct stat cache_stat;
+
+    if ((stat(cache_file.c_str(), &cache_stat) != 0) || 
+            (time(NULL) - cache_stat.st_mtime > SESSION_CACHE_MAX_AGE)) {
+        return FAILURE;
+    }
+
+    ifstream    cache_fs(cache_file.c_str());
+    DLProgStats prog_stats;
+    uint2       tdf_sig;
+    string      line;
+
+    getline(cache_fs, line);
+    getline(cache_fs, prog_stats.SerialNbr);
+    getline(cache_fs, prog_stats.OSVer);
+    getline(cache_fs, prog_stats.PowUpProg);
+    getline(cache_fs, prog_stats.ProgName);
+    cache_fs >> prog_stats.OSSig >> prog_stats.ProgSig >> tdf_sig;
+
+    if (!cache_fs || tableList__.empty() || (tdf_sig != tdfSignature__)) {
+        return FAILURE;
+    }
+
+    dataLoggerProgStats__ = prog_stats;
+
+    stringstream logmsg;
+    logmsg << "Loaded session cache - (SerialNbr:" << prog_stats.SerialNbr 
+           << ",OSSig:" << prog_stats.OSSig << ",ProgName:" 
+           << prog_stats.ProgName << ",ProgSig:" << prog_stats.ProgSig << ")";
+    Category::getInstance("TableDataManager").debug(logmsg.str());
+    return SUCCESS;
+}
+
+/**
+ * Function to save the programming statistics along with the signature of
+ * the table definitions file, so that later sessions can skip fetching
+ * them from the logger.
+ */
+void TableDataManager :: saveSessionCache ()
+{
+    string   cache_file = dataOutputConfig__.WorkingPath + "/.working/session";
+    ofstream cache_fs(cache_file.c_str(), ofstream::out);
+
+    if (!cache_fs.is_open()) {
+        Category::getInstance("TableDataManager")
+                 .error("Failed to store session cache : " + cache_file);
+        return;
+    }
+
+    cache_fs << "# SerialNbr, OSVer, PowUpProg, ProgName, OSSig ProgSig TDFSignature" << endl
+             << dataLoggerProgStats__.SerialNbr << endl
+             << dataLoggerProgStats__.OSVer << endl
+             << dataLoggerProgStats__.PowUpProg << endl
+             << dataLoggerProgStats__.ProgName << endl
+             << dataLoggerProgStats__.OSSig << " " 
+             << dataLoggerProgStats__.ProgSig << " " 
+             << tdfSignature__ << endl;
+    cache_fs.close();
+}
+
+/**
+ * Function to drop the programming statistics, along with the copy saved
+ * for later sessions, once they no longer match the table definitions.
+ */
+void TableDataManager :: clearSessionCache ()
+{
+    string cache_file = dataOutputConfig__.WorkingPath + "/.working/session";
+
+    unlink(cache_file.c_str());
+    dataLoggerProgStats__ = DLProgStats();
+}
+
 const DataOutputConfig& TableDataManager :: getDataOutputConfig() const
 {
     return dataOutputConfig__;
@@ -208,9 +517,25 @@ void TableDataManager :: setDataOutputConfig(const DataOutputConfig& dataOpt)
 {
     dataOutputConfig__ = dataOpt;
     tableList__.reserve(dataOpt.Tables.size()+2);
+
+    clearAggregators();
+    vector<AggregateOpt>::const_iterator itr;
+    for (itr = dataOpt.Aggregates.begin(); itr != dataOpt.Aggregates.end();
+            itr++) {
+        aggregators__.push_back(new TableAggregator(*itr, this));
+    }
     return; 
 }
 
+void TableDataManager :: clearAggregators()
+{
+    vector<TableAggregator*>::iterator itr;
+    for (itr = aggregators__.begin(); itr != aggregators__.end(); itr++) {
+        delete *itr;
+    }
+    aggregators__.clear();
+}
+
 /**
  * Destructor for the TableDataManager class.
  * For each table structure build from the table definition file, it
@@ -222,6 +547,7 @@ TableDataManager :: ~TableDataManager ()
     Category::getInstance("TableDataManager")
              .debug("Saving history for all collected tables.");
     saveTableStorageHistory();
+    clearAggregators();
 }
 
 /**
@@ -230,31 +556,85 @@ TableDataManager :: ~TableDataManager ()
 void TableDataManager :: saveTableStorageHistory()
 {
     ofstream tinfoFs;
-    string   tinfoFile;
 
     for (int count = 0; count < (int)tableList__.size(); count++) {
 
-        tinfoFile.append(dataOutputConfig__.WorkingPath)
-                 .append("/.working/info.")
-                 .append(tableList__[count].TblName);
+        saveTableHistory(tableList__[count]);
+
+        // Records skipped during the collection are listed separately, 
+        // one range per line
+        const map<uint4, RecordGap>& gaps = tableList__[count].Gaps;
+        string gapsFile = dataOutputConfig__.WorkingPath + "/.working/gaps." 
+                + tableList__[count].TblName;
 
-        tinfoFs.open (tinfoFile.c_str(), ofstream::out);
+        if (gaps.empty()) {
+            unlink(gapsFile.c_str());
+            continue;
+        }
 
+        tinfoFs.open (gapsFile.c_str(), ofstream::out);
         if (tinfoFs.is_open()) {
-            tinfoFs << "# NextRecord, LastRecordTime, NewFileTime, TimeOfFirstSampleInFile" << endl
-                    << tableList__[count].NextRecord << endl
-                    << tableList__[count].LastRecordTime.sec << " " 
-                    << tableList__[count].LastRecordTime.nsec << endl
-                    << tableList__[count].NewFileTime << endl
-                    << tableList__[count].FirstSampleInFile << endl;
+            tinfoFs << "# FirstRecord, LastRecord, Attempts" << endl;
+            for (map<uint4, RecordGap>::const_iterator itr = gaps.begin(); 
+                    itr != gaps.end(); itr++) {
+                tinfoFs << itr->first << " " << itr->second.LastRecord << " "
+                        << itr->second.Attempts << endl;
+            }
             tinfoFs.close();
         }
-        else { 
+        else {
             Category::getInstance("TableDataManager")
-                     .error("Failed to store collection state for " + 
+                     .error("Failed to store record gaps for " + 
                               tableList__[count].TblName);
         }
-        tinfoFile.clear();
+    }
+
+    // Derived tables keep the window in progress along with their history
+    vector<TableAggregator*>::iterator itr;
+    for (itr = aggregators__.begin(); itr != aggregators__.end(); itr++) {
+        saveTableHistory((*itr)->getTable());
+        (*itr)->saveState(dataOutputConfig__.WorkingPath + "/.working/aggr." 
+                + (*itr)->getTable().TblName);
+    }
+}
+
+/**
+ * Function to store the parameters tracking the data collection and the 
+ * data files of a table.
+ */
+void TableDataManager :: saveTableHistory(const Table& tbl)
+{
+    ofstream tinfoFs;
+    string   tinfoFile;
+
+    tinfoFile.append(dataOutputConfig__.WorkingPath)
+             .append("/.working/info.")
+             .append(tbl.TblName);
+
+    tinfoFs.open (tinfoFile.c_str(), ofstream::out);
+
+    if (tinfoFs.is_open()) {
+        const vector<uint2>& fieldNumbers = tbl.FieldNumbers;
+
+        tinfoFs << "# NextRecord, LastRecordTime, NewFileTime, TimeOfFirstSampleInFile, FieldNumbers, BackfillRange" << endl
+                << tbl.NextRecord << endl
+                << tbl.LastRecordTime.sec << " " 
+                << tbl.LastRecordTime.nsec << endl
+                << tbl.NewFileTime << endl
+                << tbl.FirstSampleInFile << endl
+                << fieldNumbers.size();
+        for (int idx = 0; idx < (int)fieldNumbers.size(); idx++) {
+            tinfoFs << " " << fieldNumbers[idx];
+        }
+        tinfoFs << endl
+                << tbl.BackfillNext << " "
+                << tbl.BackfillEnd << endl;
+        tinfoFs.close();
+    }
+    else { 
+        Category::getInstance("TableDataManager")
+                 .error("Failed to store collection state for " + 
+                          tbl.TblName);
     }
 }
 
@@ -262,200 +642,680 @@ void TableDataManager :: saveTableStorageHistory()
  * Function to construct Table structure information from the Table 
  * Definitions File.
  * It builds and maintains the table information in a vector of Table
- * structures in memory. Also the constructed table information is 
- * written to a XML file in the $DATA/.working directory.
+ * structures in memory. The parsed definitions are cached in a compiled
+ * form in the $DATA/.working directory, and loaded from the cache as long
+ * as the signature of the definitions file matches. The table information
+ * is also written to a XML file in the same directory, when the 
+ * definitions file changes.
  *
  * @return SUCCESS | FAILURE.
  */
 int TableDataManager :: BuildTDF()
 {
-    ifstream TDFdata;
     tableList__.clear();
     string   conf_dir(dataOutputConfig__.WorkingPath);
     conf_dir += "/.working";
     string   tdf_file(conf_dir);
     string   xml_file(conf_dir);
+    string   cache_file(conf_dir);
     tdf_file += "/tdf.dat";
     xml_file += "/tdf.xml";
+    cache_file += "/tdf.cache";
 
-    TDFdata.open (tdf_file.c_str(), ios::binary);
+    struct stat tdf_stat, xml_stat;
+    int fd = open (tdf_file.c_str(), O_RDONLY);
 
-    if (!TDFdata.is_open()) {
+    if ((fd < 0) || fstat (fd, &tdf_stat)) {
          Category::getInstance("TableDataManager")
                   .warn("Table definitions file does not exist : " +
                            tdf_file);
+        if (fd >= 0) {
+            close (fd);
+        }
         return FAILURE;
     }
-    TDFdata.seekg (0, ios_base::end);
-    int len = TDFdata.tellg ();
-    TDFdata.seekg (0, ios_base::beg);
+    uint4 len = tdf_stat.st_size;
 
     if (len == 0) {
         Category::getInstance("TableDataManager")
                  .error("No data available for parsing Table definitions");
-        TDFdata.close();
+        close (fd);
         Category::getInstance("TableDataManager")
                  .info("Removing invalid table definition file : " + tdf_file);
         unlink(tdf_file.c_str());
         return FAILURE;
     }
 
-    byte* tdf_data = NULL;
+    byte* tdf_data = (byte *)mmap (NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
 
-    try {
-        tdf_data = new byte[len];
-    } 
-    catch(bad_alloc& bae) {
+    if (tdf_data == (byte *)MAP_FAILED) {
         Category::getInstance("TableDataManager")
-                 .error("Failed to allocate buffer to parsing Table definitions");
-        TDFdata.close();
+                 .error("Failed to map the Table definitions file : " + 
+                         tdf_file);
         return FAILURE;
     }
 
-    TDFdata.read ((char *)tdf_data, len);
+    tdfSignature__ = CalcSig (tdf_data, len, 0xaaaa);
 
-    byte* ptr    = tdf_data;
-    byte* endptr = tdf_data+len;
-    int   table_num = 1; 
+    if (loadTDFCache (cache_file, len) != SUCCESS) {
+        byte* ptr    = tdf_data;
+        byte* endptr = tdf_data+len;
+        int   table_num = 1; 
 
-    fslVersion__ = *ptr++;
+        fslVersion__ = *ptr++;
     
-    while (ptr < endptr) {
-        int nbytes = readTableDefinition (table_num, ptr, endptr);
-        if (nbytes == -1) {
-            Category::getInstance("TableDataManager")
-                     .error("Failed to parse table definitions from : " + tdf_file);
-            tableList__.clear();
-            delete [] tdf_data;
-            TDFdata.close();
-            Category::getInstance("TableDataManager")
-                     .info("Removing invalid table definition file : " + tdf_file);
-            unlink(tdf_file.c_str());
-            return FAILURE;
-            break;
+        while (ptr < endptr) {
+            int nbytes = readTableDefinition (table_num, ptr, endptr);
+            if (nbytes == -1) {
+                Category::getInstance("TableDataManager")
+                         .error("Failed to parse table definitions from : " + 
+                                 tdf_file);
+                tableList__.clear();
+                munmap (tdf_data, len);
+                Category::getInstance("TableDataManager")
+                         .info("Removing invalid table definition file : " + 
+                                 tdf_file);
+                unlink(tdf_file.c_str());
+                unlink(cache_file.c_str());
+                return FAILURE;
+            }
+            ptr += nbytes;
+            table_num++;
+        }
+
+        for (int idx = 0; idx < (int)tableList__.size(); idx++) {
+            tableList__[idx].RecordSize = getRecordSize(tableList__[idx]);
         }
-        ptr += nbytes;
-        table_num++;
+        saveTDFCache (cache_file, len);
     }
    
-    // Clean up the buffer memory
-    delete [] tdf_data;
+    munmap (tdf_data, len);
 
-    // Dump the table definitions into a XML file
-    xmlDumpTDF ((char *)xml_file.c_str());
+    // Dump the table definitions into a XML file, unless it was already
+    // done for this definitions file
+    if ((stat(xml_file.c_str(), &xml_stat) != 0) || 
+            (xml_stat.st_mtime < tdf_stat.st_mtime)) {
+        xmlDumpTDF ((char *)xml_file.c_str());
+    }
 
     // Load the storage history for various tables - information as last 
     // stored index etc.
     loadTableStorageHistory();
 
+    // Detect the runs of fields sharing a data type up front. The plan of a
+    // table collected with a field subset is compiled once the subset is
+    // selected.
+    for (int idx = 0; idx < (int)tableList__.size(); idx++) {
+        if (tableList__[idx].FieldNumbers.empty()) {
+            compileDecodePlan(tableList__[idx]);
+        }
+    }
+
     return SUCCESS;
 }
 
+/*
+ * Layout of the compiled table definitions cache: the header, followed by
+ * the arrays of tables, fields and subscript dimensions, and the pool of
+ * null-terminated strings referenced by their offset. Each string is 
+ * stored once. The cache is only read by the host that wrote it, so the
+ * numbers are stored in the host byte order.
+ */
+struct TDFCacheHeader {
+    char   Magic[4];
+    uint4  Version;
+    uint4  TDFSize;
+    uint2  TDFSignature;
+    byte   FslVersion;
+    uint4  NumTables;
+    uint4  NumFields;
+    uint4  NumSubDims;
+    uint4  StringsSize;
+};
+
+struct TDFCacheTable {
+    uint4  TblName;
+    int    TblNum;
+    uint4  TblSize;
+    byte   TimeType;
+    uint4  TblTimeInfo[2];
+    uint4  TblTimeInterval[2];
+    uint2  TblSignature;
+    int    RecordSize;
+    uint4  FirstField;
+    uint4  NumFields;
+};
+
+struct TDFCacheField {
+    byte   FieldType;
+    uint4  FieldName;
+    uint4  Processing;
+    uint4  Unit;
+    uint4  Description;
+    uint4  BegIdx;
+    uint4  Dimension;
+    uint4  FirstSubDim;
+    uint4  NumSubDims;
+};
+
+static const char TDF_CACHE_MAGIC[4] = { 'T', 'D', 'F', 'C' };
+
 /**
- * Function to load the storage history for each table found in the TDF file.
+ * Function to load the table definitions from the compiled cache. The 
+ * cache is mapped in a single call and only used if it was compiled from
+ * a definitions file of the same size and signature.
+ *
+ * @param cache_file: Path of the cache.
+ * @param tdf_size: Size of the table definitions file.
+ * @return SUCCESS | FAILURE (The cache is missing, stale or corrupt).
  */
-void TableDataManager :: loadTableStorageHistory()
+int TableDataManager :: loadTDFCache (const string& cache_file, 
+        uint4 tdf_size)
 {
-    ifstream tinfo_fs;
-    string   tinfo_file;
-    char     buf[256];
-
-    for (int count = 0; count < (int)tableList__.size(); count++) {
-
-        tinfo_file = dataOutputConfig__.WorkingPath + "/.working/info." 
-                + tableList__[count].TblName;
+    struct stat cache_stat;
+    int fd = open (cache_file.c_str(), O_RDONLY);
 
-        tinfo_fs.open(tinfo_file.c_str(), ios_base::in);
+    if ((fd < 0) || fstat (fd, &cache_stat) || 
+            (cache_stat.st_size < (off_t)sizeof(TDFCacheHeader))) {
+        if (fd >= 0) {
+            close (fd);
+        }
+        return FAILURE;
+    }
 
-        if (tinfo_fs.is_open()) {
+    uint4 len = cache_stat.st_size;
+    byte* data = (byte *)mmap (NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
 
-            NSec lastRecordTime;
+    if (data == (byte *)MAP_FAILED) {
+        return FAILURE;
+    }
 
-            tinfo_fs.getline (buf, 256);
-            tinfo_fs >> tableList__[count].NextRecord
-                     >> lastRecordTime.sec >> lastRecordTime.nsec
-                     >> tableList__[count].NewFileTime
-                     >> tableList__[count].FirstSampleInFile;
-            tableList__[count].LastRecordTime = lastRecordTime;
+    const TDFCacheHeader* hdr = (const TDFCacheHeader *)data;
+    const TDFCacheTable*  tables = (const TDFCacheTable *)(hdr + 1);
+    const TDFCacheField*  fields = 
+            (const TDFCacheField *)(tables + hdr->NumTables);
+    const uint4* sub_dims = (const uint4 *)(fields + hdr->NumFields);
+    const char*  strings = (const char *)(sub_dims + hdr->NumSubDims);
+
+    if (memcmp (hdr->Magic, TDF_CACHE_MAGIC, 4) || 
+            (hdr->Version != TDF_CACHE_VERSION) || 
+            (hdr->TDFSize != tdf_size) || 
+            (hdr->TDFSignature != tdfSignature__) || 
+            (hdr->NumTables > len) || (hdr->NumFields > len) || 
+            (hdr->NumSubDims > len) || (hdr->StringsSize == 0) ||
+            (strings + hdr->StringsSize != (const char *)data + len) || 
+            (strings[hdr->StringsSize - 1] != '\0')) {
+        munmap (data, len);
+        return FAILURE;
+    }
 
-            tinfo_fs.close();
+    for (uint4 tbl_idx = 0; tbl_idx < hdr->NumTables; tbl_idx++) {
+        const TDFCacheTable& entry = tables[tbl_idx];
+        Table tbl;
 
-            stringstream logmsg;
-            logmsg << "Loaded history - " << tableList__[count].TblName 
-                   << "(NextRecord:" << tableList__[count].NextRecord << ","
-                   << "LastRecordTime:" << tableList__[count].LastRecordTime.sec 
-                   << "." << tableList__[count].LastRecordTime.nsec << ","
-                   << "NewFileTime:" << tableList__[count].NewFileTime << ","
-                   << "FirstSampleInFile:" << tableList__[count].FirstSampleInFile
-                   << ")";
-            Category::getInstance("TableDataManager")
-                     .debug(logmsg.str());
+        if ((entry.TblName >= hdr->StringsSize) || 
+                (entry.FirstField + entry.NumFields > hdr->NumFields) ||
+                (entry.FirstField + entry.NumFields < entry.FirstField)) {
+            tableList__.clear();
+            munmap (data, len);
+            return FAILURE;
         }
+        tbl.TblName = strings + entry.TblName;
+        tbl.TblNum = entry.TblNum;
+        tbl.TblSize = entry.TblSize;
+        tbl.TimeType = entry.TimeType;
+        tbl.TblTimeInfo.sec = entry.TblTimeInfo[0];
+        tbl.TblTimeInfo.nsec = entry.TblTimeInfo[1];
+        tbl.TblTimeInterval.sec = entry.TblTimeInterval[0];
+        tbl.TblTimeInterval.nsec = entry.TblTimeInterval[1];
+        tbl.TblSignature = entry.TblSignature;
+        tbl.RecordSize = entry.RecordSize;
+        tbl.field_list.resize(entry.NumFields);
+
+        for (uint4 idx = 0; idx < entry.NumFields; idx++) {
+            const TDFCacheField& field = fields[entry.FirstField + idx];
+            Field& var = tbl.field_list[idx];
+
+            if ((field.FieldName >= hdr->StringsSize) || 
+                    (field.Processing >= hdr->StringsSize) || 
+                    (field.Unit >= hdr->StringsSize) || 
+                    (field.Description >= hdr->StringsSize) || 
+                    (field.FirstSubDim + field.NumSubDims > hdr->NumSubDims) ||
+                    (field.FirstSubDim + field.NumSubDims < field.FirstSubDim)) {
+                tableList__.clear();
+                munmap (data, len);
+                return FAILURE;
+            }
+            var.FieldType = field.FieldType;
+            var.FieldName = strings + field.FieldName;
+            var.Processing = strings + field.Processing;
+            var.Unit = strings + field.Unit;
+            var.Description = strings + field.Description;
+            var.BegIdx = field.BegIdx;
+            var.Dimension = field.Dimension;
+            var.SubDim.assign(sub_dims + field.FirstSubDim, 
+                    sub_dims + field.FirstSubDim + field.NumSubDims);
+        }
+        tableList__.push_back(tbl);
+    }
+    fslVersion__ = hdr->FslVersion;
 
-        tinfo_file.clear();
+    munmap (data, len);
+    return SUCCESS;
+}
+
+/**
+ * Function to intern a string in the string pool of the definitions cache.
+ *
+ * @return Offset of the string in the pool.
+ */
+static uint4 internString (const string& str, string& pool, 
+        map<string, uint4>& offsets)
+{
+    map<string, uint4>::iterator itr = offsets.find(str);
+    if (itr != offsets.end()) {
+        return itr->second;
     }
-    return;
+    uint4 offset = pool.size();
+    pool.append(str.c_str(), str.size() + 1);
+    offsets[str] = offset;
+    return offset;
 }
 
-void
-TableDataManager :: cleanCache ()
+/**
+ * Function to store the table definitions in the compiled cache, loaded
+ * by loadTDFCache() as long as the definitions file doesn't change. The 
+ * cache is replaced atomically.
+ *
+ * @param cache_file: Path of the cache.
+ * @param tdf_size: Size of the table definitions file.
+ */
+void TableDataManager :: saveTDFCache (const string& cache_file, 
+        uint4 tdf_size)
 {
-    Category::getInstance("TableDataManager")
-            .debug("Removing table definitions file ...");
-    string path(dataOutputConfig__.WorkingPath);
-    path += "/.working/tdf.dat";
-    unlink(path.c_str());
-    
-    path = dataOutputConfig__.WorkingPath;
-    path += "/.working/tdf.xml";
-    unlink(path.c_str());
+    TDFCacheHeader      hdr;
+    vector<TDFCacheTable> tables;
+    vector<TDFCacheField> fields;
+    vector<uint4>       sub_dims;
+    string              pool;
+    map<string, uint4>  offsets;
+
+    memset (&hdr, 0, sizeof(hdr));
+    memcpy (hdr.Magic, TDF_CACHE_MAGIC, 4);
+    hdr.Version = TDF_CACHE_VERSION;
+    hdr.TDFSize = tdf_size;
+    hdr.TDFSignature = tdfSignature__;
+    hdr.FslVersion = fslVersion__;
+
+    for (int tbl_idx = 0; tbl_idx < (int)tableList__.size(); tbl_idx++) {
+        const Table& tbl = tableList__[tbl_idx];
+        TDFCacheTable entry;
+
+        memset (&entry, 0, sizeof(entry));
+        entry.TblName = internString (tbl.TblName, pool, offsets);
+        entry.TblNum = tbl.TblNum;
+        entry.TblSize = tbl.TblSize;
+        entry.TimeType = tbl.TimeType;
+        entry.TblTimeInfo[0] = tbl.TblTimeInfo.sec;
+        entry.TblTimeInfo[1] = tbl.TblTimeInfo.nsec;
+        entry.TblTimeInterval[0] = tbl.TblTimeInterval.sec;
+        entry.TblTimeInterval[1] = tbl.TblTimeInterval.nsec;
+        entry.TblSignature = tbl.TblSignature;
+        entry.RecordSize = tbl.RecordSize;
+        entry.FirstField = fields.size();
+        entry.NumFields = tbl.field_list.size();
+
+        for (int idx = 0; idx < (int)tbl.field_list.size(); idx++) {
+            const Field& var = tbl.field_list[idx];
+            TDFCacheField field;
+
+            memset (&field, 0, sizeof(field));
+            field.FieldType = var.FieldType;
+            field.FieldName = internString (var.FieldName, pool, offsets);
+            field.Processing = internString (var.Processing, pool, offsets);
+            field.Unit = internString (var.Unit, pool, offsets);
+            field.Description = internString (var.Description, pool, offsets);
+            field.BegIdx = var.BegIdx;
+            field.Dimension = var.Dimension;
+            field.FirstSubDim = sub_dims.size();
+            field.NumSubDims = var.SubDim.size();
+            sub_dims.insert(sub_dims.end(), var.SubDim.begin(), 
+                    var.SubDim.end());
+            fields.push_back(field);
+        }
+        tables.push_back(entry);
+    }
+    internString ("", pool, offsets);
 
-    string tinfo_file;
+    hdr.NumTables = tables.size();
+    hdr.NumFields = fields.size();
+    hdr.NumSubDims = sub_dims.size();
+    hdr.StringsSize = pool.size();
 
-    Category::getInstance("TableDataManager")
-            .debug("Resetting data collection parameters");
+    string tmp_file(cache_file + ".tmp");
+    ofstream cache_fs (tmp_file.c_str(), ios::binary | ios::trunc);
 
-    for (int count = 0; count < (int)tableList__.size(); count++) {
-        tinfo_file = dataOutputConfig__.WorkingPath + "/.working/info." 
-                + tableList__[count].TblName;
-        // unlink (tinfo_file.c_str());
-        tinfo_file = dataOutputConfig__.WorkingPath + "/.working/" 
-                + tableList__[count].TblName + ".tmp";
-        unlink (tinfo_file.c_str());
-        tableList__[count].NextRecord = 0;
-        tableList__[count].NewFileTime = 0;
-        tableList__[count].FirstSampleInFile = 0; 
-        tableList__[count].LastRecordTime.sec = 0; 
-        tableList__[count].LastRecordTime.nsec = 0; 
+    if (cache_fs.is_open()) {
+        cache_fs.write ((const char *)&hdr, sizeof(hdr));
+        if (!tables.empty()) {
+            cache_fs.write ((const char *)&tables[0], 
+                    tables.size() * sizeof(TDFCacheTable));
+        }
+        if (!fields.empty()) {
+            cache_fs.write ((const char *)&fields[0], 
+                    fields.size() * sizeof(TDFCacheField));
+        }
+        if (!sub_dims.empty()) {
+            cache_fs.write ((const char *)&sub_dims[0], 
+                    sub_dims.size() * sizeof(uint4));
+        }
+        cache_fs.write (pool.data(), pool.size());
+        cache_fs.close();
+    }
+
+    if (!cache_fs.good() || rename (tmp_file.c_str(), cache_file.c_str())) {
+        Category::getInstance("TableDataManager")
+                 .warn("Failed to store the table definitions cache : " + 
+                         cache_file);
+        unlink (tmp_file.c_str());
     }
-    tableList__.clear();
-    return;
 }
 
-/** 
- * Read the structure of a table. A successful call returns the 
- * length of the segment for this table in the table definition file.
+/**
+ * Function to rebuild the table definitions from a Table Definitions File
+ * newly fetched from the logger, keeping the collection state of tables
+ * whose definition (signature) did not change. The data files of tables
+ * that were modified or removed are published, and the modified tables are
+ * collected again from the oldest record available on the logger. If the
+ * new file fails to parse, the current definitions are kept in use.
  *
- * @param table_num: Index for table number, beginning from 1. 
- * @param byte_ptr:  Pointer to the memory location to start reading next
- *                   table structure information.
- * @param endptr:    Pointer to the end of the buffer containing the 
- *                   table definition information. A read shouldn't be
- *                   performed beyond this limit.
- * @return Returns size of the table structure read in bytes. If the 
- * end of the byte stream was reached before completing the parsing,
- * -1 is returned.
+ * @return SUCCESS | FAILURE.
  */
-int TableDataManager :: readTableDefinition (int table_num, byte *byte_ptr, byte *endptr)
+int TableDataManager :: ReloadTDF() throw (StorageException)
 {
-    Table tbl;
-    byte *ptr = byte_ptr;
+    stringstream msgstrm;
 
-    if (ptr > endptr) return (-1);
-    tbl.TblName = GetVarLenString (ptr);
-    ptr += tbl.TblName.size ()+1;
+    // Persist the current state, BuildTDF() restores it for every table
+    // that is still defined
+    saveTableStorageHistory();
+    vector<Table> oldTableList(tableList__);
+    byte  oldFslVersion = fslVersion__;
+    uint2 oldSignature = tdfSignature__;
+
+    if (BuildTDF() == FAILURE) {
+        tableList__ = oldTableList;
+        fslVersion__ = oldFslVersion;
+        tdfSignature__ = oldSignature;
+        return FAILURE;
+    }
 
-    if (ptr > endptr) return -1;
+    // The programming statistics belong to the previous definitions
+    if (tdfSignature__ != oldSignature) {
+        clearSessionCache();
+    }
+
+    vector<bool> isChecked(tableList__.size(), false);
+
+    for (int count = 0; count < (int)oldTableList.size(); count++) {
+        Table& old_tbl = oldTableList[count];
+        int    idx = 0;
+
+        while ((idx < (int)tableList__.size()) && 
+                (tableList__[idx].TblName != old_tbl.TblName)) {
+            idx++;
+        }
+
+        if ((idx < (int)tableList__.size()) && 
+                (tableList__[idx].TblSignature == old_tbl.TblSignature)) {
+            // Close the data file left open by an interrupted collection,
+            // it is appended to when the collection is retried
+            tblDataWriter__->finishWrite(old_tbl);
+            isChecked[idx] = true;
+            continue;
+        }
+
+        // Publish the records stored using the old definition
+        tblDataWriter__->flush(old_tbl);
+
+        string tmp_file = dataOutputConfig__.WorkingPath + "/.working/" 
+                + old_tbl.TblName + BACKFILL_FILE_TAG + ".tmp";
+        unlink (tmp_file.c_str());
+        tmp_file = dataOutputConfig__.WorkingPath + "/.working/" 
+                + old_tbl.TblName + GAPFILL_FILE_TAG + ".tmp";
+        unlink (tmp_file.c_str());
+
+        if (idx < (int)tableList__.size()) {
+            msgstrm << "Definition of table " << old_tbl.TblName 
+                    << " changed, restarting its data collection";
+            resetCollectionState(tableList__[idx]);
+            isChecked[idx] = true;
+        }
+        else {
+            msgstrm << "Table " << old_tbl.TblName 
+                    << " is no longer defined on the logger";
+        }
+        Category::getInstance("TableDataManager").notice(msgstrm.str());
+        msgstrm.str("");
+    }
+
+    // The history of tables that were not defined before may be stale
+    for (int idx = 0; idx < (int)tableList__.size(); idx++) {
+        if (!isChecked[idx]) {
+            Category::getInstance("TableDataManager")
+                     .notice("New table defined on the logger : " 
+                             + tableList__[idx].TblName);
+            resetCollectionState(tableList__[idx]);
+        }
+    }
+
+    saveTableStorageHistory();
+    return SUCCESS;
+}
+
+/**
+ * Function to reset the parameters tracking the data collection for a 
+ * table, so that it restarts from the oldest record on the logger.
+ */
+void TableDataManager :: resetCollectionState(Table& tbl)
+{
+    tbl.NextRecord = 0;
+    tbl.NewFileTime = 0;
+    tbl.FirstSampleInFile = 0; 
+    tbl.LastRecordTime.sec = 0; 
+    tbl.LastRecordTime.nsec = 0; 
+    tbl.FieldNumbers.clear();
+    tbl.collect_list.clear();
+    tbl.DecodePlan.clear();
+    tbl.BackfillNext = 0;
+    tbl.BackfillEnd = 0;
+    tbl.Gaps.clear();
+}
+
+/**
+ * Function to load the storage history for each table found in the TDF file.
+ */
+void TableDataManager :: loadTableStorageHistory()
+{
+    ifstream tinfo_fs;
+    string   tinfo_file;
+    char     buf[256];
+
+    for (int count = 0; count < (int)tableList__.size(); count++) {
+
+        loadTableHistory(tableList__[count]);
+
+        tinfo_file = dataOutputConfig__.WorkingPath + "/.working/gaps." 
+                + tableList__[count].TblName;
+        tableList__[count].Gaps.clear();
+        tinfo_fs.clear();
+        tinfo_fs.open(tinfo_file.c_str(), ios_base::in);
+
+        if (tinfo_fs.is_open()) {
+            uint4     firstRecord;
+            RecordGap gap;
+
+            tinfo_fs.getline (buf, 256);
+            while (tinfo_fs >> firstRecord >> gap.LastRecord >> gap.Attempts) {
+                if (gap.LastRecord >= firstRecord) {
+                    tableList__[count].Gaps[firstRecord] = gap;
+                }
+            }
+            tinfo_fs.close();
+        }
+
+        tinfo_file.clear();
+    }
+
+    vector<TableAggregator*>::iterator itr;
+    for (itr = aggregators__.begin(); itr != aggregators__.end(); itr++) {
+        loadTableHistory((*itr)->getTable());
+        (*itr)->loadState(dataOutputConfig__.WorkingPath + "/.working/aggr." 
+                + (*itr)->getTable().TblName);
+    }
+    return;
+}
+
+/**
+ * Function to load the parameters tracking the data collection and the 
+ * data files of a table, stored by saveTableHistory().
+ */
+void TableDataManager :: loadTableHistory(Table& tbl)
+{
+    ifstream tinfo_fs;
+    string   tinfo_file;
+    char     buf[256];
+
+    tinfo_file = dataOutputConfig__.WorkingPath + "/.working/info." 
+            + tbl.TblName;
+
+    tinfo_fs.open(tinfo_file.c_str(), ios_base::in);
+
+    if (tinfo_fs.is_open()) {
+
+        NSec lastRecordTime;
+
+        tinfo_fs.getline (buf, 256);
+        tinfo_fs >> tbl.NextRecord
+                 >> lastRecordTime.sec >> lastRecordTime.nsec
+                 >> tbl.NewFileTime
+                 >> tbl.FirstSampleInFile;
+        tbl.LastRecordTime = lastRecordTime;
+
+        // Field subset used for the records collected so far, missing
+        // in history files written by older versions
+        int   numFields = 0;
+        uint2 fieldNumber;
+        tbl.FieldNumbers.clear();
+        if (tinfo_fs >> numFields) {
+            while ((numFields-- > 0) && (tinfo_fs >> fieldNumber)) {
+                tbl.FieldNumbers.push_back(fieldNumber);
+            }
+        }
+
+        // Records pending to be backfilled, also optional
+        if (!(tinfo_fs >> tbl.BackfillNext >> tbl.BackfillEnd)) {
+            tbl.BackfillNext = 0;
+            tbl.BackfillEnd = 0;
+        }
+
+        tinfo_fs.close();
+
+        stringstream logmsg;
+        logmsg << "Loaded history - " << tbl.TblName 
+               << "(NextRecord:" << tbl.NextRecord << ","
+               << "LastRecordTime:" << tbl.LastRecordTime.sec 
+               << "." << tbl.LastRecordTime.nsec << ","
+               << "NewFileTime:" << tbl.NewFileTime << ","
+               << "FirstSampleInFile:" << tbl.FirstSampleInFile
+               << ",Backfill:" << tbl.BackfillNext 
+               << "-" << tbl.BackfillEnd
+               << ")";
+        Category::getInstance("TableDataManager")
+                 .debug(logmsg.str());
+    }
+}
+
+void
+TableDataManager :: cleanCache ()
+{
+    Category::getInstance("TableDataManager")
+            .debug("Removing table definitions file ...");
+    string path(dataOutputConfig__.WorkingPath);
+    path += "/.working/tdf.dat";
+    unlink(path.c_str());
+    
+    path = dataOutputConfig__.WorkingPath;
+    path += "/.working/tdf.xml";
+    unlink(path.c_str());
+
+    path = dataOutputConfig__.WorkingPath;
+    path += "/.working/tdf.cache";
+    unlink(path.c_str());
+
+    path = dataOutputConfig__.WorkingPath;
+    path += "/.working/session";
+    unlink(path.c_str());
+
+    string tinfo_file;
+
+    Category::getInstance("TableDataManager")
+            .debug("Resetting data collection parameters");
+
+    for (int count = 0; count < (int)tableList__.size(); count++) {
+        tinfo_file = dataOutputConfig__.WorkingPath + "/.working/info." 
+                + tableList__[count].TblName;
+        // unlink (tinfo_file.c_str());
+        tinfo_file = dataOutputConfig__.WorkingPath + "/.working/" 
+                + tableList__[count].TblName + ".tmp";
+        unlink (tinfo_file.c_str());
+        tinfo_file = dataOutputConfig__.WorkingPath + "/.working/" 
+                + tableList__[count].TblName + BACKFILL_FILE_TAG + ".tmp";
+        unlink (tinfo_file.c_str());
+        tinfo_file = dataOutputConfig__.WorkingPath + "/.working/" 
+                + tableList__[count].TblName + GAPFILL_FILE_TAG + ".tmp";
+        unlink (tinfo_file.c_str());
+        tinfo_file = dataOutputConfig__.WorkingPath + "/.working/gaps." 
+                + tableList__[count].TblName;
+        unlink (tinfo_file.c_str());
+        tableList__[count].Gaps.clear();
+        tableList__[count].NextRecord = 0;
+        tableList__[count].NewFileTime = 0;
+        tableList__[count].FirstSampleInFile = 0; 
+        tableList__[count].LastRecordTime.sec = 0; 
+        tableList__[count].LastRecordTime.nsec = 0; 
+        tableList__[count].BackfillNext = 0;
+        tableList__[count].BackfillEnd = 0;
+    }
+    tableList__.clear();
+    return;
+}
+
+/** 
+ * Read the structure of a table. A successful call returns the 
+ * length of the segment for this table in the table definition file.
+ *
+ * @param table_num: Index for table number, beginning from 1. 
+ * @param byte_ptr:  Pointer to the memory location to start reading next
+ *                   table structure information.
+ * @param endptr:    Pointer to the end of the buffer containing the 
+ *                   table definition information. A read shouldn't be
+ *                   performed beyond this limit.
+ * @return Returns size of the table structure read in bytes. If the 
+ * end of the byte stream was reached before completing the parsing,
+ * -1 is returned.
+ */
+int TableDataManager :: readTableDefinition (int table_num, byte *byte_ptr, byte *endptr)
+{
+    Table tbl;
+    byte *ptr = byte_ptr;
+
+    if (ptr > endptr) return (-1);
+    tbl.TblName = GetVarLenString (ptr);
+    ptr += tbl.TblName.size ()+1;
+
+    if (ptr > endptr) return -1;
     tbl.TblSize = PBDeserialize (ptr, 4);
     ptr += 4;
 
@@ -573,6 +1433,7 @@ int TableDataManager :: readFieldList (byte *byte_ptr, byte *endptr, Table& Tbl)
         if (ptr > endptr) return -1;
         var.Dimension = PBDeserialize (ptr, 4);
         ptr += 4;
+        var.SubDim.clear();
 
         // Commenting out the if statement based on Dennis Oracheski's suggestion
         // if (var.Dimension > 1) {
@@ -744,7 +1605,9 @@ void TableDataManager :: writeFieldToXml (xmlNodePtr table_node, Field& var)
 }
 
 /** 
- * Function to get record size for a particular table structure.
+ * Function to get record size for a particular table structure. The size
+ * of a record with all the fields is computed once, when the table 
+ * definitions are built.
  * 
  * @param tbl: Reference to table structure whose size is being queried.
  * @return Record size for that input table, -1 if the table contains a
@@ -756,7 +1619,13 @@ int TableDataManager :: getRecordSize (const Table& tbl)
     int RecSize = 0;
     vector<Field>::const_iterator field_itr;
 
-    for (field_itr = tbl.field_list.begin(); field_itr != tbl.field_list.end();
+    if (tbl.FieldNumbers.empty() && (tbl.RecordSize != 0)) {
+        return tbl.RecordSize;
+    }
+
+    const vector<Field>& field_list = tbl.getCollectedFields();
+
+    for (field_itr = field_list.begin(); field_itr != field_list.end();
             field_itr++) {
         field_size = getFieldSize (*field_itr);
         if (field_size > 0) {
@@ -786,6 +1655,37 @@ int TableDataManager :: getMaxRecordSize()
     return maxTableSize;        
 }
 
+/**
+ * Function to get the largest size a record of a table can take. Variable 
+ * length strings are counted at their declared length and terminator.
+ *
+ * @param tbl: Reference to the Table structure.
+ * @return Upper bound of the record size in bytes.
+ */
+int TableDataManager :: getRecordSizeLimit (const Table& tbl) 
+{
+    int field_size;
+    int RecSize = 0;
+    vector<Field>::const_iterator field_itr;
+
+    const vector<Field>& field_list = tbl.getCollectedFields();
+
+    for (field_itr = field_list.begin(); field_itr != field_list.end();
+            field_itr++) {
+        if (field_itr->FieldType == 16) {
+            field_size = field_itr->Dimension + 1;
+        }
+        else {
+            field_size = getFieldSize (*field_itr);
+        }
+        if (field_size > 0) {
+            RecSize += field_size;
+        }
+    }
+
+    return RecSize;
+}
+
 /**
  * Function to obtain number of bytes allocated for a particular field in 
  * the record for a table.
@@ -875,6 +1775,9 @@ int TableDataManager :: getFieldSize (const Field& field)
         case 25 :
             field_size = 8;
             break;
+        case 26 :
+            field_size = 4;
+            break;
         case 27 :
             field_size = 2;
             break;
@@ -919,13 +1822,13 @@ const char* TableDataManager :: getDataType (const Field& var)
         case 7 : 
             return "2-byte final storage floating point";
         case 15 : 
-            return "3-byte final storage floating point - NOT IMPLEMENTED";
+            return "3-byte final storage floating point";
         case 8 : 
-            return "4-byte final storage floating point (CSI format) - NOT IMPLEMENTED";
+            return "4-byte final storage floating point (CSI format)";
         case 9 : 
             return "4-byte floating point (IEEE standard, MSB first)";
         case 18 : 
-            return "8-byte floating point (IEEE standard, MSB first) - NOT IMPLEMENTED";
+            return "8-byte floating point (IEEE standard, MSB first)";
         case 17 : 
             return "Byte of flags";
         case 10 : 
@@ -937,27 +1840,27 @@ const char* TableDataManager :: getDataType (const Field& var)
         case 12 : 
             return "4-byte integer used for 1-sec resolution time";
         case 13 : 
-            return "6-byte unsigned integer, 10's of ms resolution - NOT IMPLEMENTED";
+            return "6-byte unsigned integer, 10's of microseconds resolution";
         case 14 : 
-            return "2 4-byte integers, nanosecond time resolution (unused by CR23xx) - NOT IMPLEMENTED";
+            return "2 4-byte integers, nanosecond time resolution (unused by CR23xx)";
         case 11 : 
             return "fixed length string of lengh n, unused portion filled";
         case 16 : 
             return "variable length null-terminated string of length n+1";
         case 19 : 
-            return "2-byte integer (LSB first) (unused by CR23xx) - NOT IMPLEMENTED";
+            return "2-byte signed integer (LSB first) (unused by CR23xx)";
         case 20 : 
-            return "4-byte integer (LSB first) (unused by CR23xx) - NOT IMPLEMENTED";
+            return "4-byte signed integer (LSB first) (unused by CR23xx)";
         case 21 : 
-            return "4-byte integer (LSB first) (unused by CR23xx) - NOT IMPLEMENTED";
+            return "2-byte unsigned integer (LSB first) (unused by CR23xx)";
         case 22 : 
-            return "4-byte unsigned integer (LSB first) (unused by CR23xx) - NOT IMPLEMENTED";
+            return "4-byte unsigned integer (LSB first) (unused by CR23xx)";
         case 23 : 
-            return "2 longs (LSB first), seconds then nanoseconds (unused by CR23xx) - NOT IMPLEMENTED";
+            return "2 longs (LSB first), seconds then nanoseconds (unused by CR23xx)";
         case 24 : 
-            return "4-byte floating point (IEEE format, LSB first) (unused by CR23xx) - NOT IMPLEMENTED";
+            return "4-byte floating point (IEEE format, LSB first) (unused by CR23xx)";
         case 25 : 
-            return "8-byte floating point (IEEE format, LSB first) (unused by CR23xx) - NOT IMPLEMENTED";
+            return "8-byte floating point (IEEE format, LSB first) (unused by CR23xx)";
         case 26 : 
             return "4-byte floating point value";
         default : 
@@ -1015,44 +1918,94 @@ NSec parseRecordTime(const byte* data)
 int TableDataManager :: storeRecord (Table& tbl_ref, byte **data, 
         uint4 rec_num, int file_span, bool parseTimestamp) throw (StorageException)
 {
-    vector<Field>           field_list = tbl_ref.field_list;
-    vector<Field>::const_iterator start, end, itr;
-    NSec recordTime;
+    return storeRecords (tbl_ref, data, rec_num, 1, parseTimestamp);
+}
 
-    start = field_list.begin();
-    end   = field_list.end();
+/**
+ * This function extracts consecutive records from a byte stream for a Table
+ * structure into a batch of columns, and hands the batch to the data writer.
+ * Only the first record carries a timestamp if parseTimestamp is set, the 
+ * time of the others follows from the table interval.
+ *
+ * @param tbl_ref: Reference to corresponding Table strucrure.
+ * @param data: Address of the pointer to the beginning of the byte sequence.
+ * @param rec_num: Number of the first record to store.
+ * @param nrecs: Number of records to store.
+ * @param parseTimestamp: Set if the first record begins with its timestamp.
+ * @return SUCCESS
+ */ 
+int TableDataManager :: storeRecords (Table& tbl_ref, byte **data, 
+        uint4 rec_num, int nrecs, bool parseTimestamp) throw (StorageException)
+{
+    NSec recordTime = tbl_ref.LastRecordTime;
+    byte *first = NULL;
+
+    if (tbl_ref.DecodePlan.empty()) {
+        compileDecodePlan(tbl_ref);
+    }
+
+    // Records of a fixed size are decoded a run at a time for the whole
+    // batch, the others one record at a time
+    int stride = tbl_ref.View.getRecordSize();
 
     try {
-        if (parseTimestamp) {
-            // tbl_ref.LastRecordTime = parseRecordTime(*data);
-            recordTime = parseRecordTime(*data);
-            *data += 8;
-        } 
-        else {
-            // tbl_ref.LastRecordTime += tbl_ref.TblTimeInterval;
-            recordTime = tbl_ref.LastRecordTime;
-            recordTime += tbl_ref.TblTimeInterval;
-        }
-    
-        tblDataWriter__->processRecordBegin(tbl_ref, rec_num, 
-                recordTime);
-        
-        for (itr = start; itr < end; itr++) {
-            if ((itr->FieldType == 11) || (itr->FieldType == 16)) {
-                storeDataSample(*itr, data);
+        initBatch(tbl_ref, nrecs);
+
+        for (int count = 0; count < nrecs; count++) {
+            if (parseTimestamp && (count == 0)) {
+                recordTime = parseRecordTime(*data);
+                *data += 8;
+            } 
+            else {
+                recordTime += tbl_ref.TblTimeInterval;
+            }
+            batch__.Times.push_back(recordTime);
+            batch__.RecordNumbers.push_back(rec_num + count);
+
+            if (!inspectors__.empty()) {
+                RecordView record(tbl_ref.View, *data, rec_num + count, 
+                        recordTime);
+                vector<RecordInspector*>::iterator itr;
+                for (itr = inspectors__.begin(); itr != inspectors__.end(); 
+                        itr++) {
+                    (*itr)->inspectRecord(tbl_ref, record);
+                }
+            }
+            if (count == 0) {
+                first = *data;
+            }
+            if (stride < 0) {
+                decodeRecord(tbl_ref, data);
             }
             else {
-                for (int dim = 0; dim < (int)itr->Dimension; dim++) {
-                    storeDataSample(*itr, data);
-                } 
+                *data += stride;
             }
+            batch__.NumRecords++;
         }
 
-        tblDataWriter__->processRecordEnd(tbl_ref);
-       
-        // Update state variables
-        tbl_ref.LastRecordTime = recordTime;
-        tbl_ref.NextRecord += 1;
+        if ((stride >= 0) && (nrecs > 0)) {
+            decodeRecords(tbl_ref, first, stride, nrecs);
+        }
+
+        if (!tbl_ref.QcPlan.empty()) {
+            checkBatch(tbl_ref);
+        }
+
+        // The writer advances the state of the table past each record
+        // stored, so it stays right if a record fails to be stored
+        tblDataWriter__->writeBatch(tbl_ref, batch__);
+
+        // Records backfilled or recovered from gaps are older than the
+        // windows in progress, only the latest records are aggregated
+        if (tbl_ref.FileTag.empty()) {
+            vector<TableAggregator*>::iterator itr;
+            for (itr = aggregators__.begin(); itr != aggregators__.end(); 
+                    itr++) {
+                if ((*itr)->getSourceName() == tbl_ref.TblName) {
+                    (*itr)->addBatch(batch__);
+                }
+            }
+        }
     }
     catch (...) {
         stringstream errormsg;
@@ -1067,206 +2020,638 @@ int TableDataManager :: storeRecord (Table& tbl_ref, byte **data,
 }
 
 /**
- * Function to extract a sample for a particular field from a data record
- * and write it to an output file stream.
+ * Function to prepare the batch of records for decoding records of a table,
+ * with a column for each collected field. The buffers of the columns are
+ * reused between batches.
  *
- * @param fs:   Reference to the output file stream.
- * @param var:  Reference to the Field structure being extracted from data.
- * @param data: Address of the pointer to the memory where the data sample
- *              is stored.
+ * @param tbl: Reference to the table the records belong to.
+ * @param nrecs: Number of records expected in the batch.
  */
-void TableDataManager :: storeDataSample (const Field& var, byte **data)
+void TableDataManager :: initBatch(const Table& tbl, int nrecs)
 {
-     uint4   unum = 0;
-     uint2   unum2 = 0;
-     int     num  = 0;
-     string  str;
-    
-     switch (var.FieldType) 
-     {
-         case 7 : 
-             // 2-byte final storage floating point - Tested with CR1000 data
-             unum2 = (uint2) PBDeserialize (*data, 2);
-             tblDataWriter__->storeFloat(var, GetFinalStorageFloat(unum2));
-             *data += 2;
-             break;
-
-         case 6 : 
-             // 4-byte signed integer (MSB first) - Tested with CR1000 data
-             num   = (int)PBDeserialize (*data, 4);
-             tblDataWriter__->storeInt(var, num);
-             *data += 4;
-             break;
-
-         case 9 : 
-             // 4-byte floating point (IEEE standard, MSB first) - Tested with 
-             // CR1000 data
-             num = PBDeserialize (*data, 4);
-             tblDataWriter__->storeFloat(var, intBitsToFloat(num));
-             *data += 4;
-             break;
-
-         case 10 : 
-             // Boolean value - Tested with CR1000 data
-             unum = PBDeserialize (*data, 1);
-             tblDataWriter__->storeBool(var, unum & 0x80);
-             *data += 1;
-             break;
-
-         case 16 : 
-             // variable length null-terminated string of length n+1 - Tested 
-             // with CR1000 data
-             str = GetVarLenString (*data);
-             tblDataWriter__->storeString(var, str);
-             *data += str.size() + 1;
-             break;
-
-         case 11 : 
-             // fixed length string of lengh n, unused portion filled 
-             // with spaces/null - Tested with CR1000 data
-             str = GetFixedLenString (*data, var);
-             tblDataWriter__->storeString(var, str);
-             *data += var.Dimension;
-             break;
-
-         case 1 : 
-             // 1-byte uint
-             unum = PBDeserialize (*data, 1);
-             tblDataWriter__->storeUint4(var, unum);
-             *data += 1;
-             break;
-         case 2 : 
-             // 2-byte unsigned integer (MSB first)
-             unum = PBDeserialize (*data, 2);
-             tblDataWriter__->storeUint4(var, unum);
-             *data += 2;
-             break;
-         case 3 : 
-             // 4-byte unsigned integer (MSB first)
-             unum = PBDeserialize (*data, 4);
-             tblDataWriter__->storeUint4(var, unum);
-             *data += 4;
-             break;
-         case 4 : 
-             // 1-byte signed integer
-             num  = (int)PBDeserialize (*data, 1);
-             tblDataWriter__->storeInt(var, num);
-             *data += 1;
-             break;
-         case 5 : 
-             // 2-byte signed integer (MSB first)
-             num = (int)PBDeserialize (*data, 2);
-             tblDataWriter__->storeInt(var, num);
-             *data += 2;
-             break;
-         case 18 : 
-             // 8-byte floating point (IEEE standard, MSB first)
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 8;
-             break;
-         case 15 : 
-             // 3-byte final storage floating point
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 3;
-             break;
-         case 8 : 
-             // 4-byte final storage floating point (CSI format)
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 4;
-             break;
-         case 17 : 
-             // Byte of flags
-             unum = PBDeserialize (*data, 1);
-             tblDataWriter__->storeUint4(var, unum);
-             *data += 1;
-             break;
-         case 27 : 
-             // Boolean value
-             unum = PBDeserialize (*data, 1);
-             tblDataWriter__->storeBool(var, unum & 0x80);
-             *data += 1;
-             break;
-         case 28 : 
-             // Boolean value
-             unum = PBDeserialize (*data, 1);
-             tblDataWriter__->storeBool(var, unum & 0x80);
-             *data += 1;
-             break;
-         case 12 : 
-             // 4-byte integer used for 1-sec resolution time
-             unum = PBDeserialize (*data, 4);
-             tblDataWriter__->storeUint4(var, unum);
-             *data += 4;
-             break;
-         case 13 : 
-             // 6-byte unsigned integer, 10's of ms resolution
-             // Read a ulong, then mask out last 2 bytes
-             unum = PBDeserialize (*data, 4);
-             tblDataWriter__->storeUint4(var, unum);
-             *data += 6;
-             break;
-         case 14 : 
-             // 2 4-byte integers, nanosecond time resolution
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 8;
-             break;
-         case 19 : 
-             // 2-byte integer (LSB first)
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 2;
-             break;
-         case 20 : 
-             // 4-byte integer (LSB first)
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 4;
-             break;
-         case 21 : 
-             // 2-byte unsigned integer (LSB first)
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 2;
-             break;
-         case 22 : 
-             // 4-byte unsigned integer (LSB first)
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 4;
-             break;
-         case 24 : 
-             // 4-byte floating point (IEEE format, LSB first)
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 4;
-             break;
-         case 25 : 
-             // 8-byte floating point (IEEE format, LSB first)
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 8;
-             break;
-         case 23 : 
-             // 2 longs (LSB first), seconds then nanoseconds
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 8;
-             break;
-         case 26 : 
-             // 4-byte floating point value
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
-             *data += 4;
-             break;
-         default : 
-             tblDataWriter__->processUnimplemented(var);
-             logUnimplementedDataError(var);
+    const vector<Field>& field_list = tbl.getCollectedFields();
+
+    batch__.NumRecords = 0;
+    batch__.Times.clear();
+    batch__.RecordNumbers.clear();
+    batch__.QcResults.clear();
+    batch__.Columns.resize(field_list.size());
+
+    for (int idx = 0; idx < (int)field_list.size(); idx++) {
+        RecordColumn& column = batch__.Columns[idx];
+        column.FieldPtr = &field_list[idx];
+        column.Kind = SAMPLE_NONE;
+        column.Samples = 0;
+        column.Uints.clear();
+        column.Ints.clear();
+        column.Floats.clear();
+        column.Doubles.clear();
+        column.Bools.clear();
+        column.Times.clear();
+        column.Strings.clear();
+    }
+
+    vector<DecodeOp>::const_iterator op;
+    for (op = tbl.DecodePlan.begin(); op != tbl.DecodePlan.end(); op++) {
+        for (int idx = op->FirstField; idx < op->FirstField + op->NumFields; 
+                idx++) {
+            RecordColumn& column = batch__.Columns[idx];
+            column.Kind = op->Kind;
+            column.Samples = (op->Kind == SAMPLE_STRING) ? 1 : 
+                    field_list[idx].Dimension;
+        }
     }
-    return;
+}
+
+/**
+ * Decoders of the data types, indexed by the type code of the fields.
+ */
+static const SampleDecoder sampleDecoders[] = {
+    NO_DECODER,
+    SAMPLE_DECODER(ByteSample),        // 1  : 1-byte uint
+    SAMPLE_DECODER(UInt2Sample),       // 2  : 2-byte unsigned integer
+    SAMPLE_DECODER(UInt4Sample),       // 3  : 4-byte unsigned integer
+    SAMPLE_DECODER(Int1Sample),        // 4  : 1-byte signed integer
+    SAMPLE_DECODER(Int2Sample),        // 5  : 2-byte signed integer
+    SAMPLE_DECODER(Int4Sample),        // 6  : 4-byte signed integer
+    SAMPLE_DECODER(Fp2Sample),         // 7  : 2-byte final storage float
+    SAMPLE_DECODER(Fp4Sample),         // 8  : 4-byte CSI float
+    SAMPLE_DECODER(IeeeSample),        // 9  : 4-byte IEEE float
+    SAMPLE_DECODER(Bool1Sample),       // 10 : Boolean value
+    { 0, SAMPLE_STRING, decodeFixedString, decodeFixedStringBatch, NULL },
+                                       // 11 : Fixed length string
+    SAMPLE_DECODER(UInt4Sample),       // 12 : 1-sec resolution time
+    SAMPLE_DECODER(USecSample),        // 13 : 10's of us resolution time
+    SAMPLE_DECODER(NSecMsfSample),     // 14 : Nanosecond resolution time
+    SAMPLE_DECODER(Fp3Sample),         // 15 : 3-byte final storage float
+    { 0, SAMPLE_STRING, decodeVarString, NULL, NULL },
+                                       // 16 : Null-terminated string
+    SAMPLE_DECODER(ByteSample),        // 17 : Byte of flags
+    SAMPLE_DECODER(Ieee8MsfSample),    // 18 : 8-byte IEEE float
+    SAMPLE_DECODER(Int2LsfSample),     // 19 : 2-byte signed integer (LSB)
+    SAMPLE_DECODER(Int4LsfSample),     // 20 : 4-byte signed integer (LSB)
+    SAMPLE_DECODER(UInt2LsfSample),    // 21 : 2-byte unsigned integer (LSB)
+    SAMPLE_DECODER(UInt4LsfSample),    // 22 : 4-byte unsigned integer (LSB)
+    SAMPLE_DECODER(NSecLsfSample),     // 23 : Nanosecond time (LSB)
+    SAMPLE_DECODER(IeeeLsfSample),     // 24 : 4-byte IEEE float (LSB)
+    SAMPLE_DECODER(Ieee8LsfSample),    // 25 : 8-byte IEEE float (LSB)
+    SAMPLE_DECODER(IeeeSample),        // 26 : 4-byte float
+    SAMPLE_DECODER(Bool2Sample),       // 27 : 2-byte boolean value
+    SAMPLE_DECODER(Bool4Sample)        // 28 : 4-byte boolean value
+};
+
+#define NUM_SAMPLE_DECODERS \
+    (int)(sizeof(sampleDecoders)/sizeof(sampleDecoders[0]))
+
+/**
+ * Function to compile the decode plan for the fields collected from a table.
+ * Each field is mapped to the decoder of its data type, and consecutive 
+ * fields sharing the decoder are merged into a single operation. Strings 
+ * are not merged, a field of type 11 or 16 holds a single string. The plan
+ * is used by decodeRecord() to decode the records without inspecting field
+ * types. Fields of unsupported types are reported here, once per plan.
+ *
+ * @param tbl: Reference to the table to compile the plan for.
+ */
+void TableDataManager :: compileDecodePlan(Table& tbl)
+{
+    const vector<Field>& field_list = tbl.getCollectedFields();
+    uint4 offset = 0;
+
+    tbl.DecodePlan.clear();
+
+    for (int idx = 0; idx < (int)field_list.size(); idx++) {
+        const Field& var = field_list[idx];
+        DecodeOp op;
+        uint4    samples = var.Dimension;
+
+        if (var.FieldType < NUM_SAMPLE_DECODERS) {
+            const SampleDecoder& decoder = sampleDecoders[var.FieldType];
+            op.Width = decoder.Width;
+            op.Kind = decoder.Kind;
+            op.Decode = decoder.Decode;
+            op.DecodeBatch = decoder.DecodeBatch;
+        }
+
+        if (op.Kind == SAMPLE_STRING) {
+            // Type 11 is as wide as its dimension, type 16 is variable
+            op.Width = (var.FieldType == 11) ? var.Dimension : 0;
+            samples = 1;
+        }
+
+        if (samples == 0) {
+            continue;
+        }
+
+        if (op.Decode == NULL) {
+            logUnimplementedDataError(var);
+        }
+
+        DecodeOp* last = tbl.DecodePlan.empty() ? NULL : &tbl.DecodePlan.back();
+
+        if (last && (last->Decode == op.Decode) && (last->Width == op.Width) &&
+                (op.Kind != SAMPLE_STRING) && 
+                (last->FirstField + last->NumFields == idx)) {
+            last->NumFields++;
+            last->Count += samples;
+        }
+        else {
+            op.Offset = offset;
+            op.FirstField = idx;
+            op.NumFields = 1;
+            op.Count = samples;
+            tbl.DecodePlan.push_back(op);
+        }
+
+        if ((var.FieldType == 16) || (offset == VARIABLE_OFFSET)) {
+            offset = VARIABLE_OFFSET;
+        }
+        else {
+            offset += op.Width * samples;
+        }
+    }
+    tbl.View = TableView(tbl);
+    compileQcPlan(tbl);
+
+    if (tbl.FileTag.empty()) {
+        vector<TableAggregator*>::iterator itr;
+        for (itr = aggregators__.begin(); itr != aggregators__.end(); itr++) {
+            if ((*itr)->getSourceName() == tbl.TblName) {
+                (*itr)->compile(tbl);
+            }
+        }
+    }
+}
+
+/**
+ * Function to compile the QC checks for the fields collected from a table,
+ * from the QC rules configured for the table. Rules for fields that are not
+ * collected, or that do not hold numbers, are reported and left out. The 
+ * state of the step and stuck checks starts over with a new plan.
+ *
+ * @param tbl: Reference to the table to compile the checks for.
+ */
+void TableDataManager :: compileQcPlan(Table& tbl)
+{
+    const vector<Field>& field_list = tbl.getCollectedFields();
+    vector<QcRule>::const_iterator rule;
+    stringstream msgstrm;
+
+    tbl.QcPlan.clear();
+
+    for (rule = dataOutputConfig__.QcRules.begin(); 
+            rule != dataOutputConfig__.QcRules.end(); rule++) {
+        if (rule->TableName != tbl.TblName) {
+            continue;
+        }
+
+        int idx = tbl.View.getFieldIndex(rule->FieldName);
+        if (idx < 0) {
+            msgstrm << "Ignoring QC rule for " << rule->FieldName 
+                    << ", the field is not collected from " << tbl.TblName;
+            Category::getInstance("TableDataManager").warn(msgstrm.str());
+            msgstrm.str("");
+            continue;
+        }
+
+        byte kind = SAMPLE_NONE;
+        vector<DecodeOp>::const_iterator op;
+        for (op = tbl.DecodePlan.begin(); op != tbl.DecodePlan.end(); op++) {
+            if ((idx >= op->FirstField) && 
+                    (idx < op->FirstField + op->NumFields)) {
+                kind = op->Kind;
+                break;
+            }
+        }
+
+        if ((kind != SAMPLE_UINT) && (kind != SAMPLE_INT) && 
+                (kind != SAMPLE_FLOAT) && (kind != SAMPLE_DOUBLE)) {
+            msgstrm << "Ignoring QC rule for " << rule->FieldName << " of " 
+                    << tbl.TblName << ", the field does not hold numbers";
+            Category::getInstance("TableDataManager").warn(msgstrm.str());
+            msgstrm.str("");
+            continue;
+        }
+
+        QcCheck check;
+        check.Column = idx;
+        check.Rule = *rule;
+        check.Last.resize(field_list[idx].Dimension);
+        check.Repeats.resize(field_list[idx].Dimension);
+        tbl.QcPlan.push_back(check);
+    }
+    resetQcState(tbl);
+}
+
+/**
+ * Function to clear the state of the step and stuck checks of a table, so
+ * that the next record checked starts over. Used for the records that do
+ * not follow the ones checked last, like backfilled records.
+ *
+ * @param tbl_ref: Reference to the table to clear the state of.
+ */
+void TableDataManager :: resetQcState(Table& tbl_ref)
+{
+    vector<QcCheck>::iterator check;
+
+    for (check = tbl_ref.QcPlan.begin(); check != tbl_ref.QcPlan.end(); 
+            check++) {
+        check->Last.assign(check->Last.size(), 
+                numeric_limits<double>::quiet_NaN());
+        check->Repeats.assign(check->Repeats.size(), 0);
+        check->NextRecord = 0;
+    }
+}
+
+/**
+ * Function to apply the checks of a QC rule to the samples of a column for
+ * a batch of records, appending the flagged samples to the results. The 
+ * range checks are evaluated over all the samples at once, the step and 
+ * stuck checks then follow each sample from one record to the next. Their
+ * state starts over at a record that does not follow the previous one.
+ * Infinite samples are missing as well, as NaN is decoded to infinity for
+ * IEEE4 fields, see intBitsToFloat().
+ *
+ * @param check: QC check of the column, holding the state of the samples.
+ * @param values: Samples of the column, for one record after another.
+ * @param records: Record numbers of the records in the batch.
+ * @param nrecs: Number of records in the batch.
+ * @param samples: Number of samples of the field in a record.
+ * @param flags: Buffer for the flags of the samples, reused.
+ * @param results: List of flagged samples to append to.
+ */
+template <class Value>
+static void checkSamples (QcCheck& check, int column, 
+        const vector<Value>& values, const uint4* records, int nrecs, 
+        uint4 samples, vector<byte>& flags, vector<QcResult>& results)
+{
+    const QcRule& rule = check.Rule;
+    uint4  count = nrecs * samples;
+    double missing = rule.Missing;
+    double min = (rule.Checks & QC_BELOW_MIN) ? rule.Min : -HUGE_VAL;
+    double max = (rule.Checks & QC_ABOVE_MAX) ? rule.Max : HUGE_VAL;
+
+    if ((count == 0) || (values.size() < count)) {
+        return;
+    }
+    flags.resize(count);
+
+    const Value* ptr = &values[0];
+    byte* flag = &flags[0];
+
+    for (uint4 idx = 0; idx < count; idx++) {
+        double value = ptr[idx];
+        byte   range = ((value < min) ? QC_BELOW_MIN : 0) | 
+                       ((value > max) ? QC_ABOVE_MAX : 0);
+        flag[idx] = (!(fabs(value) < HUGE_VAL) || (value == missing)) ? 
+                QC_MISSING : range;
+    }
+
+    if (rule.Checks & (QC_STEP | QC_STUCK)) {
+        for (uint4 sample = 0; sample < samples; sample++) {
+            double last = check.Last[sample];
+            uint4  repeats = check.Repeats[sample];
+            uint4  next = check.NextRecord;
+
+            for (uint4 idx = sample, rec = 0; idx < count; 
+                    idx += samples, rec++) {
+                if (records[rec] != next) {
+                    last = numeric_limits<double>::quiet_NaN();
+                    repeats = 0;
+                }
+                next = records[rec] + 1;
+
+                if (flag[idx] & QC_MISSING) {
+                    continue;
+                }
+                double value = ptr[idx];
+
+                if (last == last) {
+                    if ((rule.Checks & QC_STEP) && 
+                            (fabs(value - last) > rule.MaxStep)) {
+                        flag[idx] |= QC_STEP;
+                    }
+                    repeats = (value == last) ? repeats + 1 : 0;
+                    if ((rule.Checks & QC_STUCK) && repeats && 
+                            (repeats + 1 >= rule.StuckRecords)) {
+                        flag[idx] |= QC_STUCK;
+                    }
+                }
+                last = value;
+            }
+            check.Last[sample] = last;
+            check.Repeats[sample] = repeats;
+        }
+        check.NextRecord = records[nrecs - 1] + 1;
+    }
+
+    QcResult result;
+    result.Column = column;
+    for (uint4 idx = 0; idx < count; idx++) {
+        if (flag[idx]) {
+            result.Record = idx / samples;
+            result.Sample = idx % samples;
+            result.Flags = flag[idx];
+            result.Value = ptr[idx];
+            results.push_back(result);
+        }
+    }
+}
+
+/** Ordering of the QC results by record, column and sample */
+static bool qcResultBefore (const QcResult& a, const QcResult& b)
+{
+    if (a.Record != b.Record) {
+        return a.Record < b.Record;
+    }
+    if (a.Column != b.Column) {
+        return a.Column < b.Column;
+    }
+    return a.Sample < b.Sample;
+}
+
+/**
+ * Function to apply the QC checks of a table to the current batch of
+ * decoded records, collecting the flagged samples in the batch.
+ *
+ * @param tbl: Reference to the table the records belong to.
+ */
+void TableDataManager :: checkBatch(Table& tbl)
+{
+    vector<QcCheck>::iterator check;
+
+    if (batch__.NumRecords == 0) {
+        return;
+    }
+    const uint4* records = &batch__.RecordNumbers[0];
+
+    for (check = tbl.QcPlan.begin(); check != tbl.QcPlan.end(); check++) {
+        const RecordColumn& column = batch__.Columns[check->Column];
+
+        switch (column.Kind) {
+            case SAMPLE_UINT : 
+                checkSamples (*check, check->Column, column.Uints, records, 
+                        batch__.NumRecords, column.Samples, qcFlags__, 
+                        batch__.QcResults);
+                break;
+            case SAMPLE_INT : 
+                checkSamples (*check, check->Column, column.Ints, records, 
+                        batch__.NumRecords, column.Samples, qcFlags__, 
+                        batch__.QcResults);
+                break;
+            case SAMPLE_FLOAT : 
+                checkSamples (*check, check->Column, column.Floats, records, 
+                        batch__.NumRecords, column.Samples, qcFlags__, 
+                        batch__.QcResults);
+                break;
+            case SAMPLE_DOUBLE : 
+                checkSamples (*check, check->Column, column.Doubles, records, 
+                        batch__.NumRecords, column.Samples, qcFlags__, 
+                        batch__.QcResults);
+                break;
+            default : 
+                break;
+        }
+    }
+
+    if (tbl.QcPlan.size() > 1) {
+        sort (batch__.QcResults.begin(), batch__.QcResults.end(), 
+                qcResultBefore);
+    }
+}
+
+/**
+ * Function to decode the samples in a data record following the decode
+ * plan of the table, appending them to the columns of the current batch.
+ * The samples of unsupported types are skipped, and stored with
+ * processUnimplemented() by the data writer.
+ *
+ * @param tbl:  Reference to the table the record belongs to.
+ * @param data: Address of the pointer to the first sample in the record,
+ *              advanced past the record.
+ */
+void TableDataManager :: decodeRecord(const Table& tbl, byte **data)
+{
+    vector<DecodeOp>::const_iterator op;
+    RecordColumn *column;
+    byte   *ptr = *data;
+
+    for (op = tbl.DecodePlan.begin(); op != tbl.DecodePlan.end(); op++) {
+        column = &batch__.Columns[op->FirstField];
+
+        if (op->Decode) {
+            ptr = op->Decode (ptr, column, column + op->NumFields, op->Count);
+        }
+        else {
+            ptr += op->Width * op->Count;
+        }
+    }
+    *data = ptr;
+}
+
+/**
+ * Function to decode a batch of records of a fixed size following the 
+ * decode plan of the table, appending the samples to the columns of the
+ * current batch. Each operation of the plan decodes its run from all the
+ * records in a single call.
+ *
+ * @param tbl:  Reference to the table the records belong to.
+ * @param data: Pointer to the first sample of the first record.
+ * @param stride: Size of a record.
+ * @param nrecs: Number of records.
+ */
+void TableDataManager :: decodeRecords(const Table& tbl, const byte *data, 
+        uint4 stride, int nrecs)
+{
+    vector<DecodeOp>::const_iterator op;
+    RecordColumn *column;
+
+    for (op = tbl.DecodePlan.begin(); op != tbl.DecodePlan.end(); op++) {
+        if (op->DecodeBatch) {
+            column = &batch__.Columns[op->FirstField];
+            op->DecodeBatch (data + op->Offset, stride, nrecs, column, 
+                    column + op->NumFields, op->Count);
+        }
+    }
+}
+
+/**
+ * Constructor of the layout of the records collected from a table. The 
+ * offsets follow the same rules as the decode plan of the table.
+ *
+ * @param tbl: Reference to the table.
+ */
+TableView :: TableView(const Table& tbl) : recordSize__(0)
+{
+    const vector<Field>& field_list = tbl.getCollectedFields();
+    uint4 offset = 0;
+
+    for (int idx = 0; idx < (int)field_list.size(); idx++) {
+        const Field& var = field_list[idx];
+        FieldView field;
+
+        field.FieldName = var.FieldName;
+        field.FieldType = var.FieldType;
+        field.Dimension = var.Dimension;
+        field.Offset = offset;
+
+        if (var.FieldType < NUM_SAMPLE_DECODERS) {
+            field.Width = sampleDecoders[var.FieldType].Width;
+            field.Number = sampleDecoders[var.FieldType].Number;
+        }
+        if (var.FieldType == 11) {
+            field.Width = var.Dimension;
+        }
+
+        fields__.push_back(field);
+        fieldIndex__[field.FieldName] = idx;
+
+        if ((var.FieldType == 16) || (offset == VARIABLE_OFFSET)) {
+            offset = VARIABLE_OFFSET;
+        }
+        else if (var.FieldType == 11) {
+            offset += field.Width;
+        }
+        else {
+            offset += field.Width * field.Dimension;
+        }
+    }
+    recordSize__ = (offset == VARIABLE_OFFSET) ? -1 : (int)offset;
+}
+
+/**
+ * Function to look up a collected field by name.
+ *
+ * @param name: Name of the field.
+ * @return Index of the field in the record, -1 if it is not collected.
+ */
+int TableView :: getFieldIndex(const string& name) const
+{
+    map<string, int>::const_iterator itr = fieldIndex__.find(name);
+    return (itr == fieldIndex__.end()) ? -1 : itr->second;
+}
+
+/**
+ * Function to locate a field in the record. Fields at a fixed offset are
+ * located directly, the ones following a variable length string by 
+ * walking over the fields from the last one at a fixed offset.
+ *
+ * @param field: Index of the field, or the number of fields to locate the
+ *               end of the record.
+ * @return Pointer to the first sample of the field.
+ */
+const byte* RecordView :: locateField(int field) const
+{
+    int nfields = view__->getNumFields();
+    int idx = field;
+
+    while ((idx > 0) && ((idx == nfields) || 
+            (view__->getField(idx).Offset == VARIABLE_OFFSET))) {
+        idx--;
+    }
+    if (idx == nfields) {
+        return data__;
+    }
+
+    const byte* ptr = data__ + view__->getField(idx).Offset;
+    for (; idx < field; idx++) {
+        const FieldView& var = view__->getField(idx);
+        if (var.FieldType == 16) {
+            ptr += strlen((const char *)ptr) + 1;
+        }
+        else if (var.FieldType == 11) {
+            ptr += var.Width;
+        }
+        else {
+            ptr += var.Width * var.Dimension;
+        }
+    }
+    return ptr;
+}
+
+/**
+ * Function to obtain a pointer to a sample of the record.
+ *
+ * @param field: Index of the field.
+ * @param dim: Index of the sample within the field.
+ * @return Pointer to the sample in the record.
+ */
+const byte* RecordView :: getSample(int field, uint4 dim) const
+{
+    return locateField(field) + dim * view__->getField(field).Width;
+}
+
+/**
+ * Function to decode a sample of a numeric field.
+ *
+ * @param field: Index of the field.
+ * @param dim: Index of the sample within the field.
+ * @return Value of the sample, -9999 if the field is not numeric or the 
+ *         sample doesn't exist.
+ */
+double RecordView :: getNumber(int field, uint4 dim) const
+{
+    const FieldView& var = view__->getField(field);
+
+    if ((var.Number == NULL) || (dim >= var.Dimension)) {
+        return -9999;
+    }
+    return var.Number(getSample(field, dim));
+}
+
+double RecordView :: getNumber(const string& name, uint4 dim) const
+        throw (invalid_argument)
+{
+    int field = view__->getFieldIndex(name);
+    if (field < 0) {
+        throw invalid_argument("Field " + name + " is not collected");
+    }
+    return getNumber(field, dim);
+}
+
+/**
+ * Function to decode a string field.
+ *
+ * @param field: Index of the field.
+ * @return The string, empty if the field is not a string.
+ */
+string RecordView :: getString(int field) const
+{
+    const FieldView& var = view__->getField(field);
+
+    if (var.FieldType == 16) {
+        return GetVarLenString(locateField(field));
+    }
+    else if (var.FieldType == 11) {
+        Field str_field;
+        str_field.Dimension = var.Dimension;
+        return GetFixedLenString(locateField(field), str_field);
+    }
+    return "";
+}
+
+string RecordView :: getString(const string& name) const
+        throw (invalid_argument)
+{
+    int field = view__->getFieldIndex(name);
+    if (field < 0) {
+        throw invalid_argument("Field " + name + " is not collected");
+    }
+    return getString(field);
+}
+
+/**
+ * Function to locate the end of the record, where the following record 
+ * begins in a collect response.
+ *
+ * @return Pointer to the byte following the record.
+ */
+const byte* RecordView :: getEnd() const
+{
+    if (view__->getRecordSize() >= 0) {
+        return data__ + view__->getRecordSize();
+    }
+    return locateField(view__->getNumFields());
 }
 
 /**
@@ -1304,6 +2689,80 @@ void TableDataManager :: logUnimplementedDataError (const Field& var)
     return;
 }
 
+/**
+ * Select the fields to collect from a table. The field names are resolved
+ * to their position in the table definition, and the records received
+ * from the logger will only contain these fields, in the order they are 
+ * defined in the table. If the subset differs from the one used for the 
+ * records collected earlier, the current data file is closed so that the
+ * records with a different layout go to a new file.
+ *
+ * @param tbl_ref: Reference to the table to collect data from.
+ * @param names: Names of the fields to collect, all fields if empty.
+ */
+void TableDataManager :: setFieldSubset(Table& tbl_ref, 
+        const vector<string>& names)
+{
+    vector<uint2> fieldNumbers;
+
+    for (int idx = 0; idx < (int)tbl_ref.field_list.size(); idx++) {
+        if (find(names.begin(), names.end(), tbl_ref.field_list[idx].FieldName)
+                != names.end()) {
+            fieldNumbers.push_back((uint2)(idx + 1));
+        }
+    }
+
+    if (fieldNumbers.size() < names.size()) {
+        Category::getInstance("TableDataManager")
+                 .warn("Ignoring unknown field names in the field list for " +
+                         tbl_ref.TblName);
+    }
+    if (fieldNumbers.size() == tbl_ref.field_list.size()) {
+        fieldNumbers.clear();
+    }
+
+    // Keep the plan compiled for the same subset, along with the state of
+    // its QC checks
+    if ((fieldNumbers == tbl_ref.FieldNumbers) && 
+            !tbl_ref.DecodePlan.empty() &&
+            (tbl_ref.collect_list.size() == fieldNumbers.size())) {
+        return;
+    }
+
+    if (fieldNumbers != tbl_ref.FieldNumbers) {
+        if (tbl_ref.FirstSampleInFile) {
+            Category::getInstance("TableDataManager")
+                     .info("Field list changed, starting a new data file for " 
+                             + tbl_ref.TblName);
+            flushTableDataCache(tbl_ref);
+        }
+        tbl_ref.FieldNumbers = fieldNumbers;
+    }
+
+    tbl_ref.collect_list.clear();
+    for (int idx = 0; idx < (int)fieldNumbers.size(); idx++) {
+        tbl_ref.collect_list.push_back(tbl_ref.field_list[fieldNumbers[idx]-1]);
+    }
+    compileDecodePlan(tbl_ref);
+}
+
+/**
+ * Function to get a stamp of the data files written for a table and the 
+ * tables aggregated from it, changing whenever one of them starts a new 
+ * data file.
+ */
+uint4 TableDataManager :: getFileStamp(const Table& tbl)
+{
+    uint4 stamp = tbl.NewFileTime;
+    vector<TableAggregator*>::const_iterator itr;
+    for (itr = aggregators__.begin(); itr != aggregators__.end(); itr++) {
+        if ((*itr)->getSourceName() == tbl.TblName) {
+            stamp += (*itr)->getFileStamp();
+        }
+    }
+    return stamp;
+}
+
 void TableDataManager :: flushTableDataCache(Table& tblRef)
 {
     tblDataWriter__->flush(tblRef);
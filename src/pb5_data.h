@@ -16,6 +16,7 @@
 #define PBDATA_H
 
 #include <vector>
+#include <map>
 #include <string>
 #include <stdexcept>
 #include <libxml2/libxml/parser.h>
@@ -46,6 +47,12 @@ int nseccmp(const NSec& nsec1, const NSec& nsec2);
 #define SECS_BEFORE_1990 631152000
 #define InvalidTableName      1
 
+/** Version of the layout of the compiled table definitions cache */
+#define TDF_CACHE_VERSION 1
+
+/** Age (seconds) after which the programming statistics are fetched again */
+#define SESSION_CACHE_MAX_AGE 86400
+
 /**
  * Structure containing various metadata information about the datalogger 
  * programming environment. The programming statistics transaction is used
@@ -61,17 +68,85 @@ struct DLProgStats {
     uint2  ProgSig;
 };
 
+/**
+ * Flags raised by the QC checks for a sample, see QcRule.
+ */
+enum QcFlag {
+    QC_MISSING   = 0x01,    // NaN, infinite or the missing value sentinel
+    QC_BELOW_MIN = 0x02,    // Less than the minimum
+    QC_ABOVE_MAX = 0x04,    // Greater than the maximum
+    QC_STEP      = 0x08,    // Changed more than allowed since the last record
+    QC_STUCK     = 0x10     // Repeated the same value for too many records
+};
+
+/**
+ * Range and consistency checks configured for a field of a table. Missing
+ * samples are always flagged, and are left out of the other checks, which
+ * are enabled by setting the corresponding QcFlag in Checks.
+ */
+struct QcRule {
+    QcRule() : Checks(0), Min(0), Max(0), Missing(-9999), MaxStep(0), 
+            StuckRecords((uint4)0) {}
+    string TableName;
+    string FieldName;
+    byte   Checks;          // QcFlag of the checks enabled
+    double Min;
+    double Max;
+    double Missing;         // Sentinel for a missing value
+    double MaxStep;         // Largest change between consecutive records
+    uint4  StuckRecords;    // Consecutive records with the same value that
+                            // are flagged as stuck
+};
+
 /**
  * Structure containing per table based output options for downloading and 
  * storing data. 
  */
 struct TableOpt {
-    TableOpt() : TableSpan(3600), SampleInt(0) {}
+    TableOpt() : TableSpan(3600), SampleInt(0), CatchUpRecords(0), 
+            Tail(false) {}
     string TableName;
     int    TableSpan;
     int    SampleInt;
+    vector<string> FieldNames;  // Fields to collect, all fields if empty
+    uint4  CatchUpRecords;      // Newest records to collect first after an
+                                // outage, 0 to always collect in order
+    bool   Tail;                // Poll for the latest record in tail mode
 } ;
 
+/**
+ * Statistics computed for a field aggregated into a derived table.
+ */
+enum AggregateStat {
+    AGG_MEAN = 0x01,
+    AGG_MIN  = 0x02,
+    AGG_MAX  = 0x04,
+    AGG_STD  = 0x08,
+    AGG_WIND = 0x10     // Wind vector, from a speed and a direction field
+};
+
+/**
+ * Field of a table aggregated into a derived table, see AggregateOpt.
+ */
+struct AggregateField {
+    AggregateField() : Stats(0) {}
+    string FieldName;       // Field to aggregate, wind speed for AGG_WIND
+    string DirectionField;  // Wind direction in degrees, for AGG_WIND
+    byte   Stats;           // AggregateStat to compute
+};
+
+/**
+ * Derived table holding statistics of the fields of a collected table over
+ * consecutive windows of a fixed length, see TableAggregator.
+ */
+struct AggregateOpt {
+    AggregateOpt() : Interval(0) {}
+    string TableName;       // Table the records are aggregated from
+    string Name;            // Name of the derived table
+    int    Interval;        // Length of a window in seconds
+    vector<AggregateField> Fields;
+};
+
 /**
  * A collection of all parameters that can be used to configure the data 
  * download and persistence process.
@@ -81,6 +156,8 @@ typedef struct {
     string StationName;
     string LoggerType;
     vector<TableOpt> Tables;
+    vector<QcRule>   QcRules;
+    vector<AggregateOpt> Aggregates;
 } DataOutputConfig;
 
 /**
@@ -104,6 +181,158 @@ struct Field {
     string getProperty(int infoType, int dim) const;
 } ;
 
+/**
+ * Range of records that could not be collected, kept to retry them later.
+ */
+struct RecordGap {
+    RecordGap() : LastRecord((uint4)0), Attempts(0) {}
+    uint4  LastRecord;   // The range begins with the record it is keyed by
+    int    Attempts;     // Sessions that failed to recover the records
+};
+
+/**
+ * Kinds of the samples decoded from a record. The samples of each kind are
+ * stored with one of the TableDataWriter store functions.
+ */
+enum SampleKind {
+    SAMPLE_UINT,        // Unsigned integer, storeUint4
+    SAMPLE_INT,         // Signed integer, storeInt
+    SAMPLE_FLOAT,       // Floating point number, storeFloat
+    SAMPLE_DOUBLE,      // Double precision floating point number, storeDouble
+    SAMPLE_BOOL,        // Boolean value, storeBool
+    SAMPLE_TIME,        // Time since 1990, storeTime
+    SAMPLE_STRING,      // String, storeString
+    SAMPLE_NONE         // Unsupported type, processUnimplemented
+};
+
+struct RecordColumn;
+
+/**
+ * Function decoding a run of samples into the columns [column, end), see
+ * decodeRun() in pb5_decode.h.
+ * @return Pointer to the byte following the run.
+ */
+typedef byte* (*DecodeFunc)(byte* ptr, RecordColumn* column, 
+        RecordColumn* end, uint4 count);
+
+/**
+ * Function decoding a run of samples from a batch of records of the same
+ * size into the columns [column, end), see decodeRunBatch() in 
+ * pb5_decode.h.
+ */
+typedef void (*DecodeBatchFunc)(const byte* ptr, uint4 stride, int nrecs, 
+        RecordColumn* column, RecordColumn* end, uint4 count);
+
+/**
+ * Operation of a record decode plan, decoding a run of samples of the same
+ * type spread over one or more consecutive fields.
+ */
+struct DecodeOp {
+    DecodeOp() : Offset((uint4)0), Width((uint2)0), Kind(SAMPLE_NONE), 
+            Decode(NULL), DecodeBatch(NULL), FirstField(0), NumFields(0), 
+            Count((uint4)0) {}
+    uint4  Offset;       // Byte offset in the record, VARIABLE_OFFSET if it
+                         // follows a variable length string
+    uint2  Width;        // Bytes per sample, 0 if variable
+    byte   Kind;         // SampleKind
+    DecodeFunc Decode;   // Decoder of the data type, NULL if unsupported
+    DecodeBatchFunc DecodeBatch;  // Decoder of the run in a batch of records
+    int    FirstField;   // Index of the first field in the collected fields
+    int    NumFields;    // Number of fields in the run
+    uint4  Count;        // Number of samples in the run
+};
+
+#define VARIABLE_OFFSET ((uint4)-1)
+
+/** Function converting a sample to a number, see decodeNumber() */
+typedef double (*NumberFunc)(const byte* ptr);
+
+/**
+ * QC rule compiled for a collected field, along with the state carried 
+ * from one batch of records to the next for each sample of the field. The
+ * state only carries over to the record following NextRecord.
+ */
+struct QcCheck {
+    QcCheck() : Column(0), NextRecord(0) {}
+    int    Column;          // Index of the field in the collected fields
+    QcRule Rule;
+    vector<double> Last;    // Last value that was not missing, NaN if none
+    vector<uint4>  Repeats; // Records that repeated the last value
+    uint4  NextRecord;      // Record number following the last one checked
+};
+
+struct Table;
+
+/**
+ * Layout of a field in the records of a table, as seen by a RecordView.
+ */
+struct FieldView {
+    FieldView() : FieldType(0), Dimension((uint4)0), Offset((uint4)0), 
+            Width((uint2)0), Number(NULL) {}
+    string FieldName;
+    byte   FieldType;
+    uint4  Dimension;
+    uint4  Offset;       // Byte offset in the record, VARIABLE_OFFSET if it
+                         // follows a variable length string
+    uint2  Width;        // Bytes per sample, 0 if variable
+    NumberFunc Number;   // Conversion of a sample, NULL unless numeric
+};
+
+/**
+ * Layout of the records collected from a table, with the offset of each
+ * collected field precomputed so that the fields of a record can be
+ * located without decoding the record.
+ */
+class TableView {
+public:
+    TableView() : recordSize__(0) {}
+    explicit TableView(const Table& tbl);
+
+    int    getNumFields() const { return (int)fields__.size(); }
+    const  FieldView& getField(int idx) const { return fields__[idx]; }
+    int    getFieldIndex(const string& name) const;
+    int    getRecordSize() const { return recordSize__; }
+
+private:
+    vector<FieldView> fields__;
+    map<string, int>  fieldIndex__;
+    int    recordSize__;  // -1 if the records have a variable length
+};
+
+/**
+ * Read-only view of a data record, pointing into the bytes received from
+ * the logger (the collect response or the fragment reassembly buffer). 
+ * Nothing is copied, the fields are located and decoded when accessed. The
+ * view is only valid while the bytes it points to are.
+ */
+class RecordView {
+public:
+    RecordView(const TableView& view, const byte* data, uint4 recNbr, 
+            const NSec& recTime) : view__(&view), data__(data), 
+            recordNbr__(recNbr), recordTime__(recTime) {}
+
+    const TableView& getTableView() const { return *view__; }
+    uint4  getRecordNbr() const { return recordNbr__; }
+    const  NSec& getRecordTime() const { return recordTime__; }
+
+    const  byte* getSample(int field, uint4 dim = 0) const;
+    double getNumber(int field, uint4 dim = 0) const;
+    double getNumber(const string& name, uint4 dim = 0) const 
+           throw (invalid_argument);
+    string getString(int field) const;
+    string getString(const string& name) const throw (invalid_argument);
+    const  byte* getEnd() const;
+
+protected:
+    const  byte* locateField(int field) const;
+
+private:
+    const TableView* view__;
+    const byte* data__;
+    uint4  recordNbr__;
+    NSec   recordTime__;
+};
+
 /**
  * Data structure that mirrors the binary structure in which the metadata for
  * a "Table" is stored in the data logger memory. As obvious, a table contains
@@ -112,8 +341,9 @@ struct Field {
  */
 struct Table {
     Table() : TblNum(0), TblSize((uint4)0), TblSignature((uint2)0), 
-            FirstSampleInFile((uint4)0), NewFileTime((uint4)0), 
-            NextRecord((uint4)0) {}
+            RecordSize(0), FirstSampleInFile((uint4)0), 
+            NewFileTime((uint4)0), NextRecord((uint4)0), 
+            BackfillNext((uint4)0), BackfillEnd((uint4)0) {}
     /* 
      * The following parameters are read in from the Table Definitions file
      * stored on the logger.
@@ -126,6 +356,8 @@ struct Table {
     NSec   TblTimeInterval;
     vector<Field>  field_list;
     uint2  TblSignature;
+    /** Size of a record with all the fields, -1 if variable, 0 if unknown */
+    int    RecordSize;
     /*
      * The following parameters are tracked by this application as the data
      * collection progresses.
@@ -134,9 +366,108 @@ struct Table {
     uint4  NewFileTime;
     uint4  NextRecord;
     NSec   LastRecordTime;
+    /*
+     * Subset of fields requested from the logger, identified by their 
+     * position in field_list (beginning from 1). All the fields are 
+     * collected if the list is empty.
+     */
+    vector<uint2>  FieldNumbers;
+    vector<Field>  collect_list;
+    /*
+     * Older records [BackfillNext, BackfillEnd) that were skipped to 
+     * collect the newest records first, and are yet to be backfilled.
+     */
+    uint4  BackfillNext;
+    uint4  BackfillEnd;
+    /** Suffix appended to the table name in data file names */
+    string FileTag;
+    /** Records skipped during collection, keyed by the first record */
+    map<uint4, RecordGap> Gaps;
+    /** Decode plan for the collected fields, see compileDecodePlan() */
+    vector<DecodeOp> DecodePlan;
+    /** Layout of the collected fields, compiled along with the plan */
+    TableView View;
+    /** QC checks of the collected fields, compiled along with the plan */
+    vector<QcCheck> QcPlan;
+
+    /** Fields present in the records received from the logger */
+    const vector<Field>& getCollectedFields() const 
+    {
+        return FieldNumbers.empty() ? field_list : collect_list;
+    }
+};
+
+/**
+ * String sample of a record, pointing into the bytes of the record. It is
+ * only valid while the bytes it points to are.
+ */
+struct StringRef {
+    StringRef() : Ptr(NULL), Length((uint4)0) {}
+    const char* Ptr;
+    uint4  Length;
+};
+
+/**
+ * Samples of a field for a batch of records, stored in the array matching
+ * the conversion of the field. The samples of a record are consecutive.
+ */
+struct RecordColumn {
+    RecordColumn() : FieldPtr(NULL), Kind(SAMPLE_NONE), Samples((uint4)0) {}
+    const Field*   FieldPtr;
+    byte           Kind;       // SampleKind of the samples
+    uint4          Samples;    // Samples per record
+    vector<uint4>  Uints;      // SAMPLE_UINT
+    vector<int>    Ints;       // SAMPLE_INT
+    vector<float>  Floats;     // SAMPLE_FLOAT
+    vector<double> Doubles;    // SAMPLE_DOUBLE
+    vector<byte>   Bools;      // SAMPLE_BOOL
+    vector<NSec>   Times;      // SAMPLE_TIME
+    vector<StringRef> Strings; // SAMPLE_STRING
+};
+
+/**
+ * Sample of a batch of records flagged by the QC checks.
+ */
+struct QcResult {
+    QcResult() : Record(0), Column(0), Sample((uint4)0), Flags(0), 
+            Value(0) {}
+    int    Record;          // Index of the record in the batch
+    int    Column;          // Index of the column of the field
+    uint4  Sample;          // Index of the sample in the field
+    byte   Flags;           // QcFlag raised for the sample
+    double Value;
+};
+
+/**
+ * Batch of records decoded into columns, one column per collected field,
+ * along with the time and number of each record, and the samples flagged
+ * by the QC checks of the table.
+ */
+struct RecordBatch {
+    RecordBatch() : NumRecords(0) {}
+    int            NumRecords;
+    vector<NSec>   Times;
+    vector<uint4>  RecordNumbers;
+    vector<RecordColumn> Columns;
+    vector<QcResult> QcResults;  // Ordered by record, column and sample
+};
+
+/**
+ * Interface for consumers inspecting the records of a table as they are
+ * received, through a RecordView, before the records are decoded and
+ * handed to the TableDataWriter.
+ */
+class RecordInspector {
+public:
+    virtual ~RecordInspector() {}
+
+    /** Function called for each record received for a table */
+    virtual void inspectRecord(const Table& tblRef, 
+            const RecordView& record) = 0;
 };
 
 class TableDataWriter;
+class TableAggregator;
 
 /**
  * Class for holding the data structure information for Tables being stored
@@ -154,24 +485,40 @@ class TableDataManager {
 
         const DLProgStats& getProgStats () const; 
         void   setProgStats (DLProgStats& stats);
+        int    loadSessionCache ();
+        void   saveSessionCache ();
+        void   clearSessionCache ();
 
         TableDataWriter* getTableDataWriter();
         void   setTableDataWriter(TableDataWriter* tblDataWriter);
+        void   addRecordInspector(RecordInspector* inspector);
+        void   removeRecordInspector(RecordInspector* inspector);
 
         int    BuildTDF();
+        int    ReloadTDF() throw (StorageException);
         int    xmlDumpTDF (char *filename);
 
         Table& getTableRef (const string& TableName) throw (invalid_argument);
+        void   setFieldSubset (Table& tbl_ref, const vector<string>& names);
+        void   resetQcState (Table& tbl_ref);
         int    storeRecord (Table& tbl_ref, byte **data, 
                        uint4 rec_num, int file_span, bool parseTimestamp)
                throw (StorageException);
+        int    storeRecords (Table& tbl_ref, byte **data, uint4 rec_num, 
+                       int nrecs, bool parseTimestamp)
+               throw (StorageException);
         int    getRecordSize (const Table& tbl);
         int    getMaxRecordSize();
+        int    getRecordSizeLimit (const Table& tbl);
 
         void   cleanCache();
         void   flushTableDataCache(Table& tblRef);
+        void   saveTableStorageHistory();
+        uint4  getFileStamp(const Table& tbl);
 
     protected : 
+        int    loadTDFCache (const string& cache_file, uint4 tdf_size);
+        void   saveTDFCache (const string& cache_file, uint4 tdf_size);
         int    readTableDefinition (int table_num, byte *ptr, byte *endptr);
         int    readFieldList (byte *ptr, byte *endptr, Table& Tbl);
 
@@ -181,17 +528,31 @@ class TableDataManager {
         const char* getDataType (const Field& var);
         void   logUnimplementedDataError(const Field& var);
 
-        void   storeDataSample(const Field& var, byte **data);
+        void   compileDecodePlan(Table& tbl);
+        void   compileQcPlan(Table& tbl);
+        void   checkBatch(Table& tbl);
+        void   initBatch(const Table& tbl, int nrecs);
+        void   decodeRecord(const Table& tbl, byte **data);
+        void   decodeRecords(const Table& tbl, const byte *data, 
+                       uint4 stride, int nrecs);
         int    getFieldSize (const Field& field);
 
         void   loadTableStorageHistory();
-        void   saveTableStorageHistory();
+        void   loadTableHistory(Table& tbl);
+        void   saveTableHistory(const Table& tbl);
+        void   clearAggregators();
+        void   resetCollectionState(Table& tbl);
 
     private :
         byte          fslVersion__;
+        uint2         tdfSignature__;
         vector<Table> tableList__;
         DataOutputConfig       dataOutputConfig__;
         DLProgStats   dataLoggerProgStats__;
+        RecordBatch   batch__;
+        vector<byte>  qcFlags__;
+        vector<RecordInspector*> inspectors__;
+        vector<TableAggregator*> aggregators__;
         auto_ptr<TableDataWriter> tblDataWriter__;
 };
 
@@ -240,6 +601,24 @@ public:
     /** Function called for storing a float data sample */
     virtual void storeFloat(const Field& var, float num) = 0;
 
+    /** 
+     * Function called for storing a double precision data sample, stored
+     * as a float unless overridden.
+     */
+    virtual void storeDouble(const Field& var, double num) 
+    {
+        storeFloat(var, (float)num);
+    }
+
+    /** 
+     * Function called for storing a time data sample, stored as the number
+     * of seconds since 1990 unless overridden.
+     */
+    virtual void storeTime(const Field& var, const NSec& time) 
+    {
+        storeUint4(var, time.sec);
+    }
+
     /** Function called for storing a c-string data sample */
     virtual void storeString(const Field& var, string& str) = 0;
 
@@ -255,6 +634,23 @@ public:
     /** Function called upon completion of parsing a binary data record */
     virtual void processRecordEnd(Table& tblRef) = 0;
 
+    /** 
+     * Function called for each sample of a record flagged by the QC 
+     * checks, after the record is stored. The flags are ignored unless
+     * overridden.
+     */
+    virtual void processQcResult(Table& tblRef, const RecordBatch& batch, 
+            const QcResult& result) {}
+
+    /** 
+     * Function called to store a batch of decoded records. By default the
+     * samples are passed on to the per sample functions above. The 
+     * NextRecord and LastRecordTime of the table are advanced past each 
+     * record as it is stored, overriding functions are expected to do the 
+     * same.
+     */
+    virtual void writeBatch(Table& tblRef, const RecordBatch& batch);
+
     /** 
      * Function called to indicate the completion of data collection
      * for a specific table. 
@@ -274,6 +670,8 @@ private:
      * writer.
      */ 
     TableDataManager* tableDataMgr__;
+    /** String passed on to storeString(), reused between samples */
+    string strSample__;
 };
 
 // TODO Add a setTimestampFormat function to AsciiWriter
@@ -294,12 +692,16 @@ public:
     virtual void storeBool(const Field& var, bool flag);
     virtual void storeInt(const Field& var, int num);
     virtual void storeFloat(const Field& var, float num);
+    virtual void storeDouble(const Field& var, double num);
+    virtual void storeTime(const Field& var, const NSec& time);
     virtual void storeString(const Field& var, string& str);
     virtual void storeUint2(const Field& var, uint2 num);
     virtual void storeUint4(const Field& var, uint4 num);
 
     virtual void processUnimplemented(const Field& var);
     virtual void processRecordEnd(Table& tblRef);
+    virtual void processQcResult(Table& tblRef, const RecordBatch& batch, 
+                const QcResult& result);
     virtual void finishWrite(Table& tblRef) throw (StorageException);
     virtual void flush(const Table& tblRef);
 
@@ -312,10 +714,13 @@ protected:
     string getFileTimestamp(uint4 sample_time) throw (invalid_argument);
     void   openDataFile(const Table& tblRef, bool newFile) throw (StorageException);
     void   moveRawFile(const Table& tblRef) throw (StorageException);
+    void   openQcFile(const Table& tblRef);
+    void   moveQcFile(const Table& tblRef, const string& fileTimestamp);
     void   reportRecordCount();
 
 private:
     ofstream dataFileStream__;
+    ofstream qcFileStream__;     // QC stream, see processQcResult()
     string   dataDir__;
     int      fileSpan__;
     char     seperator__;
@@ -339,14 +744,110 @@ private:
     TableDataWriterFactory() {};
 }; 
 
+/**
+ * Input of a TableAggregator: a field of the table aggregated from, and
+ * the accumulators of its samples.
+ */
+struct AggregateInput {
+    AggregateInput() : Column(0), DirColumn(-1), Stats(0), 
+            Samples((uint4)0), FirstAcc((uint4)0), Missing(-9999), 
+            DirMissing(-9999) {}
+    int    Column;          // Column of the field in a batch of records
+    int    DirColumn;       // Column of the wind direction, for AGG_WIND
+    byte   Stats;           // AggregateStat to compute
+    uint4  Samples;         // Samples of the field in a record
+    uint4  FirstAcc;        // Index of the accumulator of the first sample
+    double Missing;         // Sentinel of the QC rule of the field, if any
+    double DirMissing;      // Sentinel of the QC rule of the direction
+};
+
+/**
+ * Running statistics of a sample over a window.
+ */
+struct Accumulator {
+    Accumulator() { reset(); }
+    uint4  Count;
+    double Mean;
+    double M2;              // Sum of squared differences from the mean
+    double Min;
+    double Max;
+    double SumSin;          // Sums of the direction unit vector, AGG_WIND
+    double SumCos;
+
+    void   reset();
+    void   add(double value);
+    void   addDirection(double degrees);
+};
+
+/**
+ * Aggregation of the records of a collected table into a derived table,
+ * with the statistics of the configured fields over consecutive windows of
+ * a fixed length. A window is stored with the time of its end, once the 
+ * first record of a later window is received. The derived table is stored
+ * with a writer of its own, as the writer of the TableDataManager is busy
+ * with the records of the table being collected.
+ */
+class TableAggregator {
+public:
+    TableAggregator(const AggregateOpt& opt, 
+            const TableDataManager* tblDataMgr);
+    ~TableAggregator();
+
+    /** Name of the table the records are aggregated from */
+    const string& getSourceName() const { return opt__.TableName; }
+    /** Derived table the windows are stored to */
+    Table& getTable() { return table__; }
+
+    void   compile(const Table& source);
+    void   addBatch(const RecordBatch& batch);
+    void   loadState(const string& path);
+    void   saveState(const string& path) const;
+    uint4  getFileStamp() const;
+
+protected:
+    void   addField(const Field& var, const char* suffix, 
+               const char* processing, const char* unit);
+    void   storeWindow();
+    void   writeWindows();
+
+private:
+    TableAggregator(const TableAggregator&);
+    TableAggregator& operator=(const TableAggregator&);
+
+    AggregateOpt   opt__;
+    Table          table__;
+    auto_ptr<TableDataWriter> writer__;
+    bool           writing__;       // Set once the writer is initialized
+    vector<AggregateInput> inputs__;
+    vector<Accumulator>    accumulators__;
+    uint2          layoutSig__;     // Signature of the derived field names
+    uint4          windowEnd__;     // End of the current window, 0 if none
+    RecordBatch    windows__;       // Windows waiting to be written
+    vector<Accumulator>    loadedAccumulators__;
+    uint2          loadedSig__;     // Layout the loaded state belongs to
+};
+
 string GetVarLenString (const byte *ptr);
-string GetFixedLenString (const byte *str_ptr, Field& var);
+string GetFixedLenString (const byte *str_ptr, const Field& var);
+uint4  GetFixedLenStringSize (const byte *str_ptr, uint4 dimension);
 NSec   parseRecordTime(const byte* data);
 
 //! Function to convert a bit pattern to the equivalent floating
 //! point number following specifications of IEEE-754 standard.
 float  intBitsToFloat (uint4 bits);
 
+//! Function to obtain the IEEE-754 bit pattern of a floating point number.
+uint4  floatToIntBits (float num);
+
+//! Functions to decode arrays of samples, vectorized when built with SSSE3.
+void   decodeFinalStorageFloats (const byte* src, float* dst, uint4 count);
+void   decodeIeee4Floats (const byte* src, float* dst, uint4 count);
+void   decodeBigEndian (const byte* src, uint4* dst, uint4 count, int width);
+
+//! Function to add a record to a list of record gaps, merging adjacent ones.
+void   addRecordGap (map<uint4, RecordGap>& gaps, uint4 rec_nbr, 
+               int attempts);
+
 //! Function to extract floating point number from low resolution
 //! final storage format.
 float  GetFinalStorageFloat (byte **data);
@@ -41,6 +41,70 @@ auto_ptr<TableDataWriter> TableDataWriterFactory :: getWriter(TDWtype type)
     }
 }
 
+/**
+ * Default implementation for storing a batch of records, passing the
+ * samples of each record on to the per sample functions, followed by the
+ * samples of the record flagged by the QC checks. The table is advanced
+ * past each record once it is stored, so that the records stored before
+ * a failure are not collected again.
+ *
+ * @param tblRef: Reference to the Table structure the records belong to.
+ * @param batch: Records decoded into columns.
+ */
+void TableDataWriter :: writeBatch(Table& tblRef, const RecordBatch& batch)
+{
+    vector<RecordColumn>::const_iterator column;
+    vector<QcResult>::const_iterator qc = batch.QcResults.begin();
+
+    for (int rec = 0; rec < batch.NumRecords; rec++) {
+        processRecordBegin(tblRef, batch.RecordNumbers[rec], batch.Times[rec]);
+
+        for (column = batch.Columns.begin(); column != batch.Columns.end(); 
+                column++) {
+            const Field& var = *column->FieldPtr;
+            uint4 beg = rec * column->Samples;
+            uint4 end = beg + column->Samples;
+
+            for (uint4 idx = beg; idx < end; idx++) {
+                switch (column->Kind) {
+                    case SAMPLE_UINT : 
+                        storeUint4(var, column->Uints[idx]);
+                        break;
+                    case SAMPLE_INT : 
+                        storeInt(var, column->Ints[idx]);
+                        break;
+                    case SAMPLE_FLOAT : 
+                        storeFloat(var, column->Floats[idx]);
+                        break;
+                    case SAMPLE_DOUBLE : 
+                        storeDouble(var, column->Doubles[idx]);
+                        break;
+                    case SAMPLE_BOOL : 
+                        storeBool(var, column->Bools[idx]);
+                        break;
+                    case SAMPLE_TIME : 
+                        storeTime(var, column->Times[idx]);
+                        break;
+                    case SAMPLE_STRING : 
+                        strSample__.assign(column->Strings[idx].Ptr, 
+                                column->Strings[idx].Length);
+                        storeString(var, strSample__);
+                        break;
+                    default : 
+                        processUnimplemented(var);
+                }
+            }
+        }
+        processRecordEnd(tblRef);
+        tblRef.NextRecord = batch.RecordNumbers[rec] + 1;
+        tblRef.LastRecordTime = batch.Times[rec];
+
+        for (; (qc != batch.QcResults.end()) && (qc->Record == rec); qc++) {
+            processQcResult(tblRef, batch, *qc);
+        }
+    }
+}
+
 /**
  * Constructor for an AsciiWriter object.
  * 
@@ -77,6 +141,9 @@ AsciiWriter :: ~AsciiWriter()
                      .error("Caught exception during closing filestream");
         } 
     }
+    if (qcFileStream__.is_open()) {
+        qcFileStream__.close();
+    }
 }
 
 /**
@@ -203,6 +270,9 @@ void AsciiWriter :: processRecordEnd(Table& tbl_ref)
 
 void AsciiWriter :: finishWrite(Table& tblRef) throw (StorageException)
 {
+    if (qcFileStream__.is_open()) {
+        qcFileStream__.close();
+    }
     if (dataFileStream__.is_open()) {
         try {
             dataFileStream__.close(); // close() can throw ios_base::failure too.
@@ -232,6 +302,20 @@ void AsciiWriter :: storeFloat(const Field& var, float num)
    dataFileStream__ << this->seperator__ << num;
 }
 
+void AsciiWriter :: storeDouble(const Field& var, double num)
+{
+   streamsize precision = dataFileStream__.precision(15);
+   dataFileStream__ << this->seperator__ << num;
+   dataFileStream__.precision(precision);
+}
+
+void AsciiWriter :: storeTime(const Field& var, const NSec& time)
+{
+   char timestamp[64];
+   AsciiWriter::GetTimestamp(timestamp, time);
+   dataFileStream__ << this->seperator__ << timestamp;
+}
+
 void AsciiWriter :: storeInt(const Field& var, int num)
 {
     dataFileStream__ << this->seperator__ << num;
@@ -257,6 +341,120 @@ void AsciiWriter :: processUnimplemented(const Field& var)
    dataFileStream__ << this->seperator__ << "-9999";
 }
 
+/** Names of the QcFlag bits, as written to the QC stream */
+static const char* qcFlagNames[] = {
+    "missing", "below_min", "above_max", "step", "stuck"
+};
+
+/**
+ * Function to write a sample flagged by the QC checks to the QC stream of
+ * the table, a file following the data file with one line per flagged 
+ * sample. The QC file is moved along with the data file, see moveRawFile().
+ *
+ * @param tblRef: Reference to the Table structure the record belongs to.
+ * @param batch: Batch of records holding the flagged sample.
+ * @param result: Flagged sample.
+ */
+void AsciiWriter :: processQcResult(Table& tblRef, const RecordBatch& batch,
+        const QcResult& result)
+{
+    if (!qcFileStream__.is_open()) {
+        openQcFile(tblRef);
+        if (!qcFileStream__.is_open()) {
+            return;
+        }
+    }
+
+    const Field& var = *batch.Columns[result.Column].FieldPtr;
+    char timestamp[32];
+    AsciiWriter::GetTimestamp(timestamp, batch.Times[result.Record]);
+
+    qcFileStream__ << timestamp << seperator__ 
+                   << batch.RecordNumbers[result.Record] << seperator__ 
+                   << "\"" << var.FieldName;
+    if (var.Dimension > 1) {
+        qcFileStream__ << "(" << result.Sample + 1 << ")";
+    }
+    qcFileStream__ << "\"" << seperator__ << result.Value << seperator__ 
+                   << "\"";
+
+    const char* sep = "";
+    for (int bit = 0; bit < (int)(sizeof(qcFlagNames)/sizeof(char*)); bit++) {
+        if (result.Flags & (1 << bit)) {
+            qcFileStream__ << sep << qcFlagNames[bit];
+            sep = "|";
+        }
+    }
+    qcFileStream__ << "\"" << endl;
+}
+
+/**
+ * Function to open the temporary QC file of a table for appending, with
+ * a header line if the file is new.
+ *
+ * @param tblRef: Reference to the Table structure the QC stream belongs to.
+ */
+void AsciiWriter :: openQcFile(const Table& tblRef)
+{
+    struct stat buf;
+    string tmp_file = this->getTableDataManager()
+                          ->getDataOutputConfig().WorkingPath 
+                        + "/.working/" + tblRef.TblName + tblRef.FileTag
+                        + ".qc.tmp";
+    bool new_file = (stat (tmp_file.c_str(), &buf) != 0) || 
+                    (buf.st_size == 0);
+
+    qcFileStream__.clear();
+    qcFileStream__.open (tmp_file.c_str(), ofstream::out | ofstream::app);
+
+    if (!qcFileStream__.is_open()) {
+        Category::getInstance("AsciiWriter")
+                 .error("Failed to open QC file : " + tmp_file);
+        return;
+    }
+
+    if (new_file) {
+        qcFileStream__ << "\"TIMESTAMP\",\"RECORD\",\"FIELD\",\"VALUE\","
+                       << "\"FLAGS\"" << endl;
+    }
+}
+
+/**
+ * Function to move the temporary QC file of a table next to the data file
+ * it follows, if any samples were flagged while the data file was written.
+ *
+ * @param tblRef: Reference to the Table structure the QC stream belongs to.
+ * @param fileTimestamp: Timestamp in the name of the data file.
+ */
+void AsciiWriter :: moveQcFile(const Table& tblRef, 
+        const string& fileTimestamp)
+{
+    struct stat buf;
+    const string& working_path = this->getTableDataManager()
+                                     ->getDataOutputConfig().WorkingPath;
+    string tmp_file = working_path + "/.working/" + tblRef.TblName 
+                        + tblRef.FileTag + ".qc.tmp";
+    string final_file = working_path + "/" + tblRef.TblName + tblRef.FileTag 
+                        + "." + fileTimestamp + ".qc";
+
+    if (qcFileStream__.is_open()) {
+        qcFileStream__.close();
+    }
+
+    if (stat (tmp_file.c_str(), &buf) != 0) {
+        return;
+    }
+
+    if (rename (tmp_file.c_str(), final_file.c_str()) == 0) {
+        Category::getInstance("AsciiWriter")
+                 .info("Created : " + final_file);
+    }
+    else {
+        Category::getInstance("AsciiWriter")
+                 .error("Failed to rename " + tmp_file + " to " + final_file);
+    }
+}
+
 /**
  * Function to create a new data file along with the header for the
  * particular table.
@@ -280,7 +478,8 @@ void AsciiWriter :: openDataFile (const Table& tbl_ref, bool new_file)
     bool   isSuccess(false);
     string tmp_file = this->getTableDataManager()
                           ->getDataOutputConfig().WorkingPath 
-                        + "/.working/" + tbl_ref.TblName + ".tmp";
+                        + "/.working/" + tbl_ref.TblName + tbl_ref.FileTag
+                        + ".tmp";
 
     if (!new_file) {
         file_stat = stat (tmp_file.c_str(), &buf);
@@ -361,7 +560,7 @@ void AsciiWriter :: printHeaderLine(const char* prefix,
 
 void AsciiWriter :: writeHeader(const Table& tbl_ref)
 {
-    const vector<Field>& fieldList = tbl_ref.field_list;
+    const vector<Field>& fieldList = tbl_ref.getCollectedFields();
 
     const TableDataManager* tblDataMgr = this->getTableDataManager();
 
@@ -412,7 +611,7 @@ void AsciiWriter :: flush(const Table& tblRef)
 /**
  * Function to rename the temporary datafile to one with appropriate timestamp.
  * It also moves the file from the <working_path>/.working to <working_path> 
- * directory. 
+ * directory, along with the QC file of the data file. 
  * Throws AppException if there was an error in building the target datafile 
  * name or if the call to rename() failed.
  *
@@ -430,19 +629,26 @@ void AsciiWriter :: moveRawFile (const Table& tbl_ref) throw (StorageException)
 
     tmpDatafilePath.append("/.working/")
                    .append(tbl_ref.TblName)
+                   .append(tbl_ref.FileTag)
                    .append(".tmp");
 
+    string fileTimestamp;
+
     try {
+        fileTimestamp = getFileTimestamp(tbl_ref.FirstSampleInFile);
         finalDatafilePath.append("/")
                      .append(tbl_ref.TblName)
+                     .append(tbl_ref.FileTag)
                      .append(".")
-                     .append(getFileTimestamp(tbl_ref.FirstSampleInFile))
+                     .append(fileTimestamp)
                      .append(".raw");
     } 
     catch(invalid_argument& iae) {
         return;
     }
 
+    moveQcFile(tbl_ref, fileTimestamp);
+
     struct stat tmpFileStat;
     int status = stat(tmpDatafilePath.c_str(), &tmpFileStat);
     
@@ -0,0 +1,435 @@
+/**
+ * @file pb5_decode.h
+ * Decoders for the samples stored in the data records of a table. Each
+ * data type of the logger is described by a sample type defining its
+ * width, byte order and conversion, and the decoders are specialized at
+ * compile time for every sample type.
+ */
+
+#ifndef PB5_DECODE_H
+#define PB5_DECODE_H
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include "pb5.h"
+using namespace std;
+
+float  GetFinalStorageFloat (uint2 unum);
+
+/**
+ * Function to load an unsigned integer of N bytes, stored MSB first or
+ * LSB first if LSB is set.
+ */
+template <int N, bool LSB>
+inline uint4 loadUint (const byte* ptr)
+{
+    uint4 num = 0;
+    for (int idx = 0; idx < N; idx++) {
+        num = (num << 8) | ptr[LSB ? N - 1 - idx : idx];
+    }
+    return num;
+}
+
+/** Array of a column the samples of a given type are stored in */
+template <class V> vector<V>& columnSamples (RecordColumn& column);
+
+template <> inline vector<uint4>& columnSamples<uint4> (RecordColumn& column)
+{
+    return column.Uints;
+}
+
+template <> inline vector<int>& columnSamples<int> (RecordColumn& column)
+{
+    return column.Ints;
+}
+
+template <> inline vector<float>& columnSamples<float> (RecordColumn& column)
+{
+    return column.Floats;
+}
+
+template <> inline vector<double>& columnSamples<double> (RecordColumn& column)
+{
+    return column.Doubles;
+}
+
+template <> inline vector<byte>& columnSamples<byte> (RecordColumn& column)
+{
+    return column.Bools;
+}
+
+template <> inline vector<NSec>& columnSamples<NSec> (RecordColumn& column)
+{
+    return column.Times;
+}
+
+/**
+ * Base of the sample types. A sample type provides decode() for a single
+ * sample, and may replace decodeArray() with a vectorized kernel.
+ */
+template <class Sample, class V, int N, SampleKind K>
+struct SampleType {
+    typedef V Value;
+    enum { Width = N, Kind = K };
+
+    static void decodeArray (const byte* src, Value* dst, uint4 count)
+    {
+        for (uint4 idx = 0; idx < count; idx++) {
+            dst[idx] = Sample::decode (src + N*idx);
+        }
+    }
+};
+
+/** Unsigned integer of N bytes */
+template <int N, bool LSB>
+struct UintSample : SampleType<UintSample<N, LSB>, uint4, N, SAMPLE_UINT> {
+    static uint4 decode (const byte* ptr)
+    {
+        return loadUint<N, LSB> (ptr);
+    }
+
+    static void decodeArray (const byte* src, uint4* dst, uint4 count)
+    {
+        if (LSB) {
+            SampleType<UintSample, uint4, N, SAMPLE_UINT>
+                    ::decodeArray (src, dst, count);
+        }
+        else {
+            decodeBigEndian (src, dst, count, N);
+        }
+    }
+};
+
+/** Signed integer of N bytes, sign extended to an int */
+template <int N, bool LSB>
+struct IntSample : SampleType<IntSample<N, LSB>, int, N, SAMPLE_INT> {
+    static int decode (const byte* ptr)
+    {
+        return (int)(loadUint<N, LSB> (ptr) << (32 - 8*N)) >> (32 - 8*N);
+    }
+
+    static void decodeArray (const byte* src, int* dst, uint4 count)
+    {
+        if ((N == 4) && !LSB) {
+            decodeBigEndian (src, (uint4 *)dst, count, N);
+        }
+        else {
+            SampleType<IntSample, int, N, SAMPLE_INT>
+                    ::decodeArray (src, dst, count);
+        }
+    }
+};
+
+/** 2-byte final storage floating point (FP2) */
+struct Fp2Sample : SampleType<Fp2Sample, float, 2, SAMPLE_FLOAT> {
+    static float decode (const byte* ptr)
+    {
+        return GetFinalStorageFloat ((uint2)loadUint<2, false> (ptr));
+    }
+
+    static void decodeArray (const byte* src, float* dst, uint4 count)
+    {
+        decodeFinalStorageFloats (src, dst, count);
+    }
+};
+
+/**
+ * 3-byte final storage floating point (FP3), a sign bit, a 3 bit decimal
+ * locator and a 20 bit mantissa.
+ */
+struct Fp3Sample : SampleType<Fp3Sample, float, 3, SAMPLE_FLOAT> {
+    static float decode (const byte* ptr)
+    {
+        static const float divisor[8] = { 1.0f, 10.0f, 100.0f, 1000.0f,
+                1e4f, 1e5f, 1e6f, 1e7f };
+        uint4 bits = loadUint<3, false> (ptr);
+        float abs_val = (float)(bits & 0xfffff) / divisor[(bits >> 20) & 0x07];
+        return (bits & 0x800000) ? -abs_val : abs_val;
+    }
+};
+
+/**
+ * 4-byte CSI floating point (FP4), a sign bit, a 7 bit binary exponent
+ * with a bias of 64 and a 24 bit mantissa.
+ */
+struct Fp4Sample : SampleType<Fp4Sample, float, 4, SAMPLE_FLOAT> {
+    static float decode (const byte* ptr)
+    {
+        uint4 bits = loadUint<4, false> (ptr);
+        float abs_val = (float)ldexp ((double)(bits & 0xffffff),
+                (int)((bits >> 24) & 0x7f) - 64 - 24);
+        return (bits & 0x80000000) ? -abs_val : abs_val;
+    }
+};
+
+/** 4-byte IEEE floating point */
+template <bool LSB>
+struct Ieee4Sample : SampleType<Ieee4Sample<LSB>, float, 4, SAMPLE_FLOAT> {
+    static float decode (const byte* ptr)
+    {
+        return intBitsToFloat (loadUint<4, LSB> (ptr));
+    }
+
+    static void decodeArray (const byte* src, float* dst, uint4 count)
+    {
+        if (LSB) {
+            SampleType<Ieee4Sample, float, 4, SAMPLE_FLOAT>
+                    ::decodeArray (src, dst, count);
+        }
+        else {
+            decodeIeee4Floats (src, dst, count);
+        }
+    }
+};
+
+/** 8-byte IEEE floating point */
+template <bool LSB>
+struct Ieee8Sample : SampleType<Ieee8Sample<LSB>, double, 8, SAMPLE_DOUBLE> {
+    static double decode (const byte* ptr)
+    {
+        uint64_t hi = loadUint<4, LSB> (ptr + (LSB ? 4 : 0));
+        uint64_t bits = (hi << 32) | loadUint<4, LSB> (ptr + (LSB ? 0 : 4));
+        double num;
+        memcpy (&num, &bits, sizeof(num));
+        return num;
+    }
+};
+
+/**
+ * Boolean value of N bytes. The 1-byte boolean is set by its most
+ * significant bit, the wider ones by any bit.
+ */
+template <int N>
+struct BoolSample : SampleType<BoolSample<N>, byte, N, SAMPLE_BOOL> {
+    static byte decode (const byte* ptr)
+    {
+        if (N == 1) {
+            return (*ptr & 0x80) ? 1 : 0;
+        }
+        return loadUint<N, false> (ptr) ? 1 : 0;
+    }
+};
+
+/** 6-byte time in 10's of microseconds since 1990 (USec) */
+struct USecSample : SampleType<USecSample, NSec, 6, SAMPLE_TIME> {
+    static NSec decode (const byte* ptr)
+    {
+        uint64_t usec10 = ((uint64_t)loadUint<2, false> (ptr) << 32) |
+                loadUint<4, false> (ptr + 2);
+        NSec time;
+        time.sec = (uint4)(usec10 / 100000);
+        time.nsec = (uint4)(usec10 % 100000) * 10000;
+        return time;
+    }
+};
+
+/** Time in seconds since 1990 followed by nanoseconds (NSec) */
+template <bool LSB>
+struct NSecSample : SampleType<NSecSample<LSB>, NSec, 8, SAMPLE_TIME> {
+    static NSec decode (const byte* ptr)
+    {
+        NSec time;
+        time.sec = loadUint<4, LSB> (ptr);
+        time.nsec = loadUint<4, LSB> (ptr + 4);
+        return time;
+    }
+};
+
+typedef UintSample<1, false>  ByteSample;
+typedef UintSample<2, false>  UInt2Sample;
+typedef UintSample<4, false>  UInt4Sample;
+typedef UintSample<2, true>   UInt2LsfSample;
+typedef UintSample<4, true>   UInt4LsfSample;
+typedef IntSample<1, false>   Int1Sample;
+typedef IntSample<2, false>   Int2Sample;
+typedef IntSample<4, false>   Int4Sample;
+typedef IntSample<2, true>    Int2LsfSample;
+typedef IntSample<4, true>    Int4LsfSample;
+typedef Ieee4Sample<false>    IeeeSample;
+typedef Ieee4Sample<true>     IeeeLsfSample;
+typedef Ieee8Sample<false>    Ieee8MsfSample;
+typedef Ieee8Sample<true>     Ieee8LsfSample;
+typedef BoolSample<1>         Bool1Sample;
+typedef BoolSample<2>         Bool2Sample;
+typedef BoolSample<4>         Bool4Sample;
+typedef NSecSample<false>     NSecMsfSample;
+typedef NSecSample<true>      NSecLsfSample;
+
+/**
+ * Function to decode a run of samples of the same type spread over one or
+ * more consecutive fields, appending the samples of each field to its
+ * column. A run spanning several fields is decoded at once and split
+ * between the columns afterwards.
+ *
+ * @param ptr: Pointer to the first sample of the run in the record.
+ * @param column: Column of the first field in the run.
+ * @param end: Column following the last field in the run.
+ * @param count: Number of samples in the run.
+ * @return Pointer to the byte following the run.
+ */
+template <class Sample>
+byte* decodeRun (byte* ptr, RecordColumn* column, RecordColumn* end,
+        uint4 count)
+{
+    typedef typename Sample::Value Value;
+    static vector<Value> run;
+    const Value* src = NULL;
+
+    if (end - column > 1) {
+        run.resize(count);
+        Sample::decodeArray (ptr, &run[0], count);
+        src = &run[0];
+    }
+
+    for (; column < end; column++) {
+        vector<Value>& samples = columnSamples<Value> (*column);
+        uint4 size = samples.size();
+        samples.resize(size + column->Samples);
+        if (src) {
+            copy (src, src + column->Samples, samples.begin() + size);
+            src += column->Samples;
+        }
+        else {
+            Sample::decodeArray (ptr, &samples[size], column->Samples);
+        }
+    }
+    return ptr + Sample::Width * count;
+}
+
+/**
+ * Function to decode a run of samples from each record of a batch, the 
+ * records following each other at a fixed stride. The columns of the run
+ * are extended once for the whole batch. A run of a single field is 
+ * decoded straight into its column, the samples of a longer run are 
+ * decoded at once for each record and then scattered to the columns, so
+ * that the cost per field is a single copy.
+ *
+ * @param ptr: Pointer to the first sample of the run in the first record.
+ * @param stride: Size of a record.
+ * @param nrecs: Number of records.
+ * @param column: Column of the first field in the run.
+ * @param end: Column following the last field in the run.
+ * @param count: Number of samples of the run in each record.
+ */
+template <class Sample>
+void decodeRunBatch (const byte* ptr, uint4 stride, int nrecs, 
+        RecordColumn* column, RecordColumn* end, uint4 count)
+{
+    typedef typename Sample::Value Value;
+    static vector<Value*> dst;
+    static vector<Value>  run;
+    int nfields = end - column;
+
+    dst.resize(nfields);
+    for (int idx = 0; idx < nfields; idx++) {
+        vector<Value>& samples = columnSamples<Value> (column[idx]);
+        uint4 size = samples.size();
+        samples.resize(size + nrecs * column[idx].Samples);
+        dst[idx] = samples.empty() ? NULL : &samples[0] + size;
+    }
+
+    if (nfields == 1) {
+        for (int rec = 0; rec < nrecs; rec++) {
+            Sample::decodeArray (ptr + rec*stride, dst[0] + rec*count, count);
+        }
+        return;
+    }
+
+    run.resize(count);
+    for (int rec = 0; rec < nrecs; rec++) {
+        Sample::decodeArray (ptr + rec*stride, &run[0], count);
+        const Value* src = &run[0];
+
+        for (int idx = 0; idx < nfields; idx++) {
+            uint4 samples = column[idx].Samples;
+            if (samples == 1) {
+                *dst[idx]++ = *src++;
+            }
+            else {
+                dst[idx] = copy (src, src + samples, dst[idx]);
+                src += samples;
+            }
+        }
+    }
+}
+
+/** Conversion of the decoded samples to a number */
+inline double sampleNumber (uint4 num) { return num; }
+inline double sampleNumber (int num) { return num; }
+inline double sampleNumber (float num) { return num; }
+inline double sampleNumber (double num) { return num; }
+inline double sampleNumber (byte flag) { return flag; }
+inline double sampleNumber (const NSec& time) 
+{ 
+    return time.sec + time.nsec * 1e-9; 
+}
+
+/** 
+ * Function to decode a single sample as a number, used by RecordView to 
+ * decode the fields on access.
+ */
+template <class Sample>
+double decodeNumber (const byte* ptr)
+{
+    return sampleNumber (Sample::decode (ptr));
+}
+
+/** 
+ * Function to decode a fixed length string, unused portion filled. The 
+ * strings are not copied, they point into the record.
+ */
+inline byte* decodeFixedString (byte* ptr, RecordColumn* column,
+        RecordColumn* end, uint4 count)
+{
+    StringRef str;
+    str.Ptr = (const char *)ptr;
+    str.Length = GetFixedLenStringSize (ptr, column->FieldPtr->Dimension);
+    column->Strings.push_back(str);
+    return ptr + column->FieldPtr->Dimension;
+}
+
+/** Function to decode a variable length null-terminated string in place */
+inline byte* decodeVarString (byte* ptr, RecordColumn* column,
+        RecordColumn* end, uint4 count)
+{
+    StringRef str;
+    str.Ptr = (const char *)ptr;
+    str.Length = strlen (str.Ptr);
+    column->Strings.push_back(str);
+    return ptr + str.Length + 1;
+}
+
+/** Function to decode a fixed length string from a batch of records */
+inline void decodeFixedStringBatch (const byte* ptr, uint4 stride, 
+        int nrecs, RecordColumn* column, RecordColumn* end, uint4 count)
+{
+    StringRef str;
+    for (int rec = 0; rec < nrecs; rec++) {
+        str.Ptr = (const char *)(ptr + rec*stride);
+        str.Length = GetFixedLenStringSize (ptr + rec*stride, 
+                column->FieldPtr->Dimension);
+        column->Strings.push_back(str);
+    }
+}
+
+/**
+ * Decoder of a data type, used by TableDataManager::compileDecodePlan().
+ * Strings have no fixed width, the width of a fixed length string is the
+ * dimension of its field.
+ */
+struct SampleDecoder {
+    int        Width;
+    SampleKind Kind;
+    DecodeFunc Decode;
+    DecodeBatchFunc DecodeBatch;
+    NumberFunc Number;
+};
+
+#define SAMPLE_DECODER(Sample) \
+    { Sample::Width, (SampleKind)Sample::Kind, decodeRun<Sample>, \
+      decodeRunBatch<Sample>, decodeNumber<Sample> }
+#define NO_DECODER { 0, SAMPLE_NONE, NULL, NULL, NULL }
+
+#endif
@@ -7,14 +7,20 @@
 #include <log4cpp/Category.hh>
 #include <getopt.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <math.h>
+#include <fstream>
+#include <iomanip>
 using namespace std;
 using namespace log4cpp;
 
 // TODO - Set vtime through configuration file 
 // TODO - Persist connection settings 
 
-PB5CollectionProcess :: PB5CollectionProcess() : IObuf__(8192, 512), 
-        optDebug__(false), optCleanAppCache__(false)
+PB5CollectionProcess :: PB5CollectionProcess() : IObuf__(16384, 2048), 
+        optDebug__(false), optCleanAppCache__(false), optSyncFiles__(false),
+        optTailSecs__(0)
 {
 }
 
@@ -45,7 +51,7 @@ void PB5CollectionProcess :: init(int argc, char* argv[])
 void PB5CollectionProcess :: parseCommandLineArgs(int argc, char* argv[])
     throw (exception)
 {
-    char optstring[] = "c:p:w:drvh";
+    char optstring[] = "c:p:w:f:u:g:st:drvh";
     string      configFilePath, workingPath, connectionString;
     int         cmd_opt;
     bool        optDisplayHelp = false;
@@ -70,6 +76,11 @@ void PB5CollectionProcess :: parseCommandLineArgs(int argc, char* argv[])
                        // TODO implement the clean app cache option
             case 'r' : optRedirectLog = true;     break;
             case 'w' : workingPath = optarg;     break;
+            case 'f' : optFetchFiles__.push_back(optarg); break;
+            case 'u' : optSendFiles__.push_back(optarg); break;
+            case 'g' : optGetValues__.push_back(optarg); break;
+            case 's' : optSyncFiles__ = true;    break;
+            case 't' : optTailSecs__ = atoi(optarg);  break;
             case 'h' : optDisplayHelp = true;  break;
             case 'v' : optDisplayVersion = true;  break;
             case '?' : throw invalid_argument("Invalid argument provided for initialization");
@@ -173,6 +184,7 @@ void PB5CollectionProcess :: configure() throw (AppException)
     bmp5ImplObj__.setPakBusAddr(pbAddr);
     bmp5ImplObj__.setIOBuf(&IObuf__);
     bmp5ImplObj__.setTableDataManager(&tblDataMgr__); 
+    bmp5ImplObj__.setBMP5Opt(appConfig__.getBMP5Opt());
 
     return;
 }
@@ -247,7 +259,24 @@ void PB5CollectionProcess :: run() throw (exception)
             Category::getInstance("InitSession")
                      .notice("Established PakBus session with datalogger at "
                           + dataSource__->getConnInfo());
-            collect();
+            if (optFetchFiles__.size()) {
+                fetchFiles();
+            }
+            else if (optSendFiles__.size()) {
+                sendFiles();
+            }
+            else if (optSyncFiles__) {
+                syncFiles();
+            }
+            else if (optGetValues__.size()) {
+                getValues();
+            }
+            else {
+                collect();
+                if (optTailSecs__ > 0) {
+                    tail();
+                }
+            }
             closeSession();
             break;
         } 
@@ -276,6 +305,7 @@ void PB5CollectionProcess :: run() throw (exception)
 void PB5CollectionProcess :: collect() throw (AppException)
 {
     bool recollect_tdf = false;
+    bool aborted = false;
     int numTables = appConfig__.getDataOutputConfig().Tables.size();
 
     if (0 == numTables) {
@@ -306,6 +336,7 @@ void PB5CollectionProcess :: collect() throw (AppException)
         catch (StorageException& ioe) {
             Category::getInstance("Collect")
                      .error("Aborting data collection process.");
+            aborted = true;
             break;
         }
         catch (InvalidTDFException& ite) {
@@ -325,6 +356,7 @@ void PB5CollectionProcess :: collect() throw (AppException)
             else {
                 Category::getInstance("Collect")
                          .error("Still receiving INVALID TDF error msg after reloading TDF");
+                aborted = true;
                 break;
             }
         }
@@ -340,6 +372,254 @@ void PB5CollectionProcess :: collect() throw (AppException)
             msgstrm.str("");
         }
     }
+
+    if (aborted) {
+        return;
+    }
+
+    // Older records skipped to catch up with the current data, and records
+    // that failed to be collected earlier, are collected once the current 
+    // data of all the tables is in.
+
+    for (int count = 0; count < numTables; count++) {
+        try {
+            bmp5ImplObj__.BackfillData(dataOpt.Tables[count]);
+            bmp5ImplObj__.RetryGaps(dataOpt.Tables[count]);
+        }
+        catch (invalid_argument& iae) {
+            continue;
+        }
+        catch (StorageException& ioe) {
+            Category::getInstance("Collect")
+                     .error("Aborting backfill process.");
+            break;
+        }
+        catch (AppException& e1) {
+            msgstrm << "Collection of older records failed for : ["
+                    << dataOpt.Tables[count].TableName << "] --> " 
+                    << e1.what();
+            Category::getInstance("Collect").error(msgstrm.str()); 
+            msgstrm.str("");
+        }
+    }
+}
+
+/**
+ * Poll the tables marked for tail mode for their latest record, until 
+ * optTailSecs__ seconds have passed. Each table is polled once per record
+ * interval (Table::TblTimeInterval), so that a record is stored within an
+ * interval of being written by the logger. Tables with a record interval 
+ * shorter than TAIL_MIN_POLL_SECS are polled at that rate instead.
+ */
+void PB5CollectionProcess :: tail() throw (AppException)
+{
+    const DataOutputConfig& dataOpt = appConfig__.getDataOutputConfig();
+    vector<const TableOpt*> tailTables;
+    vector<double> pollInterval, nextPoll;
+    struct timeval tv;
+
+    for (unsigned int count = 0; count < dataOpt.Tables.size(); count++) {
+        if (!dataOpt.Tables[count].Tail) {
+            continue;
+        }
+        try {
+            const Table& tbl = tblDataMgr__.getTableRef(
+                    dataOpt.Tables[count].TableName);
+            double interval = tbl.TblTimeInterval.sec + 
+                    tbl.TblTimeInterval.nsec/1E9;
+            tailTables.push_back(&dataOpt.Tables[count]);
+            pollInterval.push_back((interval < TAIL_MIN_POLL_SECS) ? 
+                    TAIL_MIN_POLL_SECS : interval);
+        }
+        catch (invalid_argument& iae) {
+            continue;
+        }
+    }
+
+    if (tailTables.empty()) {
+        Category::getInstance("Tail")
+                 .info("No tables listed for tail mode.");
+        return;
+    }
+
+    gettimeofday(&tv, NULL);
+    double now = tv.tv_sec + tv.tv_usec/1E6;
+    double endTime = now + optTailSecs__;
+    nextPoll.assign(tailTables.size(), now);
+
+    msgstrm << "Polling " << tailTables.size() << " table(s) for "
+            << optTailSecs__ << " seconds";
+    Category::getInstance("Tail").notice(msgstrm.str());
+    msgstrm.str("");
+
+    while (true) {
+        unsigned int idx = 0;
+        for (unsigned int count = 1; count < nextPoll.size(); count++) {
+            if (nextPoll[count] < nextPoll[idx]) {
+                idx = count;
+            }
+        }
+        if (nextPoll[idx] > endTime) {
+            break;
+        }
+
+        gettimeofday(&tv, NULL);
+        now = tv.tv_sec + tv.tv_usec/1E6;
+        if (nextPoll[idx] > now) {
+            usleep((useconds_t)((nextPoll[idx] - now)*1E6));
+        }
+
+        try {
+            int nrecs = bmp5ImplObj__.TailData(*tailTables[idx]);
+            if (nrecs > 0) {
+                msgstrm << "Collected " << nrecs << " record(s) from " 
+                        << tailTables[idx]->TableName;
+                Category::getInstance("Tail").debug(msgstrm.str());
+                msgstrm.str("");
+            }
+        }
+        catch (StorageException& ioe) {
+            Category::getInstance("Tail")
+                     .error("Aborting tail mode.");
+            break;
+        }
+        catch (CommException& ce) {
+            throw;
+        }
+        catch (AppException& e1) {
+            msgstrm << tailTables[idx]->TableName << " --> " << e1.what();
+            Category::getInstance("Tail").error(msgstrm.str());
+            msgstrm.str("");
+        }
+
+        // Skip the polls that are overdue rather than polling in a burst
+        gettimeofday(&tv, NULL);
+        now = tv.tv_sec + tv.tv_usec/1E6;
+        nextPoll[idx] += pollInterval[idx];
+        if (nextPoll[idx] < now) {
+            nextPoll[idx] = now + pollInterval[idx];
+        }
+    }
+}
+
+/**
+ * Fetch the files listed on the command line from the logger into the 
+ * working path, instead of collecting table data. The logger file names
+ * should include the device name (i.e. CRD:data.dat), which is dropped 
+ * from the name of the local copy.
+ */
+void PB5CollectionProcess :: fetchFiles() throw (AppException)
+{
+    const DataOutputConfig& dataOpt = appConfig__.getDataOutputConfig();
+
+    for (unsigned int count = 0; count < optFetchFiles__.size(); count++) {
+        const string& logger_file = optFetchFiles__[count];
+        string local_file = dataOpt.WorkingPath + "/" + 
+                logger_file.substr(logger_file.find(':') + 1);
+
+        cout << endl;
+        Category::getInstance("FetchFile")
+                 .notice("Fetching " + logger_file + " => " + local_file);
+
+        try {
+            if (bmp5ImplObj__.UploadFile(logger_file.c_str(), 
+                        local_file.c_str()) == FAILURE) {
+                Category::getInstance("FetchFile")
+                         .error("Failed to fetch : " + logger_file);
+            }
+        }
+        catch (IOException& ioe) {
+            Category::getInstance("FetchFile")
+                     .error("Aborting file transfers.");
+            break;
+        }
+    }
+}
+
+/**
+ * Send the host files listed on the command line to the CPU: drive of the
+ * logger (i.e. a new logger program), instead of collecting table data. 
+ * The name of a file on the logger is the base name of the host file.
+ */
+void PB5CollectionProcess :: sendFiles() throw (AppException)
+{
+    for (unsigned int count = 0; count < optSendFiles__.size(); count++) {
+        const string& host_file = optSendFiles__[count];
+
+        cout << endl;
+        Category::getInstance("SendFile")
+                 .notice("Sending " + host_file + " to the logger");
+
+        try {
+            if (bmp5ImplObj__.DownloadFile(host_file.c_str()) == FAILURE) {
+                Category::getInstance("SendFile")
+                         .error("Failed to send : " + host_file);
+            }
+        }
+        catch (IOException& ioe) {
+            Category::getInstance("SendFile")
+                     .error("Aborting file transfers.");
+            break;
+        }
+    }
+}
+
+/**
+ * Bring the host copies of the files on the logger card and user drive
+ * up to date, instead of collecting table data.
+ */
+void PB5CollectionProcess :: syncFiles() throw (AppException)
+{
+    vector<string> devices;
+    devices.push_back("CRD:");
+    devices.push_back("USR:");
+
+    cout << endl;
+    Category::getInstance("SyncFiles")
+             .notice("Synchronizing files on " + devices[0] + " and " + 
+                     devices[1]);
+
+    if (bmp5ImplObj__.SyncFiles(devices) == FAILURE) {
+        Category::getInstance("SyncFiles")
+                 .error("File synchronization was incomplete");
+    }
+}
+
+/**
+ * Read the variables listed on the command line from the logger and print
+ * their values, instead of collecting table data. The variables are named
+ * as Table.Field (i.e. Public.BattV), the Public table is assumed if the 
+ * table name is left out.
+ */
+void PB5CollectionProcess :: getValues() throw (AppException)
+{
+    vector<LoggerValue> values(optGetValues__.size());
+
+    for (unsigned int count = 0; count < optGetValues__.size(); count++) {
+        const string& name = optGetValues__[count];
+        size_t sep = name.find('.');
+        if (sep == string::npos) {
+            values[count].TableName = "Public";
+            values[count].FieldName = name;
+        }
+        else {
+            values[count].TableName = name.substr(0, sep);
+            values[count].FieldName = name.substr(sep + 1);
+        }
+    }
+
+    cout << endl;
+    if (bmp5ImplObj__.GetValues(values) == FAILURE) {
+        Category::getInstance("GetValues")
+                 .error("Failed to read some of the values");
+    }
+
+    for (unsigned int count = 0; count < values.size(); count++) {
+        if (values[count].RespCode == 0x00) {
+            cout << values[count].TableName << "." << values[count].FieldName
+                 << " = " << values[count].Values[0] << endl;
+        }
+    }
 }
 
 void PB5CollectionProcess :: onExit() throw ()
@@ -361,6 +641,18 @@ void PB5CollectionProcess :: printHelp() throw ()
     cout << "     -d Turn on debugging to print packet level errors       " << endl;
     // cout << "     -e Erase application cache                              " << endl;
     cout << "     -w Override the working path mentioned in config file   " << endl;
+    cout << "     -f Fetch a file from the logger (i.e. CRD:data.dat) into " << endl;
+    cout << "        the working path instead of collecting table data.   " << endl;
+    cout << "        May be repeated to fetch several files.              " << endl;
+    cout << "     -u Send a host file to the CPU: drive of the logger     " << endl;
+    cout << "        instead of collecting table data. May be repeated.   " << endl;
+    cout << "     -s Synchronize new or grown files on CRD: and USR: into  " << endl;
+    cout << "        the working path instead of collecting table data.   " << endl;
+    cout << "     -g Print the value of a variable (i.e. Public.BattV)    " << endl;
+    cout << "        instead of collecting table data. May be repeated.   " << endl;
+    cout << "     -t Stay connected for the given number of seconds after  " << endl;
+    cout << "        collecting data, polling the tables marked for tail  " << endl;
+    cout << "        mode for their latest record.                        " << endl;
     cout << "     -r Redirect log msgs to a file instead of stdout. The   " << endl;
     cout << "        logs will be stored in the <workingPath> directory   " << endl;
     cout << "     -h Print this help message                              " << endl;
@@ -377,6 +669,12 @@ void PB5CollectionProcess :: printVersion() throw ()
    return;
 }
 
+/**
+ * Function to check the offset of the logger clock, and set the clock if 
+ * it is off by more than MAX_TIME_OFFSET seconds. When a maximum interval 
+ * between checks is configured, the check is skipped while the clock drift 
+ * model predicts the offset to be within limits.
+ */
 void PB5CollectionProcess :: checkLoggerTime() throw (AppException)
 {
     if (loggerTimeCheckComplete__) {
@@ -384,10 +682,34 @@ void PB5CollectionProcess :: checkLoggerTime() throw (AppException)
     }
     stringstream msgstrm;
 
+    const DataOutputConfig& dataOpt = appConfig__.getDataOutputConfig();
+    string modelFile = dataOpt.WorkingPath + "/.working/clock";
+    int    maxInterval = appConfig__.getBMP5Opt().MaxClockCheckInterval;
+
+    ClockDriftModel driftModel;
+    driftModel.load(modelFile);
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    double now = tv.tv_sec + tv.tv_usec * 1e-6;
+
+    if ((maxInterval > 0) && !driftModel.isCheckDue(now, maxInterval)) {
+        double predictedOffset = driftModel.predictOffset(now);
+        msgstrm << "Skipping logger time check, predicted offset : " 
+                << predictedOffset << " seconds";
+        Category::getInstance("TimeCheck").info(msgstrm.str());
+        msgstrm.str("");
+
+        bmp5ImplObj__.setClockOffset((time_t)floor(predictedOffset + 0.5));
+        loggerTimeCheckComplete__ = true;
+        return;
+    }
+
     time_t logger_t = (time_t)bmp5ImplObj__.ClockTransaction (0, 0);
     if (!logger_t) {
         throw AppException(__FILE__, __LINE__, "Invalid logger time !");
     }
+    driftModel.addReading(bmp5ImplObj__.getClockReading());
 
     time_t host_t = time (NULL);
     time_t time_offset = host_t - logger_t;
@@ -403,7 +725,12 @@ void PB5CollectionProcess :: checkLoggerTime() throw (AppException)
 
         Category::getInstance("TimeCheck")
                  .notice(msgstrm.str());
-        logger_t = (time_t)bmp5ImplObj__.ClockTransaction (time_offset, 0);
+        // The clock is set by the round trip compensated offset, leaving 
+        // no whole second residue for the drift to add to
+        double offset = bmp5ImplObj__.getClockReading().Offset;
+        int    offset_s = (int)offset;
+        int    offset_ns = (int)((offset - offset_s) * 1e9);
+        logger_t = (time_t)bmp5ImplObj__.ClockTransaction (offset_s, offset_ns);
 
         if (logger_t) {
             Category::getInstance("TimeCheck")
@@ -414,9 +741,138 @@ void PB5CollectionProcess :: checkLoggerTime() throw (AppException)
         else {
             Category::getInstance("TimeCheck")
                      .notice("Successfully updated logger time.");
+            driftModel.adjust(offset_s + offset_ns * 1e-9);
         }
     }
+
+    driftModel.save(modelFile);
+    if (driftModel.hasDriftRate()) {
+        reportMetric("clock_drift_secs_per_day", dataOpt.StationName, 
+                driftModel.getDriftRate() * 86400);
+    }
+
     loggerTimeCheckComplete__ = true;
     return;
 }
 
+ClockDriftModel :: ClockDriftModel() : refTime__(0.0), refOffset__(0.0), 
+        refRoundTrip__(0.0), driftRate__(0.0), lastCheck__(0.0), 
+        numReadings__(0)
+{
+}
+
+/**
+ * Function to load the model saved by an earlier session. The model is 
+ * left empty if the file does not exist or is incomplete.
+ */
+void ClockDriftModel :: load(const string& path)
+{
+    ifstream modelFs(path.c_str());
+    string   header;
+
+    if (!modelFs.is_open()) {
+        return;
+    }
+    getline(modelFs, header);
+    modelFs >> refTime__ >> refOffset__ >> refRoundTrip__ >> driftRate__
+            >> lastCheck__ >> numReadings__;
+
+    if (!modelFs) {
+        *this = ClockDriftModel();
+    }
+}
+
+void ClockDriftModel :: save(const string& path) const
+{
+    ofstream modelFs(path.c_str(), ofstream::out);
+
+    if (!modelFs.is_open()) {
+        Category::getInstance("TimeCheck")
+                 .error("Failed to store clock drift model : " + path);
+        return;
+    }
+    modelFs << "# ReferenceTime, ReferenceOffset, ReferenceRoundTrip, DriftRate, LastCheckTime, Readings" << endl
+            << fixed << setprecision(6)
+            << refTime__ << " " << refOffset__ << " " << refRoundTrip__ << endl
+            << setprecision(12) << driftRate__ << endl
+            << setprecision(6) << lastCheck__ << endl
+            << numReadings__ << endl;
+    modelFs.close();
+}
+
+/**
+ * Function to update the drift rate with a new reading of the logger clock.
+ * Readings closer than MIN_DRIFT_INTERVAL to the reference reading, or 
+ * with a round trip long enough to exceed MAX_TIME_OFFSET, only count as a
+ * check.
+ */
+void ClockDriftModel :: addReading(const ClockReading& reading)
+{
+    double interval = reading.HostTime - refTime__;
+
+    lastCheck__ = reading.HostTime;
+    if (reading.RoundTrip > MAX_TIME_OFFSET) {
+        return;
+    }
+
+    // The host clock was stepped back, start over
+    if (interval < 0) {
+        numReadings__ = 0;
+    }
+
+    if (numReadings__ && (interval < MIN_DRIFT_INTERVAL)) {
+        return;
+    }
+
+    if (numReadings__) {
+        double rate = (reading.Offset - refOffset__) / interval;
+        int    weight = min(numReadings__, DRIFT_AVG_READINGS);
+        driftRate__ += (rate - driftRate__) / weight;
+    }
+    refTime__ = reading.HostTime;
+    refOffset__ = reading.Offset;
+    refRoundTrip__ = reading.RoundTrip;
+    numReadings__++;
+}
+
+/**
+ * Function to account for the logger clock being set.
+ * @param secs: Seconds added to the logger clock.
+ */
+void ClockDriftModel :: adjust(double secs)
+{
+    refOffset__ -= secs;
+}
+
+/**
+ * Function to determine if the logger clock should be checked. This is the
+ * case until the drift rate is known, once the maximum interval has passed
+ * since the last check, or when the predicted offset, allowing for the
+ * uncertainty of the reference reading and half the predicted drift, could 
+ * reach MAX_TIME_OFFSET.
+ *
+ * @param now: Current host time.
+ * @param maxInterval: Maximum interval (seconds) between two checks.
+ */
+bool ClockDriftModel :: isCheckDue(double now, int maxInterval) const
+{
+    if (!hasDriftRate() || (now < lastCheck__) || 
+            (now - lastCheck__ >= maxInterval)) {
+        return true;
+    }
+    double offset = predictOffset(now);
+    double margin = CLOCK_CHECK_MARGIN + refRoundTrip__ / 2 + 
+            fabs(offset - refOffset__) / 2;
+
+    return (fabs(offset) + margin >= MAX_TIME_OFFSET);
+}
+
+/**
+ * Function to predict the offset (host time less logger time) of the 
+ * logger clock at the given host time.
+ */
+double ClockDriftModel :: predictOffset(double now) const
+{
+    return refOffset__ + driftRate__ * (now - refTime__);
+}
+
@@ -15,6 +15,7 @@
 #ifndef PAKBUS5_PROTO_H
 #define PAKBUS5_PROTO_H
 
+#include <map>
 #include "pb5_buf.h"
 #include "pb5_data.h"
 
@@ -25,6 +26,7 @@ const byte  GET_LAST_REC   = 0x05;
 const byte  GET_DATA_RANGE = 0x06;
 const byte  INQ_REC_INFO   = 0x10;
 const byte  STORE_DATA     = 0x20;
+const byte  NEXT_REC_ONLY  = 0x40;
 
 uint2 CalcSigNullifier (uint2 sig);
 uint2 CalcSig (const void* buf, uint4 len, uint2 seed);
@@ -105,6 +107,8 @@ class PakBusMsg {
                     throw (CommException);
         byte  get_link_state (Packet& Pack);
 
+        byte  get_tran_nbr (Packet& Pack);
+
         int   parse_pakbus_header (Packet& pack, PktSummary& digest);
         void  reply_to_hello (PktSummary& digest, Packet& pack);
 
@@ -137,7 +141,7 @@ class PakBusMsg {
         /** Pointer to the buffer stream class designed for I/O */
         pakbuf* pbuf__;
         /** Packet queue to store packets read from the device */
-        deque<Packet>* packetQueue__;
+        PacketQueue*   packetQueue__;
 
     private :
         /** Output stream attached to the I/O buffer */
@@ -174,7 +178,47 @@ class PakCtrlObj : public PakBusMsg{
 struct RecordStat {
      int  count;
      NSec recordTime;
-     RecordStat() : count(-1) {}
+     uint4 recordNbr;
+     RecordStat() : count(-1), recordNbr(0) {}
+};
+
+// Status codes returned by RecordFragmentBuffer::addFragment()
+#define FRAG_ACCEPTED   0
+#define FRAG_DUPLICATE  1
+#define FRAG_OVERFLOW   2
+#define FRAG_STALE      3
+
+/**
+ * Reassembly buffer for a data record that is too large to fit in a single 
+ * PakBus packet. The logger returns such a record as a series of fragments,
+ * each tagged with its byte offset into the record. The byte extents received
+ * so far are tracked, so that fragments can be accepted in any order, 
+ * duplicates are ignored and fragments that would run past the end of the 
+ * buffer are rejected.
+ */
+class RecordFragmentBuffer {
+    public :
+        RecordFragmentBuffer ();
+        void  reset (uint4 record_nbr, int record_size, int capacity);
+        int   addFragment (uint4 record_nbr, uint4 offset, const byte* data,
+                      int len);
+        bool  isComplete () const;
+        uint4 getMissingOffset (uint4 from) const;
+        /** Record number of the record being reassembled */
+        uint4 getRecordNbr () const { return recordNbr__; }
+        /** Size of the largest fragment received for the record so far */
+        int   getFragmentSize () const { return fragSize__; }
+        /** Pointer to the beginning of the reassembled record */
+        byte* getData () { return &buf__[0]; }
+
+    private :
+        vector<byte>      buf__;
+        map<uint4, uint4> extents__;    // Begin offset -> end offset (exclusive)
+        uint4             recordNbr__;
+        int               recordSize__; // -1 for variable length records
+        int               recordEnd__;  // End of a variable length record, 
+                                        // -1 until the last fragment is seen
+        int               fragSize__;
 };
 
 /**
@@ -182,6 +226,122 @@ struct RecordStat {
  */
 #define BMP5_BUFLEN 8192
 
+// Number of requests that may be outstanding at a time when a transfer is
+// split over multiple packets
+#define DEFAULT_MAX_PENDING_REQUESTS 4
+#define MAX_FRAG_REQ_ATTEMPTS        3
+
+// Maximum number of single record requests used to locate the record to
+// resume collection from after the table ring has wrapped around
+#define MAX_RESUME_PROBES            40
+
+// Shortest interval between polls of a table in tail mode, in seconds
+#define TAIL_MIN_POLL_SECS           1.0
+
+// Largest number of values read or written in a single Get/Set Values 
+// transaction, as 4-byte floats following the response code
+#define MAX_VALUES_SWATH             ((MAX_MSG_BODY_LEN - 1)/4)
+
+// Rounds of Get/Set Values requests sent for values left without a response
+#define MAX_VALUES_ATTEMPTS          3
+
+// Data type used to exchange values in Get/Set Values transactions 
+// (4-byte IEEE floating point, MSB first)
+#define VALUES_DATA_TYPE             9
+
+// Allowance for the resolution of the logger clock offset while predicting 
+// the last record stored in a table, in seconds
+#define PREDICT_MARGIN_SECS          2
+
+// Suffix of the data files holding records collected by BackfillData
+#define BACKFILL_FILE_TAG            ".backfill"
+
+// Suffix of the data files holding records recovered by RetryGaps, and the
+// number of calls to RetryGaps after which a skipped record is given up on
+#define GAPFILL_FILE_TAG             ".gapfill"
+#define MAX_GAP_RETRIES              5
+
+// Largest message body that fits in a PakBus packet : 1010 (max. PakBus
+// packet) - 8 (PB Hdr) - 2 (Nullifier) - 2 (MsgType, TranNbr) = 998.
+#define MAX_MSG_BODY_LEN             998
+
+// Largest number of file bytes that fit in a single UploadFile response,
+// following the response code and file offset
+#define MAX_UPLOAD_SWATH             (MAX_MSG_BODY_LEN - 5)
+#define MAX_FILE_XFER_ATTEMPTS       3
+
+// Response code of a File Download Transaction refusing a chunk that does
+// not follow the data received by the logger
+#define FILE_XFER_BAD_OFFSET         0x09
+#define UPLOAD_PREALLOC_SIZE         262144
+
+/**
+ * Progress of a file transfer, persisted in the working directory so that 
+ * an interrupted transfer can be resumed in a later session.
+ */
+struct XferCheckpoint {
+    XferCheckpoint() : Offset(0), FileSize(0), Signature(0xaaaa) {}
+    string LoggerFile;
+    string HostFile;
+    uint4  Offset;     // Bytes confirmed from the beginning of the file
+    uint4  FileSize;   // Size of the file, 0 if not known yet
+    uint2  Signature;  // Signature of the confirmed bytes for uploads, of 
+                       // the complete source file for downloads
+    string LastUpdate; // Time of last update of the logger file, uploads
+};
+
+/**
+ * Entry in the directory listing of the logger file system.
+ */
+struct LoggerFileInfo {
+    LoggerFileInfo() : FileSize(0) {}
+    string FileName;   // Including the device (i.e. CRD:data.dat)
+    uint4  FileSize;
+    string LastUpdate;
+};
+
+/**
+ * Options that control how BMP5 transactions are carried out.
+ */
+struct BMP5Opt {
+    BMP5Opt() : MaxPendingRequests(DEFAULT_MAX_PENDING_REQUESTS), 
+            PredictLastRecord(false), MaxClockCheckInterval(0) {}
+    int   MaxPendingRequests;  // Requests outstanding at a time during
+                               // multi-packet transfers
+    bool  PredictLastRecord;   // Collect the record range predicted from 
+                               // the logger clock, without querying the 
+                               // last record first
+    int   MaxClockCheckInterval; // Longest time (seconds) between clock 
+                               // checks while the clock drift predicts the
+                               // offset within limits, 0 to always check
+};
+
+/**
+ * Reading of the logger clock, compensated for the round trip of the Clock
+ * transaction. Times are measured in seconds since 1970 on the host.
+ */
+struct ClockReading {
+    ClockReading() : HostTime(0.0), Offset(0.0), RoundTrip(0.0) {}
+    double HostTime;     // Host time the logger clock was read at
+    double Offset;       // Host time less logger time
+    double RoundTrip;    // Duration of the transaction
+};
+
+/**
+ * Variable on the logger read or written with the Get/Set Values 
+ * transactions. The values are exchanged as floating point numbers, the
+ * logger converts them from or to the type of the variable.
+ */
+struct LoggerValue {
+    LoggerValue() : Swath(1), RespCode(0xff) {}
+    string TableName;      // "Public" for the public variables
+    string FieldName;      // May include an array index, i.e. Temp(3)
+    uint2  Swath;          // Number of array elements from FieldName on
+    vector<float> Values;  // Values read, or to be written
+    byte   RespCode;       // Response code from the logger, 0xff if no 
+                           // response was received
+};
+
 class BMP5Obj : public PakBusMsg {
 
     public :
@@ -189,32 +349,79 @@ class BMP5Obj : public PakBusMsg {
         // BMP5Obj (PBAddr* pb_addr, pakbuf* IOBuf, string appl_dir);
 	~BMP5Obj ();
         void  setTableDataManager(TableDataManager* tblDataMgr);
+        void  setBMP5Opt(const BMP5Opt& bmp5Opt);
         void  getDataDefinitions() throw (IOException, ParseException);
         int   ClockTransaction (uint4 offset_s, uint4 offset_ns);
-        int   UploadFile (const char* get_file, char* write_to_file)
-                throw (IOException);
+        const ClockReading& getClockReading() const { return clockReading__; }
+        void  setClockOffset (time_t offset);
+        int   UploadFile (const char* get_file, const char* write_to_file,
+                const LoggerFileInfo* file_info = NULL) throw (IOException);
         int   DownloadFile (const char *filename);
         int   CollectData (const TableOpt& table_opt) 
                       throw (AppException, invalid_argument);
+        int   BackfillData (const TableOpt& table_opt) 
+                      throw (AppException, invalid_argument);
+        int   RetryGaps (const TableOpt& table_opt) 
+                      throw (AppException, invalid_argument);
+        int   TailData (const TableOpt& table_opt) 
+                      throw (AppException, invalid_argument);
 	int   ControlTable (byte ctrl_opt);
         int   ControlFile (const string& file_name, byte file_cmd);
+        int   SyncFiles (const vector<string>& devices) throw (IOException);
         int   ReloadTDF ();
+        int   GetValues (vector<LoggerValue>& values) throw (CommException);
+        int   SetValues (vector<LoggerValue>& values) throw (CommException);
+        int   GetValue (const string& table_name, const string& field_name,
+                      float& value) throw (CommException);
+        int   SetValue (const string& table_name, const string& field_name,
+                      float value) throw (CommException);
  
     protected :
-        void  GetProgStats (uint2 security_code) throw (ParseException);
+        void  GetProgStats (uint2 security_code) 
+                throw (IOException, ParseException);
         void  GetTDF () throw (IOException, ParseException);
         int   sendCollectionCmd (byte MessageType, Table& tbl, uint4 P1, uint4 P2);
         RecordStat get_records (Table& tbl_ref, byte mode, int record_size, 
                 uint4 P1, uint4 P2, int file_span);
+        int   get_record_fragments (Table& tbl_ref, 
+                RecordFragmentBuffer& frag_buf);
+        bool  probe_record (Table& tbl_ref, int record_size, uint4 rec_nbr,
+                NSec& rec_time);
+        uint4 find_resume_record (Table& tbl_ref, int record_size, 
+                uint4 last_rec_nbr, const NSec& last_rec_time, 
+                bool& contiguous);
         int   test_data_packet (Table& tbl_ref, Packet& pack) throw (AppException);
         int   store_data (byte* buf, Table& tbl, int beg, int nrecs, int file_span)
                 throw (StorageException);
-        int   process_upload_file (Packet& pack, ofstream& filedata) 
+        int   process_upload_file (Packet& pack, uint4& file_offset, 
+                byte*& file_data);
+        string get_checkpoint_path (const char* xfer_type, 
+                const string& logger_file);
+        bool  load_checkpoint (const string& path, XferCheckpoint& ckpt);
+        void  save_checkpoint (const string& path, const XferCheckpoint& ckpt);
+        int   file_signature (int fd, uint4 len, uint2& sig);
+        int   get_directory (vector<LoggerFileInfo>& entries) 
+                throw (IOException);
+        int   find_logger_file (const string& file_name, LoggerFileInfo& info)
                 throw (IOException);
+        void  load_sync_state (const string& path, 
+                map<string, LoggerFileInfo>& synced);
+        void  save_sync_state (const string& path, 
+                const map<string, LoggerFileInfo>& synced);
+        bool  predict_last_record (const Table& tbl_ref, 
+                const TableOpt& table_opt, int& last_rec_nbr);
+        int   find_pending_records (Table& tbl_ref, const TableOpt& table_opt,
+                int record_size, int& last_rec_nbr, bool& catch_up);
+        int   values_transaction (byte msg_type, vector<LoggerValue>& values)
+                throw (CommException);
+        int   build_values_msg (byte msg_type, const LoggerValue& value);
     
     private :
-        byte*     dataBuf__;
-        int       dataBufSize__;
+        map<int, RecordFragmentBuffer> fragBuffers__; // Keyed by table number
+        BMP5Opt   bmp5Opt__;
+        time_t    clockOffset__;       // Host time less logger time
+        bool      clockOffsetValid__;
+        ClockReading clockReading__;   // Last reading of the logger clock
         TableDataManager* tblDataMgr__;
 };
 
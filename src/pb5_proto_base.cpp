@@ -49,7 +49,8 @@ bool get_debug ()
  */
 uint2 CalcSig(const void *buf, uint4 len, uint2 seed)
 {
-  uint2 j, n;
+  uint2 j;
+  uint4 n;
   uint2 ret = seed;
   byte *ptr = (byte *)buf;
 
@@ -720,6 +721,22 @@ byte PakBusMsg :: get_link_state (Packet& Pack)
     return link_state;
 }
 
+/**
+ * Function to peek at the transaction number of a received packet before
+ * it is parsed. This is used to match a response against one of several
+ * outstanding requests.
+ *
+ * @param Pack: Reference to the received packet.
+ * @return Transaction number, zero if the packet is too short to carry one.
+ */
+byte PakBusMsg :: get_tran_nbr (Packet& Pack)
+{
+    if ((Pack.endPacket - Pack.begPacket) < 11) {
+        return 0;
+    }
+    return (byte)*(Pack.begPacket + 10);
+}
+
 /*
  The following functions are required for troubleshooting only. They aren't
  required by the applications running on production.
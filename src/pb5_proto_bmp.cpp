@@ -19,9 +19,19 @@
 #include <sstream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <math.h>
 #include <string>
+#include <algorithm>
+#include <set>
+#include <iterator>
 #include <log4cpp/Category.hh>
 #include "pb5.h"
 #include "utils.h"
@@ -35,18 +45,14 @@ using namespace log4cpp;
  * @param: Structure containing information about data directory, logger name,
  *         name of tables to collect and the station name.
  */
-BMP5Obj :: BMP5Obj () : PakBusMsg(), dataBufSize__(BMP5_BUFLEN), 
-        tblDataMgr__(NULL) 
+BMP5Obj :: BMP5Obj () : PakBusMsg(), 
+        clockOffset__(0), clockOffsetValid__(false), tblDataMgr__(NULL) 
 {
     HiProtoCode__ = 0x01;
-    dataBuf__ = new byte[dataBufSize__];
 }
 
 BMP5Obj :: ~BMP5Obj() 
 {
-    if (dataBuf__ != NULL) {
-        delete [] dataBuf__;
-    }
 }
 
 void BMP5Obj :: setTableDataManager(TableDataManager* tblDataMgr)
@@ -54,6 +60,18 @@ void BMP5Obj :: setTableDataManager(TableDataManager* tblDataMgr)
     tblDataMgr__ = tblDataMgr;
 }
 
+/**
+ * Set the options controlling BMP5 transactions, i.e. the number of requests
+ * that can be outstanding at a time during multi-packet exchanges.
+ */
+void BMP5Obj :: setBMP5Opt(const BMP5Opt& bmp5Opt)
+{
+    bmp5Opt__ = bmp5Opt;
+    if (bmp5Opt__.MaxPendingRequests < 1) {
+        bmp5Opt__.MaxPendingRequests = 1;
+    }
+}
+
 /**
  * Function to check or adjust the time of a PakBus device.
  * A nonzero value for the seconds and nanoseconds arguments will add them 
@@ -88,6 +106,9 @@ BMP5Obj :: ClockTransaction (uint4 secs, uint4 nsecs)
     PBSerialize (MsgBody__ + 6, nsecs, 4);
     byte tran_id = GenTranNbr();
 
+    struct timeval send_time;
+    gettimeofday(&send_time, NULL);
+
     try {
         SendPBPacket();
         pbuf__->readFromDevice();
@@ -111,11 +132,27 @@ BMP5Obj :: ClockTransaction (uint4 secs, uint4 nsecs)
                 // return datalogger time
                 old_time = PBDeserialize ((byte *)pack.begPacket + 12, 4);
                 ret_value = old_time + SECS_BEFORE_1990;
+                clockOffset__ = time(NULL) - ret_value;
+                clockOffsetValid__ = true;
+
+                // The logger time is read half way through the round trip
+                const struct timeval& recv_time = pbuf__->getFirstReadTime();
+                double send_t = send_time.tv_sec + send_time.tv_usec * 1e-6;
+                double recv_t = recv_time.tv_sec + recv_time.tv_usec * 1e-6;
+                uint4  old_nsec = PBDeserialize ((byte *)pack.begPacket + 16, 4);
+
+                clockReading__.HostTime  = (send_t + recv_t) / 2;
+                clockReading__.RoundTrip = recv_t - send_t;
+                clockReading__.Offset    = clockReading__.HostTime - 
+                        (ret_value + old_nsec * 1e-9);
             }
             else {
                 // If the transaction was to update datalogger time
                 // return response code
                 ret_value = *(pack.begPacket + 11) ? 1 : 0;
+                if (0 == ret_value) {
+                    clockOffset__ -= (int)secs;
+                }
             }
         }
         packetQueue__->pop_front ();
@@ -123,6 +160,19 @@ BMP5Obj :: ClockTransaction (uint4 secs, uint4 nsecs)
     return ret_value;
 }
 
+/**
+ * Function to set the offset of the logger clock when it was not read 
+ * during the session, e.g. when it is predicted from the clock drift. 
+ * The offset is used to predict the last record of the tables.
+ *
+ * @param offset: Host time less logger time, in seconds.
+ */
+void
+BMP5Obj :: setClockOffset (time_t offset)
+{
+    clockOffset__ = offset;
+    clockOffsetValid__ = true;
+}
 
 /**
  * Function to collect the table definitions file stored on the data logger.
@@ -130,21 +180,30 @@ BMP5Obj :: ClockTransaction (uint4 secs, uint4 nsecs)
  * and build the table definitions from it. If not found, it'll fetch
  * the table definitions file from the logger. Also an XML file called tdf.xml
  * will be created in the <DATA_DIR>/conf directory.
+ * The programming statistics saved by the last session are reused along 
+ * with the cached definitions. A program change on the logger is detected 
+ * by the invalid TDF response to the collection, which reloads both.
+ * Definitions found in the working directory are parsed only once, and 
+ * only the programming statistics are fetched if they were not cached.
  *
  * @return Throws AppException on failure.
  */
 void 
 BMP5Obj :: getDataDefinitions() throw (IOException, ParseException)
 {
-    this->GetTDF();
-    this->GetProgStats((uint2)0);
+    bool tdf_loaded = (tblDataMgr__->BuildTDF() == SUCCESS);
 
-    int maxRecordSize = tblDataMgr__->getMaxRecordSize();
-    if (maxRecordSize > dataBufSize__) {
-        delete [] dataBuf__;
-        dataBufSize__ = maxRecordSize;
-        dataBuf__ = new byte[dataBufSize__];
+    if (tdf_loaded && (tblDataMgr__->loadSessionCache() == SUCCESS)) {
+        Category::getInstance("BMP5")
+                 .info("Using table definitions cached for program " + 
+                         tblDataMgr__->getProgStats().ProgName);
+        return;
+    }
+    if (!tdf_loaded) {
+        this->GetTDF();
     }
+    this->GetProgStats((uint2)0);
+    tblDataMgr__->saveSessionCache();
     return;
 }
 
@@ -163,7 +222,7 @@ BMP5Obj :: GetTDF () throw (IOException, ParseException)
         Category::getInstance("BMP5")
                 .info("Uploading table definitions file from the logger ...");
 
-        if (UploadFile(".TDF", (char *)tdf_file_tmp.c_str()) == FAILURE) {
+        if (UploadFile(".TDF", tdf_file_tmp.c_str()) == FAILURE) {
             throw ParseException(__FILE__, __LINE__,
                     "TDF parsing failed due to failure in uploading file");
         }
@@ -188,16 +247,67 @@ BMP5Obj :: GetTDF () throw (IOException, ParseException)
     return;
 }
 
+/**
+ * Function to fetch the table definitions file again from the logger after
+ * the logger reported an invalid table definition, e.g. when the program 
+ * running on the logger was changed. Only the tables whose definition 
+ * changed are reset, see TableDataManager::ReloadTDF(). The current
+ * definitions file is put back if the new one fails to parse.
+ *
+ * @return SUCCESS | FAILURE
+ */
 int 
 BMP5Obj :: ReloadTDF () 
 {
-    tblDataMgr__->cleanCache();
+    string tdf_file = tblDataMgr__->getDataOutputConfig().WorkingPath;
+    tdf_file += "/.working/tdf.dat";
+
+    string tdf_file_tmp = tdf_file;
+    tdf_file_tmp += ".tmp";
+    string tdf_file_old = tdf_file;
+    tdf_file_old += ".old";
+
     Category::getInstance("BMP5")
             .info("Recollecting table definitions file from data logger");
 
     try {
-        this->GetTDF();
-    } catch (AppException e) {
+        // The current definitions stay in use if the upload fails
+        if (UploadFile(".TDF", tdf_file_tmp.c_str()) == FAILURE) {
+            Category::getInstance("BMP5")
+                     .error("Failed to upload table definitions file");
+            unlink(tdf_file_tmp.c_str());
+            return FAILURE;
+        }
+
+        rename(tdf_file.c_str(), tdf_file_old.c_str());
+        if (rename(tdf_file_tmp.c_str(), tdf_file.c_str()) != 0) {
+            Category::getInstance("BMP5")
+                     .error("Failed to rename temporary file to : " + tdf_file);
+            unlink(tdf_file_tmp.c_str());
+            rename(tdf_file_old.c_str(), tdf_file.c_str());
+            return FAILURE;
+        }
+
+        if (tblDataMgr__->ReloadTDF() == FAILURE) {
+            Category::getInstance("BMP5")
+                     .error("Failed to parse TDF file following download from logger");
+            rename(tdf_file_old.c_str(), tdf_file.c_str());
+            return FAILURE;
+        }
+        unlink(tdf_file_old.c_str());
+
+        // The programming statistics are refreshed with the new 
+        // definitions. They are left unknown if the transaction fails, the
+        // session cache having been dropped with the old definitions.
+        try {
+            GetProgStats((uint2)0);
+            tblDataMgr__->saveSessionCache();
+        } catch (AppException& e) {
+            Category::getInstance("BMP5")
+                     .warn(string("Failed to refresh programming statistics : ")
+                             + e.what());
+        }
+    } catch (AppException& e) {
         Category::getInstance("BMP5").error(e.what());
         return FAILURE;
     }
@@ -206,129 +316,344 @@ BMP5Obj :: ReloadTDF ()
 
 /**
  * Function to download a file to the data logger from host.
+ * The file is memory mapped and sent in chunks of the largest size that 
+ * fits in a PakBus packet. Up to MaxPendingRequests chunks are kept in 
+ * flight, and the acknowledgements are matched to the chunks using the 
+ * file offset in the response. Chunks that were not acknowledged are sent 
+ * again with the next window. The logger refuses a chunk that does not 
+ * follow the data it received, so once a chunk is lost the chunks in 
+ * flight are dropped and sending restarts from the first chunk that was 
+ * not acknowledged, alone until it is acknowledged. The last chunk carries
+ * the close flag and is sent only after all the others were acknowledged.
+ * The offset up to which all chunks were acknowledged is checkpointed in
+ * the working directory along with the size and signature of the file, 
+ * and a later transfer of the unchanged file resumes from there. 
  * @param filename: Name of file to download to the logger.
  * @return SUCCESS | FAILURE
  */
 int 
 BMP5Obj :: DownloadFile (const char *filename)
 {
-    char     buf[400];
-    int      buf_size = 400;
-    ifstream ifs (filename);
     // Assuming that the file will be downloaded to the CPU:
     // directory on the data logger
     string   store_file("CPU:");
-    int      file_offset = 0;
-    int      nread = 0;
-    byte     close_flag = 0;
-    byte     resp_code = 0;
-    byte     tran_id;
-    uint4    resp_offset = 0;
-    int      stat = 0;
-
-    store_file += filename;
+    const char* base_name = strrchr (filename, '/');
+    int      stat = SUCCESS, pack_stat;
+    int      num_attempts = 0;
+    int      window = bmp5Opt__.MaxPendingRequests;
+    uint4    next_offset = 0;
+    uint4    resume_offset = 0;
+    bool     closed = false;
+    byte*    file_data = NULL;
+    struct stat file_stat;
+    set<uint4>    lost;                // Chunks to send again
+    set<uint4>    pending;             // Offsets of chunks in flight
+    set<uint4>    acked;               // Acknowledged beyond the checkpoint
+    set<byte>     tran_ids;
+    vector<uint4> request;
+    XferCheckpoint ckpt, saved_ckpt;
+    stringstream  msgstrm;
+
+    store_file += (base_name != NULL) ? (base_name + 1) : filename;
     int      len = store_file.size();
 
+    // Including the null-character at the end of the string, the message
+    // body holds 9 bytes besides the file name and the file data
+    if (len + 9 >= MAX_MSG_BODY_LEN) {
+        Category::getInstance("BMP5")
+                 .error("File name too long to download : " + store_file);
+        return FAILURE;
+    }
+    uint4    chunk_size = MAX_MSG_BODY_LEN - 9 - len;
+
+    int fd = open (filename, O_RDONLY);
+    if ((fd < 0) || fstat (fd, &file_stat)) {
+        Category::getInstance("BMP5")
+                 .error(string("Failed to open : ") + filename);
+        if (fd >= 0) {
+            close (fd);
+        }
+        return FAILURE;
+    }
+    uint4 file_size = file_stat.st_size;
+
+    if (file_size) {
+        file_data = (byte *)mmap (NULL, file_size, PROT_READ, MAP_PRIVATE, 
+                fd, 0);
+        if (file_data == (byte *)MAP_FAILED) {
+            Category::getInstance("BMP5")
+                     .error(string("Failed to map : ") + filename);
+            close (fd);
+            return FAILURE;
+        }
+    }
+
+    // Offset of the last chunk, which closes the file on the logger
+    uint4 last_offset = file_size ? 
+            ((file_size - 1) / chunk_size) * chunk_size : 0;
+
+    ckpt.LoggerFile = store_file;
+    ckpt.HostFile   = filename;
+    ckpt.FileSize   = file_size;
+    ckpt.Signature  = CalcSig (file_data, file_size, 0xaaaa);
+
+    string ckpt_path = get_checkpoint_path ("download", store_file);
+
+    if (load_checkpoint (ckpt_path, saved_ckpt) &&
+            (saved_ckpt.LoggerFile == ckpt.LoggerFile) &&
+            (saved_ckpt.HostFile == ckpt.HostFile) &&
+            (saved_ckpt.FileSize == ckpt.FileSize) &&
+            (saved_ckpt.Signature == ckpt.Signature) &&
+            (saved_ckpt.Offset <= last_offset) &&
+            ((saved_ckpt.Offset % chunk_size) == 0)) {
+        resume_offset = saved_ckpt.Offset;
+        msgstrm << "Resuming download of " << store_file << " at offset " 
+                << resume_offset;
+        Category::getInstance("BMP5").info(msgstrm.str());
+        msgstrm.str("");
+    }
+    ckpt.Offset = next_offset = resume_offset;
+
     MsgType__ = 0x1c;
-    // Including the null-character at the end of the string
-    MsgBodyLen__ = buf_size + 9 + len;
+    Priority__ = 0x02;
 
     SetSecurityCodeInMsgBody();
     memcpy (MsgBody__+2, store_file.c_str(), len + 1);
     MsgBody__[len+3] = 0x00;
-    tran_id = GenTranNbr();
-
-    while (!ifs.eof()) {
-        // Checking the stat variable is important because that
-        // gets set when the previous command packet wasn't sent
-        // successfully. If it is set, the same packet gets sent. 
-
-        if (!stat) {
-	    ifs.read (buf, buf_size);
-	    nread = ifs.gcount(); 
-            // Assuming read() reached end of file
-	    if (nread < buf_size) {
-	        close_flag = 0x01;
-                MsgBodyLen__ = len + 9 + nread;
+
+    try {
+        while ((stat == SUCCESS) && !closed) {
+
+            request.clear();
+            while (lost.size() && ((int)request.size() < window)) {
+                request.push_back(*lost.begin());
+                lost.erase(lost.begin());
             }
-	    else {
-	        close_flag = 0x00;
+            while (((int)request.size() < window) && 
+                    (next_offset < last_offset)) {
+                request.push_back(next_offset);
+                next_offset += chunk_size;
+            }
+            if (request.empty()) {
+                request.push_back(last_offset);
             }
-        }
 
-        MsgBody__[len+4] = close_flag;
-        PBSerialize (MsgBody__+len+5, (uint4)file_offset, 4);
-        memcpy (MsgBody__+len+9, buf, nread);
+            if (num_attempts == MAX_FILE_XFER_ATTEMPTS) {
+                msgstrm << "No acknowledgement received for file offset " 
+                        << request[0] << " of " << store_file;
+                Category::getInstance("BMP5").warn(msgstrm.str());
+                stat = FAILURE;
+                break;
+            }
 
-        try {
-            SendPBPacket();
+            pending.clear();
+            tran_ids.clear();
+            for (unsigned int count = 0; count < request.size(); count++) {
+                uint4 offset = request[count];
+                uint4 nbytes = min(chunk_size, file_size - offset);
+
+                MsgBody__[len+4] = (offset == last_offset) ? 0x01 : 0x00;
+                PBSerialize (MsgBody__+len+5, offset, 4);
+                if (nbytes) {
+                    memcpy (MsgBody__+len+9, file_data + offset, nbytes);
+                }
+                MsgBodyLen__ = len + 9 + nbytes;
+
+                tran_ids.insert(GenTranNbr());
+                SendPBPacket();
+                pending.insert(offset);
+            }
             pbuf__->readFromDevice();
-        } 
-        catch (CommException& ce) {
-            Category::getInstance("BMP5")
-                     .error("Communication error during File Download Transaction");
-            throw;
-        }
 
-        while (packetQueue__->size()) {
-            Packet pack = packetQueue__->front();
-            stat = ParsePakBusPacket (pack, 0x9c, tran_id);
+            bool progress = false;
+            bool restart  = false;
+            bool resync   = false;
+
+            while (packetQueue__->size()) {
+                Packet pack = packetQueue__->front();
+                byte   tran_id = tran_ids.count(get_tran_nbr(pack)) ?
+                        get_tran_nbr(pack) : TranNbr__;
+
+                if ((pack_stat = ParsePakBusPacket (pack, 0x9c, tran_id))) {
+                    PacketErr ("File Download Transaction", pack, pack_stat);
+                    packetQueue__->pop_front ();
+                    continue;
+                }
+
+                byte  resp_code   = (byte)*(pack.begPacket+11);
+                uint4 resp_offset = PBDeserialize ((byte *)(pack.begPacket+12), 4);
+                packetQueue__->pop_front ();
+
+                if (resp_code && resume_offset) {
+                    // The logger would not continue the partial file, 
+                    // start the transfer over
+                    msgstrm << "Logger refused to resume " << store_file 
+                            << " at offset " << resume_offset 
+                            << ", restarting from the beginning";
+                    Category::getInstance("BMP5").notice(msgstrm.str());
+                    msgstrm.str("");
+                    restart = true;
+                    break;
+                }
+                if (resp_code == FILE_XFER_BAD_OFFSET) {
+                    // A chunk was lost, the logger refuses the chunks 
+                    // that follow it
+                    pending.erase(resp_offset);
+                    resync = true;
+                    continue;
+                }
+                if (resp_code) {
+                    msgstrm << "File Download Transaction for " << store_file
+                            << " failed at offset " << resp_offset 
+                            << ", response code : " << (int)resp_code;
+                    Category::getInstance("BMP5").error(msgstrm.str());
+                    stat = FAILURE;
+                    break;
+                }
+                if (pending.erase(resp_offset)) {
+                    progress = true;
+                    resume_offset = 0;
+                    if (resp_offset == last_offset) {
+                        closed = true;
+                    }
+                    acked.insert(resp_offset);
+                }
+            }
 
-            if (stat) {
-                PacketErr ("File Download Transaction", pack, stat);
+            if (restart) {
+                packetQueue__->clear();
+                lost.clear();
+                acked.clear();
+                resume_offset = next_offset = ckpt.Offset = 0;
+                num_attempts = 0;
+                continue;
             }
-            else {
-		        resp_code = (byte)*(pack.begPacket+11);
-                resp_offset = PBDeserialize ((byte *)(pack.begPacket+12), 4);
+
+            // Advance the checkpoint over the chunks acknowledged in order
+            uint4 prev_offset = ckpt.Offset;
+            while (acked.size() && (*acked.begin() == ckpt.Offset)) {
+                acked.erase(acked.begin());
+                ckpt.Offset += chunk_size;
+            }
+            if ((ckpt.Offset != prev_offset) && !closed) {
+                save_checkpoint (ckpt_path, ckpt);
             }
-            packetQueue__->pop_front ();
-        }
 
-        if (!stat) {
-            if (resp_code || (resp_offset != (uint4)file_offset)) {
-	        return resp_code;
+            if (resync && !closed) {
+                msgstrm << "Logger refused out of order chunks of " 
+                        << store_file << ", resending from offset " 
+                        << ckpt.Offset;
+                Category::getInstance("BMP5").notice(msgstrm.str());
+                msgstrm.str("");
+                packetQueue__->clear();
+                pending.clear();
+                lost.clear();
+                acked.clear();
+                next_offset = ckpt.Offset;
+                window = 1;
             }
-	    file_offset += nread;
+            else if (progress) {
+                window = bmp5Opt__.MaxPendingRequests;
+            }
+
+            lost.insert(pending.begin(), pending.end());
+            num_attempts = progress ? 0 : (num_attempts + 1);
+        }
+    } 
+    catch (CommException& ce) {
+        Category::getInstance("BMP5")
+                 .error("Communication error during File Download Transaction");
+        if (file_data) {
+            munmap (file_data, file_size);
         }
+        close (fd);
+        throw;
     }
-    return SUCCESS;
+
+    if (file_data) {
+        munmap (file_data, file_size);
+    }
+    close (fd);
+
+    if (stat == SUCCESS) {
+        unlink (ckpt_path.c_str());
+    }
+    return stat;
 }
 
 /**
  * Function to upload a file from the data logger to the host. The
  * function requires the name of the file to download and the complete
  * path for the output file for writing out downloaded data.
+ * Up to MaxPendingRequests requests for consecutive file offsets are kept
+ * outstanding at a time. The responses are matched to the requests using 
+ * the transaction number and written at their offset in the output file, 
+ * which is preallocated ahead of the data, so they may arrive in any order. 
+ * Offsets that were not answered are requested again immediately along
+ * with the next window. The end of the file is recognized from a response 
+ * carrying less data than requested.
+ * The number of bytes received in order from the beginning of the file is
+ * checkpointed in the working directory along with their signature and the
+ * size and time of last update listed for the file by the logger. If the
+ * transfer fails, the partial file is kept and a later transfer of the
+ * same file resumes from the checkpoint, once the logger lists the file
+ * with the same size and time of update, the partial file is found intact
+ * and the last block before the checkpoint reads back the same from the
+ * logger. Otherwise the transfer starts over. The files generated by the
+ * logger on request (.TDF, .DIR) and the files missing from the directory
+ * listing of the logger are never checkpointed.
  * @param get_file: File to upload from logger to host. This should
- *                  include the complete pathname (i.e. CPU:Def.TDF 
+ *                  include the complete pathname (i.e. CPU:Def.TDF
  *                  instead of Def.TDF.
- * @param write_to_file: Complete path of the destination filename on 
+ * @param write_to_file: Complete path of the destination filename on
  *                  host.
+ * @param file_info: Directory entry of the file if already known, it is
+ *                  looked up in the directory listing otherwise.
  * @return SUCCESS | FAILURE
- */ 
-int 
-BMP5Obj :: UploadFile (const char *get_file, char *write_to_file) throw (IOException)
+ */
+int
+BMP5Obj :: UploadFile (const char *get_file, const char *write_to_file,
+        const LoggerFileInfo* file_info) throw (IOException)
 {
-    int      len, stat = FAILURE;
-    uint4    file_offset = 0;
-    uint4    file_datalen = 0;
+    int      len, pack_stat, stat = SUCCESS;
+    int      num_attempts = 0;
+    int      window = bmp5Opt__.MaxPendingRequests;
+    uint4    next_offset = 0;          // Next new offset to request
+    uint4    eof_offset  = 0xffffffff; // File size, once the end is seen
+    uint4    err_offset  = 0xffffffff; // Lowest offset refused by the logger
+    uint4    verify_offset = 0xffffffff; // Block read back when resuming
+    uint4    alloc_size  = 0;          // Size preallocated for the output
+    uint4    nbytes      = 0;
+    uint2    Swath = MAX_UPLOAD_SWATH;
     Packet   pack;
-    ofstream TDFdata;
-    bool     ioException = false;
-    
-    // Maximum number of bytes that can be packed in a PakBus message
-    // with exceeding 1010 bytes. Actually it would be 1010 -8 (PB Hdr)
-    // - 2 (Nullifier) - 7 (bytes from the response MsgBody) = 993.
-    // I'm rounding off to 985.
-    
+    set<uint4>       lost;             // Offsets to request again
+    vector<uint4>    request;
+    map<byte, uint4> pending;          // Transaction number -> file offset
+    map<byte, uint4>::iterator pending_itr;
+    map<uint4, uint4> received;        // Offset -> length, for the blocks
+                                       // received beyond the checkpoint
+    byte     block[MAX_UPLOAD_SWATH];
+    XferCheckpoint ckpt, saved_ckpt;
+    LoggerFileInfo entry;
+    string   comm_error;
+    stringstream msgstrm;
+    time_t   start_t = time(NULL);
+    bool     keep_ckpt = strcmp (get_file, ".TDF") && strcmp (get_file, ".DIR");
+
+    // The directory listing is uploaded through here as well, so the file
+    // is looked up before the request is built
+
+    if (keep_ckpt) {
+        if (file_info != NULL) {
+            entry = *file_info;
+        }
+        else if (find_logger_file (get_file, entry) == FAILURE) {
+            keep_ckpt = false;
+        }
+    }
+
     Priority__ = 0x02;
     MsgType__  = 0x1d;
-    // uint2 Swath = 0x0158;
-    uint2 Swath = 0x03d9;
-    byte  tran_id =  GenTranNbr();
-
-    // Keep the file open for possible exchanges, the logger will close
-    // the file automatically is complete file is read
-    byte  CloseFlag = 0x00;
 
     SetSecurityCodeInMsgBody();
 
@@ -336,18 +661,20 @@ BMP5Obj :: UploadFile (const char *get_file, char *write_to_file) throw (IOExcep
     memcpy (MsgBody__+2, get_file, len);
     MsgBody__[len+2] = 0x00;
 
-    MsgBody__[len+3] = CloseFlag;
+    // Keep the file open for possible exchanges, the logger will close
+    // the file automatically is complete file is read
+    MsgBody__[len+3] = 0x00;
 
-    // Byte offset into the file is set within the loop below
+    // Byte offset into the file is set for each request below
 
     MsgBody__[len+8] = (byte)(Swath >> 8);
     MsgBody__[len+9] = (byte)(Swath & 0xff);
 
     MsgBodyLen__ = len+10;
 
-    TDFdata.open (write_to_file, ofstream::binary | ofstream::out);
+    int fd = open (write_to_file, O_RDWR | O_CREAT, 0644);
     
-    if (TDFdata.is_open() == false) {
+    if (fd < 0) {
         string err("Failed to open : ");
         err.append(write_to_file);
         Category::getInstance("BMP5")
@@ -355,164 +682,692 @@ BMP5Obj :: UploadFile (const char *get_file, char *write_to_file) throw (IOExcep
         throw IOException(__FILE__, __LINE__, err.c_str());
     }
 
-    while (1) {
-        PBSerialize (MsgBody__+len+4, (uint4)file_offset, 4);
+    ckpt.LoggerFile = get_file;
+    ckpt.HostFile   = write_to_file;
+    ckpt.FileSize   = entry.FileSize;
+    ckpt.LastUpdate = entry.LastUpdate;
+    string ckpt_path = get_checkpoint_path ("upload", get_file);
+
+    if (keep_ckpt && load_checkpoint (ckpt_path, saved_ckpt) &&
+            (saved_ckpt.LoggerFile == ckpt.LoggerFile) &&
+            (saved_ckpt.HostFile == ckpt.HostFile) &&
+            (saved_ckpt.FileSize == ckpt.FileSize) &&
+            (saved_ckpt.LastUpdate == ckpt.LastUpdate) &&
+            (saved_ckpt.Offset <= ckpt.FileSize) &&
+            (saved_ckpt.Offset >= Swath) &&
+            ((saved_ckpt.Offset % Swath) == 0) &&
+            (file_signature (fd, saved_ckpt.Offset, ckpt.Signature) == 
+                    SUCCESS) &&
+            (ckpt.Signature == saved_ckpt.Signature)) {
+        ckpt.Offset = saved_ckpt.Offset;
+        verify_offset = next_offset = ckpt.Offset - Swath;
+        msgstrm << "Resuming upload of " << get_file << " at offset " 
+                << ckpt.Offset;
+        Category::getInstance("BMP5").info(msgstrm.str());
+        msgstrm.str("");
+    }
+    else {
+        ckpt.Offset    = 0;
+        ckpt.Signature = 0xaaaa;
+        if (ftruncate (fd, 0)) {
+            stat = FAILURE;
+        }
+    }
+
+    while (stat == SUCCESS) {
+
+        // Offsets lost in the previous exchange go out first, followed by 
+        // new offsets up to the window size.
+
+        request.clear();
+        while (lost.size() && ((int)request.size() < window)) {
+            request.push_back(*lost.begin());
+            lost.erase(lost.begin());
+        }
+        while (((int)request.size() < window) && 
+                (next_offset < min(eof_offset, err_offset))) {
+            request.push_back(next_offset);
+            next_offset += Swath;
+        }
+        if (request.empty()) {
+            break;
+        }
 
+        if (num_attempts == MAX_FILE_XFER_ATTEMPTS) {
+            msgstrm << "No response received for file offset " << request[0]
+                    << " of " << get_file;
+            Category::getInstance("BMP5").warn(msgstrm.str());
+            stat = FAILURE;
+            break;
+        }
+
+        pending.clear();
         try {
-            SendPBPacket();
+            for (unsigned int count = 0; count < request.size(); count++) {
+                byte tran_id = GenTranNbr();
+                PBSerialize (MsgBody__+len+4, request[count], 4);
+                SendPBPacket();
+                pending[tran_id] = request[count];
+            }
             pbuf__->readFromDevice();
         }
         catch (CommException& ce) {
             Category::getInstance("BMP5")
                      .error("Communication error during File Upload Transaction");
-            throw;
-        }
-
-        if (!packetQueue__->size()) {
-            Category::getInstance("BMP5")
-                    .warn("No data was found to read.");
+            comm_error = ce.what();
+            stat = FAILURE;
             break;
         }
 
-        // There will be zero or one packets containing response
-        // to Uploadfile command and some hello packets
+        bool progress = false;
+        bool restart  = false;
 
         while (packetQueue__->size()) {
             pack = packetQueue__->front();
-            stat = ParsePakBusPacket (pack, 0x9d, tran_id);
-            if (stat) {
-                PacketErr ("File Upload Transaction", pack, stat);
+            pending_itr = pending.find(get_tran_nbr(pack));
+            byte tran_id = (pending_itr != pending.end()) ? 
+                    pending_itr->first : TranNbr__;
+
+            if ((pack_stat = ParsePakBusPacket (pack, 0x9d, tran_id)) ||
+                    (pending_itr == pending.end())) {
+                PacketErr ("File Upload Transaction", pack, pack_stat);
+                packetQueue__->pop_front ();
+                if (pack_stat == DELIVERY_FAILURE) {
+                    stat = FAILURE;
+                }
+                continue;
             }
-            else {
-                try {
-                    file_datalen = process_upload_file (pack, TDFdata);
-                } 
-                catch (IOException& ioe) {
-                    string err("I/O error occurred while writing to : ");
-                    err.append(write_to_file);
-                    Category::getInstance("BMP5").warn(err);
-                    ioException = true;
+
+            uint4 file_offset;
+            byte* file_data;
+            int   file_datalen = process_upload_file (pack, file_offset, 
+                    file_data);
+
+            if ((file_datalen >= 0) && (file_offset == verify_offset)) {
+                // Compare the block read back from the logger with the
+                // partial file to make sure the logger file is unchanged
+                verify_offset = 0xffffffff;
+                if ((file_datalen != Swath) || 
+                        (pread (fd, block, Swath, file_offset) != Swath) ||
+                        memcmp (block, file_data, Swath)) {
+                    msgstrm << get_file << " has changed on the logger, "
+                            << "restarting upload from the beginning";
+                    Category::getInstance("BMP5").notice(msgstrm.str());
+                    msgstrm.str("");
+                    restart = true;
                     break;
                 }
-                file_offset += file_datalen;
             }
+
+            if (file_datalen < 0) {
+                err_offset = min(err_offset, pending_itr->second);
+            }
+            else {
+                if (file_datalen < Swath) {
+                    eof_offset = min(eof_offset, file_offset + file_datalen);
+                }
+                if (file_datalen && (stat == SUCCESS) && 
+                        (file_offset >= ckpt.Offset)) {
+                    uint4 end_offset = file_offset + file_datalen;
+                    if (end_offset > alloc_size) {
+                        alloc_size = end_offset + UPLOAD_PREALLOC_SIZE;
+                        if (posix_fallocate (fd, 0, alloc_size)) {
+                            stat = FAILURE;
+                        }
+                    }
+                    if (pwrite (fd, file_data, file_datalen, file_offset)
+                            != file_datalen) {
+                        stat = FAILURE;
+                    }
+                    if (stat == FAILURE) {
+                        string err("I/O error occurred while writing to : ");
+                        err.append(write_to_file);
+                        Category::getInstance("BMP5").warn(err);
+                    }
+                    else {
+                        received[file_offset] = file_datalen;
+                    }
+                    nbytes += file_datalen;
+                }
+                progress = true;
+            }
+            pending.erase(pending_itr);
             packetQueue__->pop_front ();
         }
 
-        if (ioException) { 
-            break;
+        if (restart) {
+            packetQueue__->clear();
+            lost.clear();
+            received.clear();
+            next_offset = ckpt.Offset = 0;
+            ckpt.Signature = 0xaaaa;
+            eof_offset = err_offset = 0xffffffff;
+            alloc_size = nbytes = 0;
+            num_attempts = 0;
+            if (ftruncate (fd, 0)) {
+                stat = FAILURE;
+            }
+            continue;
         }
 
-        if (!stat) {
-            if (file_datalen != Swath) {
+        // Advance the checkpoint over the blocks received in order
+        uint4 prev_offset = ckpt.Offset;
+        map<uint4, uint4>::iterator recv_itr;
+        while ((stat == SUCCESS) && 
+                ((recv_itr = received.find(ckpt.Offset)) != received.end())) {
+            if (pread (fd, block, recv_itr->second, recv_itr->first) != 
+                    (int)recv_itr->second) {
+                stat = FAILURE;
                 break;
             }
+            ckpt.Signature = CalcSig (block, recv_itr->second, ckpt.Signature);
+            ckpt.Offset += recv_itr->second;
+            received.erase(recv_itr);
         }
-        else {
-            if (stat == DELIVERY_FAILURE) {
-                break;
+        if (keep_ckpt && (ckpt.Offset != prev_offset)) {
+            save_checkpoint (ckpt_path, ckpt);
+        }
+
+        for (pending_itr = pending.begin(); pending_itr != pending.end(); 
+                ++pending_itr) {
+            lost.insert(pending_itr->second);
+        }
+        while (lost.size() && (*lost.rbegin() >= min(eof_offset, err_offset))) {
+            lost.erase(*lost.rbegin());
+        }
+
+        // Requests past the end of the file are expected to be refused, as
+        // the file size is not known in advance. Once everything before the
+        // refused offset is in, it marks the end of the file unless nothing 
+        // could be read at all.
+        if ((err_offset < eof_offset) && lost.empty()) {
+            if (err_offset == 0) {
+                Category::getInstance("BMP5")
+                         .error(string("Logger refused upload of ") + get_file);
+                stat = FAILURE;
             }
             else {
-                sleep (1);
+                eof_offset = err_offset;
             }
         }
+        num_attempts = progress ? 0 : (num_attempts + 1);
     }
-    
-    TDFdata.close ();
 
-    if (ioException) {
-        string err("Removing possibly corrupted file : ");
+    if ((stat == SUCCESS) && (eof_offset != 0xffffffff) && 
+            ftruncate (fd, eof_offset)) {
+        string err("I/O error occurred while writing to : ");
         err.append(write_to_file);
-        Category::getInstance("BMP5").notice(err);
-        unlink(write_to_file);
+        Category::getInstance("BMP5").warn(err);
+        stat = FAILURE;
     }
-    
-    if (ioException || (file_offset == 0) || stat) {
-        // Indicate that this transaction is the final exchange of this
-        // trasaction so that the file can be closed.
-        // CloseFlag = 0x01;
 
-        MsgBody__[len+3] = 0x01;
-        MsgBody__[len+8] = 0x00;
-        MsgBody__[len+9] = 0x00;
+    // An empty file is complete once the logger answered with no data
 
-        try {
-            SendPBPacket();
-            pbuf__->readFromDevice();
-        } 
-        catch (CommException& ce) {
-            Category::getInstance("BMP5")
-                     .error("Communication error during closing of File Upload Transaction");
-        }
-        return FAILURE;
+    if ((stat == SUCCESS) && (ckpt.Offset || (eof_offset == 0))) {
+        unlink (ckpt_path.c_str());
+        close (fd);
+        msgstrm << "Uploaded " << get_file << " (" << nbytes << " bytes in "
+                << (time(NULL) - start_t) << " secs)";
+        Category::getInstance("BMP5").debug(msgstrm.str());
+        return SUCCESS;
+    }
+
+    // Keep what was received in order for resuming the transfer later 
+
+    if (keep_ckpt && ckpt.Offset && !ftruncate (fd, ckpt.Offset)) {
+        msgstrm << "Keeping partial file " << write_to_file << " (" 
+                << ckpt.Offset << " bytes) for resuming the transfer";
+        Category::getInstance("BMP5").notice(msgstrm.str());
+        close (fd);
     }
     else {
-        return SUCCESS;
+        string err("Removing incomplete file : ");
+        err.append(write_to_file);
+        Category::getInstance("BMP5").notice(err);
+        close (fd);
+        unlink (write_to_file);
+        unlink (ckpt_path.c_str());
+    }
+
+    if (comm_error.size()) {
+        throw CommException(__FILE__, __LINE__, comm_error.c_str());
+    }
+
+    // Indicate that this transaction is the final exchange of this
+    // trasaction so that the file can be closed.
+    // CloseFlag = 0x01;
+
+    GenTranNbr();
+    MsgBody__[len+3] = 0x01;
+    PBSerialize (MsgBody__+len+4, (uint4)0, 4);
+    MsgBody__[len+8] = 0x00;
+    MsgBody__[len+9] = 0x00;
+
+    try {
+        SendPBPacket();
+        pbuf__->readFromDevice();
+    } 
+    catch (CommException& ce) {
+        Category::getInstance("BMP5")
+                 .error("Communication error during closing of File Upload Transaction");
     }
+    return FAILURE;
 }
 
 /**
- * Function to parse the data packets received in response to UpLoadFile command.
- * @param pack: Refernce to the PakBus data packet to parse.
- * @param filedata: Reference to the output filestream to write the data 
- *              in the packet. Assuming the file stream will be opened prior
- *              to making the function call.
- * @return On success, returns the number of bytes from the file received in 
- * the packet. 0 is returned to indicate error conditions.
+ * Path of the file holding the progress of a file transfer.
+ * @param xfer_type: Direction of the transfer ("upload" or "download").
+ * @param logger_file: Name of the file on the logger.
  */
-int 
-BMP5Obj :: process_upload_file (Packet& pack, ofstream& filedata) throw (IOException)
+string 
+BMP5Obj :: get_checkpoint_path (const char* xfer_type, const string& logger_file)
 {
-    byte *pack_ptr = (byte *)(pack.begPacket + 11);
-    string errormsg;
-
-    byte stat = *pack_ptr++;
-    if (stat) {
-        if (stat == 0x01) {
-            errormsg = "Permission denied";
-        }
-        else if (stat == 0x0d) {
-            errormsg = "Invalid filename";
-        }
-        else if (stat == 0x0e) {
-            errormsg = "File currently unavailable";
-        }
-        Category::getInstance("BMP5")
-                .error("process_upload_file() : " + errormsg);
-        return 0;
-    }
-    pack_ptr += 4;
+    string path = tblDataMgr__->getDataOutputConfig().WorkingPath;
+    path.append("/.working/").append(xfer_type).append(".");
 
-    int file_data_len = pack.endPacket - (char *)pack_ptr - 2;
-    // Need to subtract the signature length as well
-    filedata.write ((const char *)pack_ptr, file_data_len);
-    filedata.flush();
-    if (filedata.bad()) {
-        throw IOException(__FILE__, __LINE__, "I/O error");
+    for (unsigned int count = 0; count < logger_file.size(); count++) {
+        char ch = logger_file[count];
+        path += ((ch == ':') || (ch == '/')) ? '_' : ch;
     }
-    return file_data_len;
+    return path;
 }
 
 /**
- * Function to send a "collect" command to the data logger. 
- * Although the BMP5 protocol describes 6 modes for data collection, the 
- * data logger software may not have the features implemented. 
- * @param message_type: Message type to indicate the data collection.
- *              mode. Modes 0x03-0x07 are implenented in this function,
- *              although only 0x05 and 0x06 are used in this program
- *              for data collection.
- * @param tbl:  Reference to the Table structure containing information
- *              about the table to collect data from.
- * @param P1, P2: Parameters corresponding to the data collection mode.
- *              If a collection mode requires only one parameter, then
- *              the second argument (P2) will be ignored.
- * @return Returns -1 if an invalud collection mode is specified.
+ * Load the progress of an earlier file transfer.
+ * @return true if a checkpoint was found for the same logger file.
  */
-int 
-BMP5Obj :: sendCollectionCmd (byte message_type, Table& tbl, uint4 P1, uint4 P2)
+bool 
+BMP5Obj :: load_checkpoint (const string& path, XferCheckpoint& ckpt)
 {
-    Priority__ = 0x02;
-    MsgType__  = 0x09;
+    ifstream ckpt_fs (path.c_str(), ios_base::in);
+    char     buf[256];
+
+    if (!ckpt_fs.is_open()) {
+        return false;
+    }
+    ckpt_fs.getline (buf, 256);
+    getline (ckpt_fs, ckpt.LoggerFile);
+    getline (ckpt_fs, ckpt.HostFile);
+    ckpt_fs >> ckpt.Offset >> ckpt.FileSize >> ckpt.Signature;
+    if (ckpt_fs.fail()) {
+        return false;
+    }
+    getline (ckpt_fs >> ws, ckpt.LastUpdate);
+
+    return true;
+}
+
+/**
+ * Persist the progress of a file transfer.
+ */
+void 
+BMP5Obj :: save_checkpoint (const string& path, const XferCheckpoint& ckpt)
+{
+    ofstream ckpt_fs (path.c_str(), ofstream::out);
+
+    if (ckpt_fs.is_open()) {
+        ckpt_fs << "# LoggerFile, HostFile, Offset, FileSize, Signature, "
+                << "LastUpdate" << endl
+                << ckpt.LoggerFile << endl
+                << ckpt.HostFile << endl
+                << ckpt.Offset << endl
+                << ckpt.FileSize << endl
+                << ckpt.Signature << endl
+                << ckpt.LastUpdate << endl;
+    }
+    else {
+        Category::getInstance("BMP5")
+                 .warn("Failed to store file transfer checkpoint : " + path);
+    }
+}
+
+/**
+ * Compute the signature of the first len bytes of a file.
+ * @param sig: Set to the signature on success.
+ * @return SUCCESS, or FAILURE if the file is shorter than len bytes.
+ */
+int 
+BMP5Obj :: file_signature (int fd, uint4 len, uint2& sig)
+{
+    byte  buf[4096];
+    uint4 offset = 0;
+
+    sig = 0xaaaa;
+    while (offset < len) {
+        int nread = pread (fd, buf, min((uint4)sizeof(buf), len - offset), 
+                offset);
+        if (nread <= 0) {
+            return FAILURE;
+        }
+        sig = CalcSig (buf, nread, sig);
+        offset += nread;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Function to bring the host copies of the files on the logger file system
+ * up to date. The directory listing of the logger is uploaded and the 
+ * files on the given devices that are new, have grown or were rewritten 
+ * since the last synchronization are uploaded into the working path. 
+ * Files that have only grown are continued from the end of the host copy,
+ * once the last block of the host copy reads back the same from the logger.
+ * The name, size and time of update of the files synchronized are cached
+ * in the working directory between sessions.
+ * @param devices: Devices to synchronize files from (i.e. "CRD:").
+ * @return SUCCESS if all files were synchronized, FAILURE otherwise.
+ */
+int
+BMP5Obj :: SyncFiles (const vector<string>& devices) throw (IOException)
+{
+    int    sync_stat = SUCCESS;
+    int    num_files = 0;
+    string working_path = tblDataMgr__->getDataOutputConfig().WorkingPath;
+    string state_file = working_path + "/.working/sync.state";
+    vector<LoggerFileInfo>   entries;
+    map<string, LoggerFileInfo> synced;
+    map<string, LoggerFileInfo>::iterator synced_itr;
+    stringstream msgstrm;
+
+    if (get_directory (entries) == FAILURE) {
+        Category::getInstance("BMP5")
+                 .error("Failed to read the directory listing of the logger");
+        return FAILURE;
+    }
+    load_sync_state (state_file, synced);
+
+    for (unsigned int count = 0; count < entries.size(); count++) {
+        const LoggerFileInfo& entry = entries[count];
+        unsigned int dev;
+
+        for (dev = 0; dev < devices.size(); dev++) {
+            if (entry.FileName.compare(0, devices[dev].size(), devices[dev]) 
+                    == 0) {
+                break;
+            }
+        }
+        if (dev == devices.size()) {
+            continue;
+        }
+
+        string host_file = working_path + "/";
+        for (unsigned int pos = entry.FileName.find(':') + 1; 
+                pos < entry.FileName.size(); pos++) {
+            host_file += (entry.FileName[pos] == '/') ? '_' : 
+                    entry.FileName[pos];
+        }
+
+        synced_itr = synced.find(entry.FileName);
+        bool cached = (synced_itr != synced.end());
+        struct stat file_stat;
+
+        if (cached && (synced_itr->second.FileSize == entry.FileSize) &&
+                (synced_itr->second.LastUpdate == entry.LastUpdate) &&
+                !stat (host_file.c_str(), &file_stat)) {
+            continue;
+        }
+
+        // A file that has grown is continued from the end of the host 
+        // copy, by leaving a checkpoint for UploadFile to resume from.
+
+        if (cached && (entry.FileSize > synced_itr->second.FileSize) &&
+                !stat (host_file.c_str(), &file_stat) &&
+                ((uint4)file_stat.st_size == synced_itr->second.FileSize)) {
+            XferCheckpoint ckpt;
+            ckpt.LoggerFile = entry.FileName;
+            ckpt.HostFile   = host_file;
+            ckpt.FileSize   = entry.FileSize;
+            ckpt.LastUpdate = entry.LastUpdate;
+            ckpt.Offset     = (file_stat.st_size / MAX_UPLOAD_SWATH) * 
+                    MAX_UPLOAD_SWATH;
+
+            int fd = open (host_file.c_str(), O_RDONLY);
+            if ((fd >= 0) && ckpt.Offset &&
+                    (file_signature (fd, ckpt.Offset, ckpt.Signature) == 
+                            SUCCESS)) {
+                save_checkpoint (get_checkpoint_path ("upload", 
+                            entry.FileName), ckpt);
+            }
+            if (fd >= 0) {
+                close (fd);
+            }
+        }
+
+        msgstrm << "Synchronizing " << entry.FileName << " (" 
+                << entry.FileSize << " bytes, " << entry.LastUpdate << ")";
+        Category::getInstance("BMP5").info(msgstrm.str());
+        msgstrm.str("");
+
+        if (UploadFile (entry.FileName.c_str(), host_file.c_str(), &entry) 
+                == SUCCESS) {
+            synced[entry.FileName] = entry;
+            save_sync_state (state_file, synced);
+            num_files++;
+        }
+        else {
+            Category::getInstance("BMP5")
+                     .error("Failed to synchronize : " + entry.FileName);
+            sync_stat = FAILURE;
+        }
+    }
+
+    msgstrm << "Synchronized " << num_files << " file(s) from the logger";
+    Category::getInstance("BMP5").notice(msgstrm.str());
+    return sync_stat;
+}
+
+/**
+ * Function to upload and parse the directory listing of the logger file 
+ * system. The listing begins with a format version byte, followed by an
+ * entry per file holding the file name (ASCIIZ), the file size (UInt4), 
+ * the time of last update (ASCIIZ) and a list of attribute codes ending 
+ * with 0x00. An empty file name marks the end of the listing.
+ * @param entries: Loaded with the files found on the logger.
+ * @return SUCCESS | FAILURE
+ */
+int
+BMP5Obj :: get_directory (vector<LoggerFileInfo>& entries) throw (IOException)
+{
+    string dir_file = tblDataMgr__->getDataOutputConfig().WorkingPath;
+    dir_file += "/.working/dir.dat";
+
+    if (UploadFile (".DIR", dir_file.c_str()) == FAILURE) {
+        return FAILURE;
+    }
+
+    ifstream dir_fs (dir_file.c_str(), ios_base::in | ios_base::binary);
+    vector<char> buf ((istreambuf_iterator<char>(dir_fs)), 
+            istreambuf_iterator<char>());
+    dir_fs.close();
+    unlink (dir_file.c_str());
+
+    unsigned int pos = 1;  // Skip the format version
+    entries.clear();
+
+    while (pos < buf.size()) {
+        LoggerFileInfo entry;
+        const char* end = (const char *)memchr (&buf[pos], 0, buf.size() - pos);
+        if (end == NULL) {
+            break;
+        }
+        entry.FileName = &buf[pos];
+        pos += entry.FileName.size() + 1;
+        if (entry.FileName.empty() || (pos + 4 > buf.size())) {
+            break;
+        }
+
+        entry.FileSize = PBDeserialize ((const byte *)&buf[pos], 4);
+        pos += 4;
+
+        if (pos >= buf.size()) {
+            break;
+        }
+        end = (const char *)memchr (&buf[pos], 0, buf.size() - pos);
+        if (end == NULL) {
+            break;
+        }
+        entry.LastUpdate = &buf[pos];
+        pos += entry.LastUpdate.size() + 1;
+
+        while ((pos < buf.size()) && buf[pos]) {
+            pos++;
+        }
+        pos++;
+
+        entries.push_back(entry);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Look up a file in the directory listing of the logger.
+ * @param file_name: File name including the device (i.e. CRD:data.dat).
+ * @param info: Set to the directory entry of the file when found.
+ * @return SUCCESS, or FAILURE if the file is not listed.
+ */
+int
+BMP5Obj :: find_logger_file (const string& file_name, LoggerFileInfo& info) 
+        throw (IOException)
+{
+    vector<LoggerFileInfo> entries;
+
+    if (get_directory (entries) == FAILURE) {
+        return FAILURE;
+    }
+    for (unsigned int count = 0; count < entries.size(); count++) {
+        if (entries[count].FileName == file_name) {
+            info = entries[count];
+            return SUCCESS;
+        }
+    }
+    Category::getInstance("BMP5")
+             .debug(file_name + " is not in the directory listing of the logger");
+    return FAILURE;
+}
+
+/**
+ * Load the files synchronized in earlier sessions, one per line holding
+ * the logger file name, its size and time of last update separated by 
+ * tabs. The size and time are taken from the last two fields, so that the
+ * file names may hold any character.
+ */
+void
+BMP5Obj :: load_sync_state (const string& path, 
+        map<string, LoggerFileInfo>& synced)
+{
+    ifstream state_fs (path.c_str(), ios_base::in);
+    string   line;
+
+    synced.clear();
+    while (getline (state_fs, line)) {
+        if (line.empty() || (line[0] == '#')) {
+            continue;
+        }
+        string::size_type time_pos = line.rfind('\t');
+        if ((time_pos == string::npos) || (time_pos == 0)) {
+            continue;
+        }
+        string::size_type size_pos = line.rfind('\t', time_pos - 1);
+        if ((size_pos == string::npos) || (size_pos == 0)) {
+            continue;
+        }
+
+        LoggerFileInfo entry;
+        istringstream size_strm (line.substr(size_pos + 1, 
+                time_pos - size_pos - 1));
+        size_strm >> entry.FileSize;
+        if (size_strm.fail()) {
+            continue;
+        }
+        entry.FileName   = line.substr(0, size_pos);
+        entry.LastUpdate = line.substr(time_pos + 1);
+        synced[entry.FileName] = entry;
+    }
+}
+
+/**
+ * Persist the files synchronized so far.
+ */
+void
+BMP5Obj :: save_sync_state (const string& path, 
+        const map<string, LoggerFileInfo>& synced)
+{
+    ofstream state_fs (path.c_str(), ofstream::out);
+    map<string, LoggerFileInfo>::const_iterator itr;
+
+    if (!state_fs.is_open()) {
+        Category::getInstance("BMP5")
+                 .warn("Failed to store file synchronization state : " + path);
+        return;
+    }
+    state_fs << "# FileName, FileSize, LastUpdate" << endl;
+    for (itr = synced.begin(); itr != synced.end(); ++itr) {
+        state_fs << itr->second.FileName << '\t' << itr->second.FileSize 
+                 << '\t' << itr->second.LastUpdate << endl;
+    }
+}
+
+/**
+ * Function to parse the data packets received in response to UpLoadFile command.
+ * @param pack: Refernce to the PakBus data packet to parse.
+ * @param file_offset: Set to the byte offset of the data in the file.
+ * @param file_data: Set to point to the file data within the packet.
+ * @return On success, returns the number of bytes from the file received in 
+ * the packet. -1 is returned if the logger reported an error.
+ */
+int 
+BMP5Obj :: process_upload_file (Packet& pack, uint4& file_offset, 
+        byte*& file_data)
+{
+    byte *pack_ptr = (byte *)(pack.begPacket + 11);
+    string errormsg;
+
+    byte stat = *pack_ptr++;
+    if (stat) {
+        if (stat == 0x01) {
+            errormsg = "Permission denied";
+        }
+        else if (stat == 0x0d) {
+            errormsg = "Invalid filename";
+        }
+        else if (stat == 0x0e) {
+            errormsg = "File currently unavailable";
+        }
+        // Requests past the end of the file are refused as well, the 
+        // caller decides whether this is an error
+        Category::getInstance("BMP5")
+                .debug("process_upload_file() : " + errormsg);
+        return -1;
+    }
+    file_offset = PBDeserialize (pack_ptr, 4);
+    pack_ptr += 4;
+    file_data = pack_ptr;
+
+    // Need to subtract the signature length as well
+    int file_data_len = pack.endPacket - (char *)pack_ptr - 2;
+    return (file_data_len < 0) ? 0 : file_data_len;
+}
+
+/**
+ * Function to send a "collect" command to the data logger. 
+ * Although the BMP5 protocol describes 6 modes for data collection, the 
+ * data logger software may not have the features implemented. 
+ * @param message_type: Message type to indicate the data collection.
+ *              mode. Modes 0x03-0x07 are implenented in this function,
+ *              although only 0x05 and 0x06 are used in this program
+ *              for data collection.
+ * @param tbl:  Reference to the Table structure containing information
+ *              about the table to collect data from.
+ * @param P1, P2: Parameters corresponding to the data collection mode.
+ *              If a collection mode requires only one parameter, then
+ *              the second argument (P2) will be ignored.
+ * @return Returns -1 if an invalud collection mode is specified.
+ */
+int 
+BMP5Obj :: sendCollectionCmd (byte message_type, Table& tbl, uint4 P1, uint4 P2)
+{
+    Priority__ = 0x02;
+    MsgType__  = 0x09;
     stringstream msgstrm;
 
     switch (message_type) {
@@ -544,21 +1399,24 @@ BMP5Obj :: sendCollectionCmd (byte message_type, Table& tbl, uint4 P1, uint4 P2)
     PBSerialize (MsgBody__+3, tbl.TblNum, 2);
     PBSerialize (MsgBody__+5, tbl.TblSignature, 2);
 
-    if (MsgBodyLen__ == 9) {
-        // No parameters required, just pass the field list terminator
-        PBSerialize (MsgBody__+7, 0, 2);
-    }
-    else {
+    if (MsgBodyLen__ > 9) {
         PBSerialize (MsgBody__+7, P1, 4);
 
-        if (MsgBodyLen__ == 13) {
-            PBSerialize (MsgBody__+11, 0, 2);
-        }
-        else {
+        if (MsgBodyLen__ == 17) {
             PBSerialize (MsgBody__+11, P2, 4);
-            PBSerialize (MsgBody__+15, 0, 2);
         }
     }
+
+    // The field list follows the parameters and is terminated by 0. An
+    // empty list requests all the fields of the table.
+    byte* field_ptr = MsgBody__ + MsgBodyLen__ - 2;
+    for (int count = 0; count < (int)tbl.FieldNumbers.size(); count++) {
+        PBSerialize (field_ptr, tbl.FieldNumbers[count], 2);
+        field_ptr += 2;
+    }
+    PBSerialize (field_ptr, 0, 2);
+    MsgBodyLen__ += 2 * tbl.FieldNumbers.size();
+
     SendPBPacket();
     return TranNbr__;
 }
@@ -587,26 +1445,363 @@ BMP5Obj :: store_data (byte* buf, Table& tbl, int beg, int nrecs,
         int file_span) throw (StorageException)
 {
     int stat = FAILURE;
-    bool parseTimestamp = true;
-    int rec_num = 0;
-    while (rec_num < nrecs) {
-        try {
-            stat = tblDataMgr__->storeRecord (tbl, &buf, beg+rec_num, file_span, 
-                    parseTimestamp);
-        } catch (StorageException& e) {
-            Category::getInstance("BMP5")
-                     .error("Caught exception while storing data for " + tbl.TblName);
-            Category::getInstance("BMP5")
-                     .error(e.what()); 
-            throw;
+    if (nrecs <= 0) {
+        return stat;
+    }
+    try {
+        stat = tblDataMgr__->storeRecords (tbl, &buf, beg, nrecs, true);
+    } catch (StorageException& e) {
+        Category::getInstance("BMP5")
+                 .error("Caught exception while storing data for " + tbl.TblName);
+        Category::getInstance("BMP5")
+                 .error(e.what()); 
+        throw;
+    }
+    return stat;
+}
+
+/**
+ * Function to learn the time of a single record without storing it.
+ * @param rec_nbr: Number of the record to probe.
+ * @param rec_time: Set to the time of the record if it is available.
+ * @return true if the record is still available on the logger.
+ */
+bool
+BMP5Obj :: probe_record (Table& tbl_ref, int record_size, uint4 rec_nbr, 
+        NSec& rec_time)
+{
+    RecordStat recordStat = get_records (tbl_ref, 
+            GET_DATA_RANGE | INQ_REC_INFO, record_size, rec_nbr, rec_nbr + 1, 0);
+    if ((recordStat.count < 0) || ((uint4)recordStat.count != rec_nbr)) {
+        return false;
+    }
+    rec_time = recordStat.recordTime;
+    return true;
+}
+
+/**
+ * Function to find the record to resume data collection from, when the 
+ * next record to collect is no longer available on the logger (the table
+ * ring has wrapped around since the last collection or the logger was 
+ * reset). The oldest record available is probed first. If it is newer 
+ * than the last record collected, the records in between are lost and the
+ * collection resumes from the oldest record. Otherwise the first record 
+ * newer than Table::LastRecordTime is searched for with single record 
+ * probes, starting from the position estimated with the table interval.
+ *
+ * @param tbl_ref: Reference to the table being collected.
+ * @param record_size: Size of a record, -1 if variable.
+ * @param last_rec_nbr: Number of the last record stored on the logger.
+ * @param last_rec_time: Time of the last record stored on the logger.
+ * @param contiguous: Set to true if the collection resumes right after
+ *             the last record collected.
+ * @return Number of the record to resume data collection from.
+ */
+uint4
+BMP5Obj :: find_resume_record (Table& tbl_ref, int record_size, 
+        uint4 last_rec_nbr, const NSec& last_rec_time, bool& contiguous)
+{
+    const NSec& collected_time = tbl_ref.LastRecordTime;
+    uint4  oldest = (last_rec_nbr + 1 > tbl_ref.TblSize) ? 
+            (last_rec_nbr + 1 - tbl_ref.TblSize) : 0;
+    NSec   oldest_time, probe_time;
+    int    num_probes = 0;
+    stringstream msgstrm;
+
+    contiguous = false;
+
+    // The ring may hold one record less than the table size
+    while (!probe_record (tbl_ref, record_size, oldest, oldest_time)) {
+        num_probes++;
+        if ((oldest == last_rec_nbr) || (num_probes == 2)) {
+            oldest = last_rec_nbr;
+            oldest_time = last_rec_time;
+            break;
         }
-        parseTimestamp = false;
-        if (stat == FAILURE) {
+        oldest++;
+    }
+
+    if ((collected_time.sec == 0) || 
+            (nseccmp(oldest_time, collected_time) > 0)) {
+        if (collected_time.sec) {
+            msgstrm << "Records were lost from " << tbl_ref.TblName 
+                    << " before they could be collected, resuming from the "
+                    << "oldest record available : " << oldest;
+            Category::getInstance("BMP5").warn(msgstrm.str());
+        }
+        return oldest;
+    }
+
+    if (nseccmp(last_rec_time, collected_time) <= 0) {
+        // Nothing on the logger is newer than the last record collected
+        // (i.e. the logger clock was set back), collect the whole table.
+        msgstrm << "No record in " << tbl_ref.TblName << " is newer than "
+                << "the last record collected, resuming from the oldest "
+                << "record available : " << oldest;
+        Category::getInstance("BMP5").warn(msgstrm.str());
+        return oldest;
+    }
+
+    // Records lo and hi are known to be at most as old and newer than 
+    // the last record collected respectively.
+
+    uint4 lo = oldest, hi = last_rec_nbr;
+    NSec  lo_time = oldest_time;
+    double interval = tbl_ref.TblTimeInterval.sec + 
+            tbl_ref.TblTimeInterval.nsec / 1E9;
+    uint4 mid = 0;
+    bool  guess = false;
+
+    if (interval > 0) {
+        double elapsed = (double)collected_time.sec - oldest_time.sec + 
+                ((double)collected_time.nsec - oldest_time.nsec) / 1E9;
+        mid = lo + (uint4)(elapsed / interval + 0.5);
+        guess = true;
+    }
+
+    while ((hi - lo > 1) && (num_probes < MAX_RESUME_PROBES)) {
+        if ((mid <= lo) || (mid >= hi)) {
+            mid = lo + (hi - lo) / 2;
+        }
+        num_probes++;
+
+        // Following a probe at the estimated position, the neighbouring 
+        // record is probed in case the estimate was off by one. The 
+        // search falls back to bisection from there on.
+        bool found = probe_record (tbl_ref, record_size, mid, probe_time);
+        if (!found || (nseccmp(probe_time, collected_time) <= 0)) {
+            lo = mid;
+            lo_time = found ? probe_time : NSec();
+            mid = guess ? (lo + 1) : 0;
+        }
+        else {
+            hi = mid;
+            mid = guess ? (hi - 1) : 0;
+        }
+        guess = false;
+    }
+
+    contiguous = (nseccmp(lo_time, collected_time) == 0);
+
+    msgstrm << "Resuming collection of " << tbl_ref.TblName << " at record " 
+            << hi << " (" << num_probes << " probes)";
+    Category::getInstance("BMP5").info(msgstrm.str());
+    return hi;
+}
+
+/**
+ * Function to predict the number of the last record stored in a table from
+ * the time elapsed since the last record collected, for tables with a fixed
+ * record interval. The logger time is derived from the clock offset measured
+ * by the last clock check (ClockTransaction), less PREDICT_MARGIN_SECS to 
+ * allow for the resolution of the offset. No prediction is made unless it
+ * is enabled with BMP5Opt::PredictLastRecord, or if the range would need 
+ * the special handling of a ring wrap or a catch-up.
+ *
+ * @param tbl_ref: Reference to the table being collected.
+ * @param table_opt: Collection options for the table.
+ * @param last_rec_nbr: Set to the number of the last record predicted.
+ * @return true if a prediction was made.
+ */
+bool
+BMP5Obj :: predict_last_record (const Table& tbl_ref, const TableOpt& table_opt,
+        int& last_rec_nbr)
+{
+    double interval = tbl_ref.TblTimeInterval.sec + 
+            tbl_ref.TblTimeInterval.nsec/1E9;
+
+    if (!bmp5Opt__.PredictLastRecord || !clockOffsetValid__ || 
+            (interval <= 0) || (tbl_ref.TblSize <= 1) || 
+            (tbl_ref.LastRecordTime.sec == 0) || (tbl_ref.NextRecord == 0)) {
+        return false;
+    }
+
+    double logger_time = (double)(time(NULL) - clockOffset__ - SECS_BEFORE_1990);
+    double elapsed = logger_time - PREDICT_MARGIN_SECS - 
+            (tbl_ref.LastRecordTime.sec + tbl_ref.LastRecordTime.nsec/1E9);
+    double num_records = floor(elapsed/interval);
+
+    if ((num_records < 1) || (num_records >= tbl_ref.TblSize) || 
+            (table_opt.CatchUpRecords && 
+                (num_records > table_opt.CatchUpRecords))) {
+        return false;
+    }
+
+    last_rec_nbr = (int)(tbl_ref.NextRecord - 1 + (uint4)num_records);
+
+    stringstream msgstrm;
+    msgstrm << "Predicted last record of " << tbl_ref.TblName << " : " 
+            << last_rec_nbr;
+    Category::getInstance("BMP5").debug(msgstrm.str());
+    return true;
+}
+
+/**
+ * Function to find the range of records to collect from a table, by 
+ * querying the logger for the last record stored. Table::NextRecord is
+ * moved to the record to resume the collection from, if the next record 
+ * is no longer available on the logger (see find_resume_record) or the 
+ * newest records are to be collected first (see TableOpt::CatchUpRecords).
+ *
+ * @param tbl_ref: Reference to the table being collected.
+ * @param table_opt: Collection options for the table.
+ * @param record_size: Size of a record, -1 if variable.
+ * @param last_rec_nbr: Set to the number of the last record on the logger.
+ * @param catch_up: Set to true if the newest records are collected first.
+ * @return Number of records to collect, -1 if the last record stored on
+ * the logger couldn't be determined.
+ */
+int
+BMP5Obj :: find_pending_records (Table& tbl_ref, const TableOpt& table_opt, 
+        int record_size, int& last_rec_nbr, bool& catch_up)
+{
+    int      records_pending;
+    stringstream msgstrm;
+    RecordStat recordStat;
+
+    int numAttempts = 0;
+    // get the last record number the logger is written in it's memory.
+    while (numAttempts++ < 3) {
+        recordStat = get_records (tbl_ref, GET_LAST_REC | INQ_REC_INFO,
+                record_size, 1, 0, table_opt.TableSpan);
+        last_rec_nbr = recordStat.count;
+        if (last_rec_nbr >= 0) {
             break;
         }
-        rec_num++;
+    }
+
+    // The data can't be collected if the last record number is unavailable.
+    if (last_rec_nbr < 0) {
+        string err("Failed to retrieve information about last record stored in [");
+        err.append(tbl_ref.TblName)
+              .append("] on datalogger memory");
+        Category::getInstance("BMP5")
+                 .error(err);
+        return -1;
+    }
+
+    // Get the record number to start data collection and the record 
+    // untill which to collect. Table::NextRecord tells us where we need to
+    // start the data collection.
+   
+    msgstrm << "Record Index information :" << endl
+            << "\t\tIndex of last stored record on datalogger memory : " 
+            << last_rec_nbr << endl
+            << "\t\tIndex of next record to collect from datalogger memory : " 
+            << tbl_ref.NextRecord;
+    Category::getInstance("BMP5")
+             .debug(msgstrm.str());
+    msgstrm.str("");
+     
+    records_pending = (int)(last_rec_nbr-tbl_ref.NextRecord);
+
+    if  (records_pending < 0) {
+
+        time_t t_s = (time_t)tbl_ref.LastRecordTime.sec + SECS_BEFORE_1990;
+        time_t t_c = (time_t)recordStat.recordTime.sec + SECS_BEFORE_1990;
+
+        if (records_pending == -1) {
+            if (0 == nseccmp(tbl_ref.LastRecordTime, recordStat.recordTime)) {
+                Category::getInstance("BMP5")
+                     .info("No new data is available yet for : " 
+                            + table_opt.TableName);
+                return 0;
+            }
+            else {
+                msgstrm << "Different timestamp found for identical record id\n"
+                        << "\tTimestamp of last stored record on logger : " 
+                        << ctime(&t_s)
+                        << "\tTimestamp of last collected record from logger : " 
+                        << ctime(&t_c);
+                Category::getInstance("BMP5")
+                         .notice(msgstrm.str());
+                msgstrm.str("");
+            }
+        }
+        else if (nseccmp(tbl_ref.LastRecordTime, recordStat.recordTime) > 1) {
+            msgstrm << "Backward shift observed in datalogger clock." << endl
+                    << "\tCheck data from table => " << tbl_ref.TblName << endl
+                    << "\tTimestamp of last available data record in datalogger memory"
+                    << "precedes the timestamp of the last collected record" << endl
+                    << "\tNext target record index : " << tbl_ref.NextRecord << endl
+                    << "\tTimestamp of last collected record from datalogger: " 
+                    << ctime(&t_c)
+                    << "\tIndex of last stored record in datalogger memory : " 
+                    << last_rec_nbr << endl
+                    << "\tTimestamp of last stored record in datalogger memory : " 
+                    << ctime(&t_s);
+            Category::getInstance("BMP5")
+                     .warn(msgstrm.str());
+            msgstrm.str("");
+        }
     } 
-    return stat;
+
+    // The following cases need special attention:
+    // 1. The logger has written enough data since the last data collection so
+    //    that the record with ID tbl_ref.NextRecord is wiped from memory. 
+    // 2. The data collection downtime can be long enough so that the logger 
+    //    reached the maximum  record id and then started back from 1 again.
+    // In both cases, the record following the last collected record is 
+    // located by its time.
+
+    if ((records_pending >= (int)tbl_ref.TblSize) || (records_pending < 0)) {
+
+        msgstrm << "Locating start record index to compensate for backlog:\n"
+                << "\tTable(" << tbl_ref.TblName << ") size: "
+                << tbl_ref.TblSize << " records" << endl
+                << "\tLast stored record id : " << last_rec_nbr << endl
+                << "\tLast collected record id : " << tbl_ref.NextRecord << endl;
+        Category::getInstance("BMP5").info(msgstrm.str());
+        msgstrm.str("");
+
+        bool contiguous;
+        tbl_ref.NextRecord = find_resume_record (tbl_ref, record_size, 
+                last_rec_nbr, recordStat.recordTime, contiguous);
+     
+        // Reset all the history for this Table unless the collection
+        // continues right after the last record collected
+        if (tbl_ref.NewFileTime && !contiguous) {
+            tblDataMgr__->flushTableDataCache(tbl_ref);
+        }
+    }
+
+    // After an outage, collect the newest records first so that current
+    // data is available right away. The records skipped are backfilled
+    // into separate files by BackfillData. Only one range of records is 
+    // tracked for backfill, so the collection continues in order while 
+    // an earlier backlog is pending.
+
+    if (table_opt.CatchUpRecords && 
+            (tbl_ref.NextRecord <= (uint4)last_rec_nbr) &&
+            ((uint4)last_rec_nbr - tbl_ref.NextRecord + 1 > 
+                    table_opt.CatchUpRecords)) {
+        if (tbl_ref.BackfillNext < tbl_ref.BackfillEnd) {
+            msgstrm << "Backfill of records " << tbl_ref.BackfillNext 
+                    << "-" << tbl_ref.BackfillEnd - 1 << " still pending,"
+                    << " collecting " << tbl_ref.TblName << " in order";
+            Category::getInstance("BMP5").notice(msgstrm.str());
+            msgstrm.str("");
+        }
+        else {
+            tbl_ref.BackfillNext = tbl_ref.NextRecord;
+            tbl_ref.BackfillEnd  = (uint4)last_rec_nbr + 1 - 
+                    table_opt.CatchUpRecords;
+            tbl_ref.NextRecord   = tbl_ref.BackfillEnd;
+            catch_up = true;
+
+            msgstrm << "Collecting newest " << table_opt.CatchUpRecords 
+                    << " records of " << tbl_ref.TblName << " first,"
+                    << " records " << tbl_ref.BackfillNext << "-" 
+                    << tbl_ref.BackfillEnd - 1 << " will be backfilled";
+            Category::getInstance("BMP5").notice(msgstrm.str());
+            msgstrm.str("");
+        }
+    }
+
+    if (tbl_ref.NextRecord > (uint4)last_rec_nbr) {
+        return 0;
+    }
+    return (int)((uint4)last_rec_nbr - tbl_ref.NextRecord + 1);
 }
 
 /**
@@ -620,6 +1815,9 @@ BMP5Obj :: store_data (byte* buf, Table& tbl, int beg, int nrecs,
  * data section. Data packets are parsed using process_data_packet().
  * It calls storeRecord() in turn to actually extract records for the
  * specified table from the byte sequence and write them to disk.
+ * If the last record can be predicted (see predict_last_record), the query
+ * is skipped and the collection starts right away. The logger is queried
+ * only if the first record of the predicted range is unavailable.
  *
  * @param table_opt: Structure containing table name and span information.
  * @param span: Span of datafile in seconds
@@ -633,12 +1831,13 @@ BMP5Obj :: CollectData (const TableOpt& table_opt) throw (AppException, invalid_
     int      last_rec_nbr;
     int      nrecs_read = 0;
     uint4    recs_per_request = 1;
-    int      records_pending;
     uint4    num_collected_recs = 0;
+    bool     catch_up = false;
     stringstream msgstrm;
     RecordStat recordStat;
 
     Table& tbl_ref = tblDataMgr__->getTableRef (table_opt.TableName);
+    tblDataMgr__->setFieldSubset (tbl_ref, table_opt.FieldNames);
     
     record_size = tblDataMgr__->getRecordSize (tbl_ref);
 
@@ -667,115 +1866,17 @@ BMP5Obj :: CollectData (const TableOpt& table_opt) throw (AppException, invalid_
 
     if (tbl_ref.TblSize > 1) {
 
-        int numAttempts = 0;
-        // get the last record number the logger is written in it's memory.
-        while (numAttempts < 3) {
-            recordStat = get_records (tbl_ref, GET_LAST_REC | INQ_REC_INFO,
-                    record_size, 1, 0, table_opt.TableSpan);
-            last_rec_nbr = recordStat.count;
-            if (last_rec_nbr >= 0) {
-                break;
-            }
-        }
-
-        // The data can't be collected if the last record number is unavailable.
-        if (last_rec_nbr < 0) {
-            string err("Failed to retrieve information about last record stored in [");
-            err.append(tbl_ref.TblName)
-                  .append("] on datalogger memory");
-            Category::getInstance("BMP5")
-                     .error(err);
-            return FAILURE;
-        }
+        bool predicted = predict_last_record (tbl_ref, table_opt, 
+                last_rec_nbr);
 
-        // Get the record number to start data collection and the record 
-        // untill which to collect. Table::NextRecord tells us where we need to
-        // start the data collection.
-   
-        msgstrm << "Record Index information :" << endl
-                << "\t\tIndex of last stored record on datalogger memory : " 
-                << last_rec_nbr << endl
-                << "\t\tIndex of next record to collect from datalogger memory : " 
-                << tbl_ref.NextRecord;
-        Category::getInstance("BMP5")
-                 .debug(msgstrm.str());
-        msgstrm.str("");
-         
-        records_pending = (int)(last_rec_nbr-tbl_ref.NextRecord);
-
-        if  (records_pending < 0) {
-
-            time_t t_s = (time_t)tbl_ref.LastRecordTime.sec + SECS_BEFORE_1990;
-            time_t t_c = (time_t)recordStat.recordTime.sec + SECS_BEFORE_1990;
-
-            if (records_pending == -1) {
-                if (0 == nseccmp(tbl_ref.LastRecordTime, recordStat.recordTime)) {
-                    Category::getInstance("BMP5")
-                         .info("No new data is available yet for : " 
-                                + table_opt.TableName);
-                    return SUCCESS;
-                }
-                else {
-                    msgstrm << "Different timestamp found for identical record id\n"
-                            << "\tTimestamp of last stored record on logger : " 
-                            << ctime(&t_s)
-                            << "\tTimestamp of last collected record from logger : " 
-                            << ctime(&t_c);
-                    Category::getInstance("BMP5")
-                             .notice(msgstrm.str());
-                    msgstrm.str("");
-                }
-            }
-            else if (nseccmp(tbl_ref.LastRecordTime, recordStat.recordTime) > 1) {
-                msgstrm << "Backward shift observed in datalogger clock." << endl
-                        << "\tCheck data from table => " << tbl_ref.TblName << endl
-                        << "\tTimestamp of last available data record in datalogger memory"
-                        << "precedes the timestamp of the last collected record" << endl
-                        << "\tNext target record index : " << tbl_ref.NextRecord << endl
-                        << "\tTimestamp of last collected record from datalogger: " 
-                        << ctime(&t_c)
-                        << "\tIndex of last stored record in datalogger memory : " 
-                        << last_rec_nbr << endl
-                        << "\tTimestamp of last stored record in datalogger memory : " 
-                        << ctime(&t_s);
-                Category::getInstance("BMP5")
-                         .warn(msgstrm.str());
-                msgstrm.str("");
-            }
-        } 
-
-        // The following cases need special attention:
-        // 1. The logger has written enough data since the last data collection so
-        //    that the record with ID tbl_ref.NextRecord is wiped from memory. In 
-        //    this case, we need to set the "begin pointer" at the beginning of the
-        //    table.
-        // 2. The data collection downtime can be long enough so that the logger 
-        //    reached the maximum  record id and then started back from 1 again.
-
-        if ((records_pending >= (int)tbl_ref.TblSize) || (records_pending < 0)) {
-
-            msgstrm << "Adjusting start record index to compensate for backlog:\n"
-                    << "\tTable(" << tbl_ref.TblName << ") size: "
-                    << tbl_ref.TblSize << " records" << endl
-                    << "\tLast stored record id : " << last_rec_nbr << endl
-                    << "\tLast collected record id : " << tbl_ref.NextRecord << endl;
-
-            int newIndex = last_rec_nbr - tbl_ref.TblSize + 2;
-      
-            tbl_ref.NextRecord = (newIndex < 0) ? 1 : ((uint4)newIndex);
-
-            msgstrm << "\tAdvancing next collection record to : ";
-            msgstrm << tbl_ref.NextRecord << endl;
-
-            Category::getInstance("BMP5").info(msgstrm.str());
-            msgstrm.str("");
-         
-            // Reset all the history for this Table
-            if (tbl_ref.NewFileTime) {
-                tblDataMgr__->flushTableDataCache(tbl_ref);
+        if (!predicted) {
+            int pending = find_pending_records (tbl_ref, table_opt, 
+                    record_size, last_rec_nbr, catch_up);
+            if (pending <= 0) {
+                return (pending == 0) ? SUCCESS : FAILURE;
             }
         }
-    
+
         // If the temporary data file for this table already exists, 
         // append to it. Else, a new file will be created.
     
@@ -792,10 +1893,54 @@ BMP5Obj :: CollectData (const TableOpt& table_opt) throw (AppException, invalid_
 
         while (tbl_ref.NextRecord <= (uint4) last_rec_nbr) 
         {
-            recordStat = get_records (tbl_ref, GET_DATA_RANGE | STORE_DATA,
+#ifdef PB5_ALLOC_CHECK
+            unsigned long allocs = getAllocationCount ();
+            uint4 file_stamp = tblDataMgr__->getFileStamp (tbl_ref);
+#endif
+            // Records are stored from a predicted range only if they 
+            // follow the last record collected
+            recordStat = get_records (tbl_ref, GET_DATA_RANGE | STORE_DATA |
+                    (predicted ? NEXT_REC_ONLY : 0),
                     record_size, tbl_ref.NextRecord, 
                     tbl_ref.NextRecord + recs_per_request, table_opt.TableSpan);
             nrecs_read = recordStat.count;
+#ifdef PB5_ALLOC_CHECK
+            // Once the first records are stored, collecting more of them
+            // must not allocate memory, unless a new data file was started
+            if (num_collected_recs && (nrecs_read > 0) && 
+                    (file_stamp == tblDataMgr__->getFileStamp (tbl_ref)) && 
+                    (getAllocationCount () != allocs)) {
+                msgstrm << getAllocationCount () - allocs 
+                        << " heap allocations while collecting " << nrecs_read
+                        << " records of " << tbl_ref.TblName;
+                Category::getInstance("BMP5").error(msgstrm.str());
+                abort ();
+            }
+#endif
+
+            if (predicted && (nrecs_read <= 0)) {
+                if (num_collected_recs) {
+                    // The logger is behind the prediction, the rest of 
+                    // the records are collected in the next cycle
+                    nrecs_read = 0;
+                    break;
+                }
+
+                // Missed prediction, query the logger for the last record
+                Category::getInstance("BMP5")
+                         .debug("Predicted record range unavailable for " 
+                                + tbl_ref.TblName);
+                predicted = false;
+                tblDataMgr__->getTableDataWriter()->finishWrite(tbl_ref);
+
+                int pending = find_pending_records (tbl_ref, table_opt, 
+                        record_size, last_rec_nbr, catch_up);
+                if (pending <= 0) {
+                    return (pending == 0) ? SUCCESS : FAILURE;
+                }
+                tblDataMgr__->getTableDataWriter()->initWrite(tbl_ref);
+                continue;
+            }
 
             if (nrecs_read < 0) {
                 break;
@@ -817,6 +1962,10 @@ BMP5Obj :: CollectData (const TableOpt& table_opt) throw (AppException, invalid_
                              .error(msgstrm.str());
                     msgstrm.str("");
  
+                    // Listed to retry in RetryGaps
+                    addRecordGap (tbl_ref.Gaps, tbl_ref.NextRecord, 0);
+                    reportMetric ("records_skipped", tbl_ref.TblName, 1);
+
                     tbl_ref.NextRecord += 1;
                     msgstrm << "Advancing collection to record index : "
                             << tbl_ref.NextRecord;
@@ -864,6 +2013,11 @@ BMP5Obj :: CollectData (const TableOpt& table_opt) throw (AppException, invalid_
             tblDataMgr__->flushTableDataCache(tbl_ref);
         }
     }
+
+    // Publish the newest records without waiting for the file span to end
+    if (catch_up && tbl_ref.NewFileTime) {
+        tblDataMgr__->flushTableDataCache(tbl_ref);
+    }
     
     // A negative nrecs_read indicates some sort of error in data collection
     if (nrecs_read >= 0) {
@@ -874,6 +2028,370 @@ BMP5Obj :: CollectData (const TableOpt& table_opt) throw (AppException, invalid_
     }
 }
 
+/**
+ * Function to collect the older records that were skipped when CollectData
+ * caught up with the newest records of a table first (see 
+ * TableOpt::CatchUpRecords). It is meant to be called after the current 
+ * data of all the tables has been collected. The records are stored in a
+ * separate set of data files, named with BACKFILL_FILE_TAG following the 
+ * table name, which are rotated on the file span like the regular files 
+ * and published at the end of every call. The records that are no longer 
+ * available on the logger are skipped. The range left to backfill is saved
+ * with the table history, so an interrupted backfill is resumed from the
+ * last record stored in a published file.
+ *
+ * @param table_opt: Structure containing table name and span information.
+ * @return SUCCESS | FAILURE
+ */
+int 
+BMP5Obj :: BackfillData (const TableOpt& table_opt) throw (AppException, invalid_argument)
+{
+    int      record_size;
+    int      last_rec_nbr;
+    int      nrecs_read = 0;
+    uint4    recs_per_request = 1;
+    uint4    num_collected_recs = 0;
+    uint4    oldest;
+    bool     comm_error = false;
+    stringstream msgstrm;
+    RecordStat recordStat;
+
+    Table& tbl_ref = tblDataMgr__->getTableRef (table_opt.TableName);
+
+    if (tbl_ref.BackfillNext >= tbl_ref.BackfillEnd) {
+        return SUCCESS;
+    }
+
+    record_size = tblDataMgr__->getRecordSize (tbl_ref);
+    if ((record_size > 0) && (record_size < 512)) {
+        recs_per_request = (uint4) (512/record_size);
+    }
+
+    recordStat = get_records (tbl_ref, GET_LAST_REC | INQ_REC_INFO,
+            record_size, 1, 0, table_opt.TableSpan);
+    last_rec_nbr = recordStat.count;
+
+    if (last_rec_nbr < 0) {
+        Category::getInstance("BMP5")
+                 .error("Failed to retrieve last record information for backfill of " 
+                        + tbl_ref.TblName);
+        return FAILURE;
+    }
+
+    // The logger was reset or the table ring wrapped around since the 
+    // range was recorded, drop the records that are gone.
+
+    oldest = ((uint4)last_rec_nbr + 1 > tbl_ref.TblSize) ? 
+            ((uint4)last_rec_nbr + 1 - tbl_ref.TblSize) : 0;
+
+    if ((uint4)last_rec_nbr + 1 < tbl_ref.BackfillEnd) {
+        oldest = tbl_ref.BackfillEnd;
+    }
+
+    if (tbl_ref.BackfillNext < oldest) {
+        msgstrm << "Records " << tbl_ref.BackfillNext << "-" 
+                << min(oldest, tbl_ref.BackfillEnd) - 1 << " of " 
+                << tbl_ref.TblName << " are no longer available for backfill";
+        Category::getInstance("BMP5").warn(msgstrm.str());
+        msgstrm.str("");
+        tbl_ref.BackfillNext = min(oldest, tbl_ref.BackfillEnd);
+    }
+
+    // The backfill works on a copy of the table, so that the state of the
+    // data file with the current records is left untouched. A new file is
+    // started on every call, which discards records written to it by an
+    // interrupted call.
+
+    Table bf_tbl (tbl_ref);
+    bf_tbl.FileTag = BACKFILL_FILE_TAG;
+    bf_tbl.NextRecord = tbl_ref.BackfillNext;
+    bf_tbl.NewFileTime = 0;
+    bf_tbl.FirstSampleInFile = 0;
+    bf_tbl.LastRecordTime = NSec();
+    tblDataMgr__->resetQcState(bf_tbl);
+
+    if (bf_tbl.NextRecord < tbl_ref.BackfillEnd) {
+        msgstrm << "Backfilling records " << bf_tbl.NextRecord << "-" 
+                << tbl_ref.BackfillEnd - 1 << " of " << tbl_ref.TblName;
+        Category::getInstance("BMP5").info(msgstrm.str());
+        msgstrm.str("");
+
+        tblDataMgr__->getTableDataWriter()->initWrite(bf_tbl);
+
+        uint4 lastBadRecordIndex = (unsigned int) -1;
+        int countBadRecordCollAttempt = 0;
+
+        try {
+            while (bf_tbl.NextRecord < tbl_ref.BackfillEnd) {
+                recordStat = get_records (bf_tbl, GET_DATA_RANGE | STORE_DATA,
+                        record_size, bf_tbl.NextRecord, 
+                        min(bf_tbl.NextRecord + recs_per_request, 
+                            tbl_ref.BackfillEnd), 
+                        table_opt.TableSpan);
+                nrecs_read = recordStat.count;
+
+                if (nrecs_read < 0) {
+                    break;
+                }
+                else if (nrecs_read == 0) {
+                    if (lastBadRecordIndex != bf_tbl.NextRecord) {
+                        countBadRecordCollAttempt = 1;
+                        lastBadRecordIndex = bf_tbl.NextRecord;
+                    }
+                    else if (++countBadRecordCollAttempt > 2) {
+                        msgstrm << "Failed to collect record with index " 
+                                << bf_tbl.NextRecord << " for backfill";
+                        Category::getInstance("BMP5").error(msgstrm.str());
+                        msgstrm.str("");
+                        addRecordGap (tbl_ref.Gaps, bf_tbl.NextRecord, 0);
+                        reportMetric ("records_skipped", tbl_ref.TblName, 1);
+                        bf_tbl.NextRecord += 1;
+                    }
+                }
+                else {
+                    num_collected_recs += nrecs_read;
+                }
+            }
+        }
+        catch (CommException& ce) {
+            comm_error = true;
+        }
+
+        tblDataMgr__->getTableDataWriter()->finishWrite(bf_tbl);
+        tblDataMgr__->getTableDataWriter()->flush(bf_tbl);
+        tbl_ref.BackfillNext = bf_tbl.NextRecord;
+    }
+
+    msgstrm << "Backfilled " << num_collected_recs << " records of " 
+            << tbl_ref.TblName;
+    Category::getInstance("BMP5").info(msgstrm.str());
+    msgstrm.str("");
+
+    if (tbl_ref.BackfillNext >= tbl_ref.BackfillEnd) {
+        Category::getInstance("BMP5")
+                 .notice("Backfill completed for " + tbl_ref.TblName);
+        tbl_ref.BackfillNext = 0;
+        tbl_ref.BackfillEnd = 0;
+    }
+
+    // Save the progress right away, as the published files can't be 
+    // taken back if the application is interrupted before exiting.
+    tblDataMgr__->saveTableStorageHistory();
+
+    if (comm_error) {
+        throw CommException(__FILE__, __LINE__, 
+                "Communication error during backfill");
+    }
+
+    return (nrecs_read >= 0) ? SUCCESS : FAILURE;
+}
+
+/**
+ * Function to retry collecting the records that were skipped by earlier 
+ * collections (listed in Table::Gaps). It is meant to be called once the 
+ * regular collection is done. The records recovered are stored in a 
+ * separate set of data files named with GAPFILL_FILE_TAG following the 
+ * table name, published at the end of the call. Records that are no 
+ * longer available on the logger, or that still fail after MAX_GAP_RETRIES
+ * calls, are dropped from the list. The number of records recovered, lost
+ * and still missing are reported as metrics.
+ *
+ * @param table_opt: Structure containing table name and span information.
+ * @return SUCCESS | FAILURE
+ */
+int 
+BMP5Obj :: RetryGaps (const TableOpt& table_opt) throw (AppException, invalid_argument)
+{
+    int      record_size;
+    int      last_rec_nbr;
+    uint4    oldest;
+    int      num_recovered = 0;
+    int      num_lost = 0;
+    int      num_missing = 0;
+    bool     comm_error = false;
+    stringstream msgstrm;
+    RecordStat recordStat;
+    map<uint4, RecordGap> gaps;
+    map<uint4, RecordGap>::iterator gap_itr;
+
+    Table& tbl_ref = tblDataMgr__->getTableRef (table_opt.TableName);
+
+    if (tbl_ref.Gaps.empty()) {
+        return SUCCESS;
+    }
+
+    record_size = tblDataMgr__->getRecordSize (tbl_ref);
+
+    recordStat = get_records (tbl_ref, GET_LAST_REC | INQ_REC_INFO,
+            record_size, 1, 0, table_opt.TableSpan);
+    last_rec_nbr = recordStat.count;
+
+    if (last_rec_nbr < 0) {
+        Category::getInstance("BMP5")
+                 .error("Failed to retrieve last record information to retry gaps in " 
+                        + tbl_ref.TblName);
+        return FAILURE;
+    }
+
+    oldest = ((uint4)last_rec_nbr + 1 > tbl_ref.TblSize) ? 
+            ((uint4)last_rec_nbr + 1 - tbl_ref.TblSize) : 0;
+
+    // The records are stored through a copy of the table, so that the state
+    // of the data file with the current records is left untouched.
+
+    Table gf_tbl (tbl_ref);
+    gf_tbl.FileTag = GAPFILL_FILE_TAG;
+    gf_tbl.NewFileTime = 0;
+    gf_tbl.FirstSampleInFile = 0;
+    gf_tbl.LastRecordTime = NSec();
+    tblDataMgr__->resetQcState(gf_tbl);
+
+    bool file_open = false;
+
+    for (gap_itr = tbl_ref.Gaps.begin(); gap_itr != tbl_ref.Gaps.end(); 
+            gap_itr++) {
+        uint4 first = gap_itr->first;
+        uint4 last  = gap_itr->second.LastRecord;
+
+        // Records overwritten since, or gone with a reset of the logger
+        if ((last < oldest) || (last > (uint4)last_rec_nbr)) {
+            num_lost += last - first + 1;
+            continue;
+        }
+        if (first < oldest) {
+            num_lost += oldest - first;
+            first = oldest;
+        }
+
+        // The rest of the gaps are kept as they are after a link failure
+        if (comm_error) {
+            gaps[first] = gap_itr->second;
+            continue;
+        }
+
+        for (uint4 rec_nbr = first; rec_nbr <= last; rec_nbr++) {
+            int nrecs_read = -1;
+
+            if (!comm_error) {
+                try {
+                    if (!file_open) {
+                        tblDataMgr__->getTableDataWriter()->initWrite(gf_tbl);
+                        file_open = true;
+                    }
+                    gf_tbl.NextRecord = rec_nbr;
+                    recordStat = get_records (gf_tbl, GET_DATA_RANGE | STORE_DATA,
+                            record_size, rec_nbr, rec_nbr + 1, table_opt.TableSpan);
+                    nrecs_read = recordStat.count;
+                }
+                catch (CommException& ce) {
+                    comm_error = true;
+                }
+            }
+
+            if (nrecs_read > 0) {
+                num_recovered++;
+            }
+            else if (comm_error) {
+                addRecordGap (gaps, rec_nbr, gap_itr->second.Attempts);
+            }
+            else if (gap_itr->second.Attempts + 1 >= MAX_GAP_RETRIES) {
+                msgstrm << "Giving up on record " << rec_nbr << " of " 
+                        << tbl_ref.TblName << " after " << MAX_GAP_RETRIES 
+                        << " attempts";
+                Category::getInstance("BMP5").error(msgstrm.str());
+                msgstrm.str("");
+                num_lost++;
+            }
+            else {
+                addRecordGap (gaps, rec_nbr, gap_itr->second.Attempts + 1);
+            }
+        }
+    }
+
+    if (file_open) {
+        tblDataMgr__->getTableDataWriter()->finishWrite(gf_tbl);
+        tblDataMgr__->getTableDataWriter()->flush(gf_tbl);
+    }
+
+    tbl_ref.Gaps = gaps;
+    for (gap_itr = gaps.begin(); gap_itr != gaps.end(); gap_itr++) {
+        num_missing += gap_itr->second.LastRecord - gap_itr->first + 1;
+    }
+
+    msgstrm << "Recovered " << num_recovered << " skipped records of " 
+            << tbl_ref.TblName << ", " << num_missing << " still missing, "
+            << num_lost << " lost";
+    Category::getInstance("BMP5").info(msgstrm.str());
+    msgstrm.str("");
+
+    reportMetric ("records_recovered", tbl_ref.TblName, num_recovered);
+    reportMetric ("records_lost", tbl_ref.TblName, num_lost);
+    reportMetric ("record_gaps", tbl_ref.TblName, num_missing);
+
+    tblDataMgr__->saveTableStorageHistory();
+
+    if (comm_error) {
+        throw CommException(__FILE__, __LINE__, 
+                "Communication error while retrying record gaps");
+    }
+    return SUCCESS;
+}
+
+/**
+ * Function to collect the latest record of a table, for tables polled 
+ * frequently to follow the measurements as they are made. The last record
+ * is requested (GET_LAST_REC with a count of 1) and stored only if it is 
+ * the one following the last record collected. A record collected already
+ * is skipped. If records were missed since the last poll, the collection
+ * falls back to CollectData, which collects all the pending records.
+ *
+ * @param table_opt: Structure containing table name and span information.
+ * @return Number of records collected, -1 on failure.
+ */
+int 
+BMP5Obj :: TailData (const TableOpt& table_opt) throw (AppException, invalid_argument)
+{
+    RecordStat recordStat;
+    stringstream msgstrm;
+
+    Table& tbl_ref = tblDataMgr__->getTableRef (table_opt.TableName);
+
+    // The record numbers are not tracked for tables of unknown size, and
+    // a table never collected before needs locating the start record.
+    if ((tbl_ref.TblSize <= 1) || (0 == tbl_ref.LastRecordTime.sec)) {
+        return (CollectData (table_opt) == SUCCESS) ? 0 : -1;
+    }
+
+    tblDataMgr__->setFieldSubset (tbl_ref, table_opt.FieldNames);
+    int record_size = tblDataMgr__->getRecordSize (tbl_ref);
+
+    tblDataMgr__->getTableDataWriter()->initWrite(tbl_ref);
+    recordStat = get_records (tbl_ref, 
+            GET_LAST_REC | STORE_DATA | NEXT_REC_ONLY, record_size, 1, 0, 
+            table_opt.TableSpan);
+    tblDataMgr__->getTableDataWriter()->finishWrite(tbl_ref);
+
+    if (recordStat.count != 0) {
+        return recordStat.count;
+    }
+
+    if ((recordStat.recordNbr > tbl_ref.NextRecord) && 
+            (recordStat.recordNbr != 0xffffffff)) {
+        msgstrm << "Collecting records " << tbl_ref.NextRecord << "-" 
+                << recordStat.recordNbr << " of " << tbl_ref.TblName
+                << " missed while polling";
+        Category::getInstance("BMP5").info(msgstrm.str());
+        msgstrm.str("");
+
+        uint4 next_record = tbl_ref.NextRecord;
+        if (CollectData (table_opt) != SUCCESS) {
+            return -1;
+        }
+        return (int)(tbl_ref.NextRecord - next_record);
+    }
+    return 0;
+}
+
 /**
  * Function for sending a message to administer tables on the datalogger.
  * @param ctrl_opt: 0x01 (Reset the table and trash existing records)\n 
@@ -1002,6 +2520,255 @@ BMP5Obj :: ControlFile (const string& file_name, byte cmd)
     }
 } 
 
+/**
+ * Function to read the values of variables from a table on the logger 
+ * (usually the Public table) using Get Values transactions. One 
+ * transaction is carried out per entry, for Swath consecutive elements
+ * starting from the named field. Up to MaxPendingRequests transactions 
+ * are sent back to back before waiting for the responses, so that a batch
+ * of values costs about one round trip per window.
+ *
+ * @param values: List of variables to read. The Values and RespCode
+ *                members are set from the responses.
+ * @return SUCCESS if all the values were read, FAILURE otherwise.
+ */
+int 
+BMP5Obj :: GetValues (vector<LoggerValue>& values) throw (CommException)
+{
+    return values_transaction (0x1a, values);
+}
+
+/**
+ * Function to write the values of variables in a table on the logger 
+ * (usually the Public table) using Set Values transactions. The 
+ * transactions are batched the same way as in GetValues.
+ *
+ * @param values: List of variables to write, each with Swath values. The 
+ *                RespCode members are set from the responses.
+ * @return SUCCESS if all the values were written, FAILURE otherwise.
+ */
+int 
+BMP5Obj :: SetValues (vector<LoggerValue>& values) throw (CommException)
+{
+    return values_transaction (0x1b, values);
+}
+
+/**
+ * Function to read a single value from a table on the logger.
+ * @param table_name: Name of the table, i.e. Public.
+ * @param field_name: Name of the variable, with the array index if any.
+ * @param value: Set to the value read from the logger.
+ * @return SUCCESS | FAILURE
+ */
+int 
+BMP5Obj :: GetValue (const string& table_name, const string& field_name,
+        float& value) throw (CommException)
+{
+    vector<LoggerValue> values(1);
+    values[0].TableName = table_name;
+    values[0].FieldName = field_name;
+
+    if (values_transaction (0x1a, values) == SUCCESS) {
+        value = values[0].Values[0];
+        return SUCCESS;
+    }
+    return FAILURE;
+}
+
+/**
+ * Function to write a single value to a table on the logger.
+ * @param table_name: Name of the table, i.e. Public.
+ * @param field_name: Name of the variable, with the array index if any.
+ * @param value: Value to write.
+ * @return SUCCESS | FAILURE
+ */
+int 
+BMP5Obj :: SetValue (const string& table_name, const string& field_name,
+        float value) throw (CommException)
+{
+    vector<LoggerValue> values(1);
+    values[0].TableName = table_name;
+    values[0].FieldName = field_name;
+    values[0].Values.push_back(value);
+
+    return values_transaction (0x1b, values);
+}
+
+/**
+ * Function to build the message body of a Get Values (0x1a) or Set Values 
+ * (0x1b) command for a variable.
+ * @return SUCCESS, or FAILURE if the request doesn't fit in a packet.
+ */
+int 
+BMP5Obj :: build_values_msg (byte msg_type, const LoggerValue& value)
+{
+    int tbl_len = value.TableName.size();
+    int fld_len = value.FieldName.size();
+    int len = tbl_len + fld_len + 7;
+
+    if (msg_type == 0x1b) {
+        len += 4 * value.Swath;
+    }
+    if ((value.Swath == 0) || (value.Swath > MAX_VALUES_SWATH) || 
+            (len > MAX_MSG_BODY_LEN) || 
+            ((msg_type == 0x1b) && (value.Values.size() < value.Swath))) {
+        return FAILURE;
+    }
+
+    Priority__   = 0x02;
+    MsgType__    = msg_type;
+    MsgBodyLen__ = len;
+
+    SetSecurityCodeInMsgBody();
+    byte* ptr = MsgBody__ + 2;
+    memcpy (ptr, value.TableName.c_str(), tbl_len + 1);
+    ptr += tbl_len + 1;
+    *ptr++ = VALUES_DATA_TYPE;
+    memcpy (ptr, value.FieldName.c_str(), fld_len + 1);
+    ptr += fld_len + 1;
+    PBSerialize (ptr, value.Swath, 2);
+    ptr += 2;
+
+    if (msg_type == 0x1b) {
+        for (int idx = 0; idx < value.Swath; idx++) {
+            PBSerialize (ptr, floatToIntBits (value.Values[idx]), 4);
+            ptr += 4;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * Function carrying out the Get Values or Set Values transactions for a 
+ * list of variables. The requests are sent in windows of MaxPendingRequests
+ * and the responses are matched to the variables using the transaction
+ * number. Requests left without a response are sent again, for up to 
+ * MAX_VALUES_ATTEMPTS rounds.
+ *
+ * @param msg_type: 0x1a (Get Values) or 0x1b (Set Values).
+ * @param values: List of variables to read or write.
+ * @return SUCCESS if the logger completed all the requests, FAILURE 
+ * otherwise.
+ */
+int 
+BMP5Obj :: values_transaction (byte msg_type, vector<LoggerValue>& values)
+        throw (CommException)
+{
+    const char* tran_name = (msg_type == 0x1a) ? 
+            "Get Values Transaction" : "Set Values Transaction";
+    int    window = max(1, bmp5Opt__.MaxPendingRequests);
+    int    stat = SUCCESS;
+    int    pack_stat;
+    Packet pack;
+    deque<unsigned int> queued;
+    vector<unsigned int> lost;
+    map<byte, unsigned int> pending;
+    map<byte, unsigned int>::iterator pending_itr;
+    stringstream msgstrm;
+
+    for (unsigned int idx = 0; idx < values.size(); idx++) {
+        values[idx].RespCode = 0xff;
+        queued.push_back(idx);
+    }
+
+    for (int num_attempts = 0; (num_attempts < MAX_VALUES_ATTEMPTS) && 
+            queued.size(); num_attempts++) {
+        lost.clear();
+
+        while (queued.size()) {
+            pending.clear();
+            try {
+                while (queued.size() && ((int)pending.size() < window)) {
+                    unsigned int idx = queued.front();
+                    queued.pop_front();
+                    if (build_values_msg (msg_type, values[idx]) == FAILURE) {
+                        msgstrm << "Invalid request for " << values[idx].TableName
+                                << "." << values[idx].FieldName << " (swath "
+                                << values[idx].Swath << ")";
+                        Category::getInstance("BMP5").error(msgstrm.str());
+                        msgstrm.str("");
+                        continue;
+                    }
+                    byte tran_id = GenTranNbr();
+                    SendPBPacket();
+                    pending[tran_id] = idx;
+                }
+                if (pending.empty()) {
+                    break;
+                }
+                pbuf__->readFromDevice();
+            }
+            catch (CommException& ce) {
+                Category::getInstance("BMP5")
+                         .error(string("Communication error during ") + tran_name);
+                throw;
+            }
+
+            while (packetQueue__->size()) {
+                pack = packetQueue__->front();
+                pending_itr = pending.find(get_tran_nbr(pack));
+                byte tran_id = (pending_itr != pending.end()) ? 
+                        pending_itr->first : TranNbr__;
+
+                if ((pack_stat = ParsePakBusPacket (pack, msg_type | 0x80, 
+                        tran_id)) || (pending_itr == pending.end())) {
+                    PacketErr (tran_name, pack, pack_stat);
+                    packetQueue__->pop_front ();
+                    continue;
+                }
+
+                LoggerValue& value = values[pending_itr->second];
+                value.RespCode = (byte)*(pack.begPacket + 11);
+
+                if ((msg_type == 0x1a) && (value.RespCode == 0x00)) {
+                    byte* ptr = (byte *)(pack.begPacket + 12);
+                    if (pack.endPacket - (char *)ptr - 2 < 4 * value.Swath) {
+                        PacketErr (tran_name, pack, FAILURE);
+                        value.RespCode = 0xff;
+                    }
+                    else {
+                        value.Values.resize(value.Swath);
+                        for (int idx = 0; idx < value.Swath; idx++) {
+                            value.Values[idx] = intBitsToFloat (
+                                    PBDeserialize (ptr, 4));
+                            ptr += 4;
+                        }
+                    }
+                }
+                pending.erase(pending_itr);
+                packetQueue__->pop_front ();
+            }
+
+            for (pending_itr = pending.begin(); pending_itr != pending.end();
+                    pending_itr++) {
+                lost.push_back(pending_itr->second);
+            }
+        }
+        queued.assign(lost.begin(), lost.end());
+    }
+
+    for (unsigned int idx = 0; idx < values.size(); idx++) {
+        const LoggerValue& value = values[idx];
+        if (value.RespCode == 0x00) {
+            continue;
+        }
+        stat = FAILURE;
+        msgstrm << tran_name << " failed for " << value.TableName << "." 
+                << value.FieldName << " : ";
+        switch (value.RespCode) {
+            case 0x01 : msgstrm << "Permission denied"; break;
+            case 0x10 : msgstrm << "Invalid table or field name"; break;
+            case 0x11 : msgstrm << "Data type conversion not supported"; break;
+            case 0x12 : msgstrm << "Memory bounds violation"; break;
+            case 0xff : msgstrm << "No response"; break;
+            default   : msgstrm << "Response code " << byte2int(value.RespCode);
+        }
+        Category::getInstance("BMP5").warn(msgstrm.str());
+        msgstrm.str("");
+    }
+    return stat;
+}
+
 /**
  * Function to retrieve available status information from the datalogger.
  * This function retrieves information about the datalogger, its operating 
@@ -1014,7 +2781,8 @@ BMP5Obj :: ControlFile (const string& file_name, byte cmd)
  * @return Throws AppException on failure;
  */
 void 
-BMP5Obj :: GetProgStats (uint2 security_code) throw (ParseException)
+BMP5Obj :: GetProgStats (uint2 security_code) 
+        throw (IOException, ParseException)
 {
     int         stat;
     DLProgStats prog_stat;
@@ -1109,7 +2877,9 @@ BMP5Obj :: GetProgStats (uint2 security_code) throw (ParseException)
  * @param start_mode: Possible options (GET_LAST_REC|INQ_REC_INFO), 
  *         (GET_LAST_REC|STORE_DATA) or (GET_DATA_RANGE|STORE_DATA). The 
  *         constants are defined in pakbus.h. Other collection modes proposed
- *         in the PakBus manual are not supported.
+ *         in the PakBus manual are not supported. With NEXT_REC_ONLY added
+ *         to STORE_DATA, the record is stored only if it is the one 
+ *         following the last collected record (Table::NextRecord).
  * @param record_size: Size of the record to collect. 
  * @param P1, P2: If collecting in GET_LAST_REC mode, they would be 1 and 0. 
  *         Else, P1 and P2 would refer to range of records to collect. It is
@@ -1121,6 +2891,8 @@ BMP5Obj :: GetProgStats (uint2 security_code) throw (ParseException)
  *         member is set to -1 on failure. 
  *         If using GET_LAST_REC, count returns the last record number.
  *         For GET_DATA_RANGE this returns the number of collected records.
+ *         The recordNbr member is set to the number of the first record
+ *         returned in the last query exchange.
  */
 RecordStat 
 BMP5Obj :: get_records (Table& tbl_ref, byte start_mode, int record_size, 
@@ -1131,12 +2903,11 @@ BMP5Obj :: get_records (Table& tbl_ref, byte start_mode, int record_size,
     uint4  byte_offset;
     byte   collect_mode = start_mode & 0x0f;
     byte   store_mode   = start_mode & STORE_DATA;
-    int    data_len = 0;
     byte   frag_record = 0;
     uint2  num_recs = 0;
     Packet pack;
     int    pack_data_len;
-    bool   pending = false;
+    bool   frag_pending = false;
     int    stat = SUCCESS;
     int    pack_stat;
     stringstream msgstrm;
@@ -1151,132 +2922,389 @@ BMP5Obj :: get_records (Table& tbl_ref, byte start_mode, int record_size,
         return recordStat;
     }
 
-    do {
-        byte tran_id = GenTranNbr();
+    byte tran_id = GenTranNbr();
+    try {
+        sendCollectionCmd (collect_mode, tbl_ref, P1, P2); 
+        pbuf__->readFromDevice();
+    } 
+    catch (CommException& ce) {
+        Category::getInstance("BMP5")
+                 .error("Communication error during collect transaction");
+        throw;
+    }
+    
+    while (packetQueue__->size()) {
+        pack = packetQueue__->front();
+
+        if ((pack_stat = ParsePakBusPacket (pack, 0x89, tran_id))) {
+            stat = ((pack_stat == FAILURE)||((pack_stat & 0x0b) == 0x0b)) 
+                    ? FAILURE:SUCCESS;
+            PacketErr ("get_record::ParsePakBusPacket", pack, pack_stat);
+            packetQueue__->pop_front();
+            continue;
+        }
+
+        /* Check the data packets for problems typical with a data
+         * packet */
+        if ((stat = test_data_packet (tbl_ref, pack))) {
+            PacketErr ("get_record::test_data_packet", pack, stat);
+            packetQueue__->pop_front();
+            continue;
+        }
+
+        /* Obtain the beginning record number and determine if the 
+         * data packet contains a fragmented record */
+        beg_rec_nbr = PBDeserialize ((byte *)(pack.begPacket+14), 4);
+        frag_record = ( (*(pack.begPacket+18) & 0x80) >> 7 );
+        
+         /* Get the time of the first record */
+        if (frag_record) {
+            beg_rec_time = parseRecordTime((byte *)(pack.begPacket+22));
+        }
+        else {
+            beg_rec_time = parseRecordTime((byte *)(pack.begPacket+20));
+        }
+
+        // Any other record is only reported, as it was either collected
+        // already or would leave a gap
+        if (store_mode && (start_mode & NEXT_REC_ONLY) && 
+                (beg_rec_nbr != tbl_ref.NextRecord)) {
+            store_mode = 0;
+        }
+
+        if (frag_record) {
+            // Only the first fragment is needed to learn about the record
+            // number and time, so the rest of the record is fetched only
+            // when the data is to be stored.
+            if (store_mode) {
+                byte_offset =  PBDeserialize ((byte *)(pack.begPacket+18), 4);
+                byte_offset &= 0x7fffffff; 
+                pack_data_len = (pack.endPacket-4) - (pack.begPacket+30) + 1;
+
+                RecordFragmentBuffer& frag_buf = fragBuffers__[tbl_ref.TblNum];
+                frag_buf.reset (beg_rec_nbr, record_size, 
+                        (record_size > 0) ? record_size : max (BMP5_BUFLEN,
+                        tblDataMgr__->getRecordSizeLimit (tbl_ref)));
+
+                if (frag_buf.addFragment (beg_rec_nbr, byte_offset, 
+                        (byte *)(pack.begPacket+22), pack_data_len) 
+                        == FRAG_OVERFLOW) {
+                    stat = FAILURE;
+                }
+                else {
+                    frag_pending = true;
+                }
+            }
+        }
+        else {
+            // We are not dealing with a fragmented record
+            if (store_mode) {
+                num_recs = (uint2) PBDeserialize ((byte *)(pack.begPacket+18), 2);
+                num_recs &= 0x7fff;
+                stat = store_data ((byte *)(pack.begPacket+20), tbl_ref, 
+                           beg_rec_nbr, num_recs, span);
+            }
+        }
+
+        packetQueue__->pop_front();
+    }
+
+    // The remaining fragments are fetched only after the packet queue 
+    // holding the response to the collect command has been drained, since
+    // the I/O buffer gets reused for the following exchanges.
+
+    if (frag_pending && (stat == SUCCESS)) {
+        RecordFragmentBuffer& frag_buf = fragBuffers__[tbl_ref.TblNum];
+        stat = get_record_fragments (tbl_ref, frag_buf);
+        if (stat == SUCCESS) {
+            stat = store_data (frag_buf.getData(), tbl_ref, beg_rec_nbr, 1, span); 
+            if (SUCCESS == stat) {
+                num_recs = 1;
+            }
+        }
+    }
+
+    if (stat != SUCCESS) {
+        return recordStat;
+    }
+
+    recordStat.recordNbr = beg_rec_nbr;
+
+    if (store_mode) {
+        recordStat.count = frag_record ? 1 : num_recs;
+    }
+    else if (start_mode & STORE_DATA) {
+        recordStat.count = 0;
+        recordStat.recordTime = beg_rec_time; 
+    }
+    else {
+        recordStat.count = beg_rec_nbr;
+        recordStat.recordTime = beg_rec_time; 
+    }
+
+    return recordStat;
+}
+
+/**
+ * Function to fetch the remaining fragments of a record that is too large
+ * to fit in a single packet, once the first fragment has been received. 
+ * For records of known size, up to MaxPendingRequests partial record 
+ * requests (collection mode 0x08) are sent back to back for the missing byte
+ * offsets before waiting for the responses, and the responses are matched 
+ * to the requests using the transaction number. The fragments are stored 
+ * in the reassembly buffer regardless of the order they arrive in. Records
+ * with variable length fields are fetched one fragment at a time, as the 
+ * end of the record can only be recognized by a short fragment.
+ *
+ * @param tbl_ref: Reference to the Table structure the record belongs to.
+ * @param frag_buf: Reassembly buffer holding the fragments received so far.
+ * @return SUCCESS if the record was completely received, FAILURE otherwise.
+ */
+int
+BMP5Obj :: get_record_fragments (Table& tbl_ref, RecordFragmentBuffer& frag_buf)
+{
+    uint4  rec_nbr = frag_buf.getRecordNbr();
+    int    record_size = tblDataMgr__->getRecordSize (tbl_ref);
+    int    window = (record_size > 0) ? bmp5Opt__.MaxPendingRequests : 1;
+    int    num_attempts = 0;
+    int    pack_stat;
+    Packet pack;
+    map<byte, uint4> pending;
+    map<byte, uint4>::iterator pending_itr;
+    stringstream msgstrm;
+
+    while (!frag_buf.isComplete()) {
+
+        if (num_attempts == MAX_FRAG_REQ_ATTEMPTS) {
+            msgstrm << "Failed to collect all fragments of record " << rec_nbr
+                    << " from " << tbl_ref.TblName;
+            Category::getInstance("BMP5").warn(msgstrm.str());
+            return FAILURE;
+        }
+
+        // Request the missing byte ranges, assuming that the logger will 
+        // return fragments of the same size as the largest one seen so far.
+
+        pending.clear();
+        uint4 offset = frag_buf.getMissingOffset(0);
+        int   step   = frag_buf.getFragmentSize();
+
         try {
-            sendCollectionCmd (collect_mode, tbl_ref, P1, P2); 
+            for (int count = 0; count < window; count++) {
+                if ((record_size > 0) && (offset >= (uint4)record_size)) {
+                    break;
+                }
+                byte tran_id = GenTranNbr();
+                sendCollectionCmd (0x08, tbl_ref, rec_nbr, offset);
+                pending[tran_id] = offset;
+                offset = frag_buf.getMissingOffset(offset + step);
+            }
             pbuf__->readFromDevice();
-        } 
+        }
         catch (CommException& ce) {
             Category::getInstance("BMP5")
-                     .error("Communication error during collect transaction");
+                     .error("Communication error while collecting record fragments");
             throw;
         }
-        
+
+        bool progress = false;
+
         while (packetQueue__->size()) {
             pack = packetQueue__->front();
+            pending_itr = pending.find(get_tran_nbr(pack));
 
-            if ((pack_stat = ParsePakBusPacket (pack, 0x89, tran_id))) {
-                stat = ((pack_stat == FAILURE)||((pack_stat & 0x0b) == 0x0b)) 
-                        ? FAILURE:SUCCESS;
-                PacketErr ("get_record::ParsePakBusPacket", pack, pack_stat);
+            // Packets that do not belong to any of the outstanding requests
+            // are still parsed so that hello messages etc. are handled.
+            byte tran_id = (pending_itr != pending.end()) ? 
+                    pending_itr->first : TranNbr__;
+
+            if ((pack_stat = ParsePakBusPacket (pack, 0x89, tran_id)) ||
+                    (pending_itr == pending.end())) {
+                PacketErr ("get_record_fragments", pack, pack_stat);
                 packetQueue__->pop_front();
                 continue;
             }
 
-            /* Check the data packets for problems typical with a data
-             * packet */
-            if ((stat = test_data_packet (tbl_ref, pack))) {
-                PacketErr ("get_record::test_data_packet", pack, stat);
+            if ((pack_stat = test_data_packet (tbl_ref, pack))) {
+                PacketErr ("get_record_fragments::test_data_packet", pack, 
+                        pack_stat);
                 packetQueue__->pop_front();
                 continue;
             }
 
-            /* Obtain the beginning record number and determine if the 
-             * data packet contains a fragmented record */
-            beg_rec_nbr = PBDeserialize ((byte *)(pack.begPacket+14), 4);
-            frag_record = ( (*(pack.begPacket+18) & 0x80) >> 7 );
-            
-             /* Get the time of the first record */
-            if (frag_record) {
-                beg_rec_time = parseRecordTime((byte *)(pack.begPacket+22));
-            }
-            else {
-                beg_rec_time = parseRecordTime((byte *)(pack.begPacket+20));
+            uint4 frag_rec_nbr = PBDeserialize ((byte *)(pack.begPacket+14), 4);
+            uint4 byte_offset  = PBDeserialize ((byte *)(pack.begPacket+18), 4);
+            int   data_len = (pack.endPacket-4) - (pack.begPacket+30) + 1;
+
+            if (!(byte_offset & 0x80000000)) {
+                // A complete record in response to a partial record request
+                // indicates that the offset was beyond the end of the record
+                packetQueue__->pop_front();
+                continue;
             }
+            byte_offset &= 0x7fffffff;
 
-            if (frag_record) {
-                byte_offset =  PBDeserialize ((byte *)(pack.begPacket+18), 4);
-                byte_offset &= 0x7fffffff; 
-                pack_data_len = (pack.endPacket-4) - (pack.begPacket+30) + 1;
-                // Copy data from the packet to the buffer
-                memcpy ((char*)(dataBuf__+byte_offset), (char*)(pack.begPacket+22), 
-                        pack_data_len); 
-
-                // Set parameters for the next "collect" request
-                collect_mode = 0x08;
-                P1 = beg_rec_nbr;
-                P2 = pack_data_len + byte_offset;
-
-                // In case the data record contains variable length 
-                // fields, I'm assuming that a packet smaller than 512
-                // bytes will indicate that the last data packet for a
-                // record has been received.
-
-                if (record_size == -1) {
-                    if (pack_data_len < 512) {
-                        if (store_mode) {
-                            stat = store_data (dataBuf__, tbl_ref, beg_rec_nbr, 
-                                    1, span); 
-                            if (SUCCESS == stat) {
-                                num_recs = 1;
-                            }
-                        }
-                        pending = false;
-                    }
-                    else {
-                        pending  = true;
-                    }
-                }
-                else {
-                    data_len += pack_data_len; 
-                    if (data_len >= record_size) {
-                        if (store_mode) {
-                            stat = store_data (dataBuf__, tbl_ref, beg_rec_nbr, 
-                                    1, span); 
-                            if (SUCCESS == stat) {
-                                num_recs = 1;
-                            }
-                        }
-                        pending = false;
-                    }
-                    else {
-                        pending = true;
-                    }
-                }
+            int frag_stat = frag_buf.addFragment (frag_rec_nbr, byte_offset,
+                    (byte *)(pack.begPacket+22), data_len);
+
+            if (frag_stat == FRAG_OVERFLOW) {
+                msgstrm << "Rejecting fragment of record " << frag_rec_nbr 
+                        << " from " << tbl_ref.TblName << " at byte offset " 
+                        << byte_offset << " (" << data_len 
+                        << " bytes), exceeds record buffer";
+                Category::getInstance("BMP5").error(msgstrm.str());
+                packetQueue__->pop_front();
+                return FAILURE;
             }
-            else {
-                // We are not dealing with a fragmented record
-                if (store_mode) {
-                    num_recs = (uint2) PBDeserialize ((byte *)(pack.begPacket+18), 2);
-                    num_recs &= 0x7fff;
-                    stat = store_data ((byte *)(pack.begPacket+20), tbl_ref, 
-                               beg_rec_nbr, num_recs, span);
-                }
-                pending = false;
+            else if (frag_stat == FRAG_ACCEPTED) {
+                progress = true;
             }
-
+            pending.erase(pending_itr);
             packetQueue__->pop_front();
         }
 
-        if (stat != SUCCESS) {
-            break;
+        num_attempts = progress ? 0 : (num_attempts + 1);
+    }
+    return SUCCESS;
+}
+
+/////////////////////////////////////////////////////////////////////
+//           Implementation of RecordFragmentBuffer class          //
+/////////////////////////////////////////////////////////////////////
+
+RecordFragmentBuffer :: RecordFragmentBuffer () : recordNbr__(0xffffffff),
+        recordSize__(-1), recordEnd__(-1), fragSize__(0)
+{
+}
+
+/**
+ * Prepare the buffer for reassembling a new record.
+ *
+ * @param record_nbr: Record number of the record to reassemble.
+ * @param record_size: Size of the record in bytes, -1 if the record contains
+ *             variable length fields.
+ * @param capacity: Maximum number of bytes the buffer may hold.
+ */
+void RecordFragmentBuffer :: reset (uint4 record_nbr, int record_size, 
+        int capacity)
+{
+    if ((int)buf__.size() < capacity) {
+        buf__.resize(capacity);
+    }
+    extents__.clear();
+    recordNbr__  = record_nbr;
+    recordSize__ = (record_size > capacity) ? capacity : record_size;
+    recordEnd__  = -1;
+    fragSize__   = 0;
+}
+
+/**
+ * Copy a fragment into the buffer.
+ *
+ * @param record_nbr: Record number that the fragment belongs to.
+ * @param offset: Byte offset of the fragment within the record.
+ * @param data: Pointer to the fragment data.
+ * @param len: Number of bytes in the fragment.
+ * @return FRAG_ACCEPTED if new data was added, FRAG_DUPLICATE if the data 
+ *         was already received, FRAG_STALE if the fragment belongs to a 
+ *         different record and FRAG_OVERFLOW if the fragment doesn't fit
+ *         in the buffer.
+ */
+int RecordFragmentBuffer :: addFragment (uint4 record_nbr, uint4 offset, 
+        const byte* data, int len)
+{
+    if (record_nbr != recordNbr__) {
+        return FRAG_STALE;
+    }
+    if (len <= 0) {
+        // An empty fragment right after the received data marks the end
+        // of a variable length record whose size is a multiple of the 
+        // fragment size.
+        if ((recordSize__ <= 0) && (offset > 0) && 
+                (getMissingOffset(0) == offset)) {
+            recordEnd__ = offset;
+            return FRAG_ACCEPTED;
         }
-    } while (pending);
+        return FRAG_DUPLICATE;
+    }
 
-    if (stat != SUCCESS) {
-        return recordStat;
+    uint4 limit = (recordSize__ > 0) ? (uint4)recordSize__ : (uint4)buf__.size();
+    if ((offset >= limit) || 
+            ((recordSize__ <= 0) && ((uint4)len > (limit - offset)))) {
+        return FRAG_OVERFLOW;
+    }
+    if ((uint4)len > (limit - offset)) {
+        len = limit - offset;
     }
 
-    if (store_mode) {
-        recordStat.count = frag_record ? 1 : num_recs;
+    if (len > fragSize__) {
+        fragSize__ = len;
     }
-    else {
-        recordStat.count = beg_rec_nbr;
-        recordStat.recordTime = beg_rec_time; 
+    else if ((recordSize__ <= 0) && (len < fragSize__)) {
+        // A short fragment marks the end of a variable length record
+        recordEnd__ = offset + len;
     }
 
-    return recordStat;
+    uint4 beg = offset;
+    uint4 end = offset + len;
+
+    if (getMissingOffset(beg) >= end) {
+        return FRAG_DUPLICATE;
+    }
+    memcpy (&buf__[beg], data, len);
+
+    // Merge the new extent with any overlapping or adjacent ones
+
+    map<uint4, uint4>::iterator itr = extents__.upper_bound(beg);
+    if (itr != extents__.begin()) {
+        map<uint4, uint4>::iterator prev = itr;
+        prev--;
+        if (prev->second >= beg) {
+            beg = prev->first;
+            end = max(end, prev->second);
+            extents__.erase(prev);
+        }
+    }
+    while ((itr != extents__.end()) && (itr->first <= end)) {
+        end = max(end, itr->second);
+        extents__.erase(itr++);
+    }
+    extents__[beg] = end;
+    return FRAG_ACCEPTED;
+}
+
+/**
+ * Check if the whole record has been received. For variable length records
+ * the end of the record is known only after a short fragment was received.
+ */
+bool RecordFragmentBuffer :: isComplete () const
+{
+    int target = (recordSize__ > 0) ? recordSize__ : recordEnd__;
+
+    if ((target < 0) || (extents__.size() != 1)) {
+        return false;
+    }
+    map<uint4, uint4>::const_iterator itr = extents__.begin();
+    return ((itr->first == 0) && (itr->second >= (uint4)target));
+}
+
+/**
+ * Find the first byte offset at or after the given offset that hasn't been
+ * received yet.
+ */
+uint4 RecordFragmentBuffer :: getMissingOffset (uint4 from) const
+{
+    map<uint4, uint4>::const_iterator itr;
+
+    for (itr = extents__.begin(); itr != extents__.end(); itr++) {
+        if (itr->first > from) {
+            break;
+        }
+        if (itr->second > from) {
+            from = itr->second;
+        }
+    }
+    return from;
 }
 
 /**
@@ -0,0 +1,249 @@
+/**
+ * @file alloc_check.cpp
+ * Checks that storing collected records makes no heap allocations once
+ * warmed up. Canned responses to Collect Data commands (0x89) are stored
+ * through BMP5Obj::store_data() and TableDataManager::storeRecords(), one
+ * table with records of a fixed size and one with variable length strings.
+ * Built by "make test" with utils.cpp counting the allocations
+ * (PB5_ALLOC_CHECK).
+ */
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string.h>
+#include "pb5.h"
+#include "utils.h"
+using namespace std;
+
+static const int NUM_BATCHES  = 16;  // Batches of records stored per table
+static const int WARMUP       = 2;   // Batches allowed to allocate
+static const int RECS_PER_BATCH = 20;
+static const uint4 FIRST_RECORD = 1000;
+static const uint4 FIRST_TIME   = 1000000000;  // Seconds since 1990
+
+/**
+ * BMP5Obj giving access to the storage of the records of a response.
+ */
+class StoreCheck : public BMP5Obj {
+    public :
+        int store (vector<byte>& resp, Table& tbl)
+        {
+            int nrecs = (int)PBDeserialize (&resp[18], 2);
+            return store_data (&resp[20], tbl, PBDeserialize (&resp[14], 4),
+                    nrecs, 86400);
+        }
+};
+
+static void putString (vector<byte>& buf, const char* str)
+{
+    buf.insert (buf.end(), str, str + strlen(str) + 1);
+}
+
+static void putUint (vector<byte>& buf, uint4 num, int len)
+{
+    for (int count = len - 1; count >= 0; count--) {
+        buf.push_back ((byte)(num >> (8*count)));
+    }
+}
+
+/**
+ * Append a field definition to a table definition.
+ */
+static void putField (vector<byte>& tdf, byte type, const char* name,
+        uint4 dim)
+{
+    tdf.push_back (type);
+    putString (tdf, name);
+    tdf.push_back (0x00);       // No aliases
+    putString (tdf, "Smp");
+    putString (tdf, "units");
+    putString (tdf, "");
+    putUint (tdf, 1, 4);        // BegIdx
+    putUint (tdf, dim, 4);
+    putUint (tdf, dim, 4);      // Sub-dimensions, ending with 0
+    putUint (tdf, 0, 4);
+}
+
+/**
+ * Append a table definition holding one second records.
+ */
+static void putTable (vector<byte>& tdf, const char* name)
+{
+    putString (tdf, name);
+    putUint (tdf, 100000, 4);   // Table size
+    tdf.push_back (0x0e);       // Time type
+    putUint (tdf, 0, 8);        // Time into
+    putUint (tdf, 1, 4);        // Interval
+    putUint (tdf, 0, 4);
+}
+
+/**
+ * Build the response to a Collect Data command, as found in the packet
+ * queue after the sync byte: the PakBus header, the message type, the
+ * transaction number, the response code, the table number, the number of
+ * the first record, the number of records, the time of the first record
+ * and the records.
+ */
+static void buildResponse (vector<byte>& resp, uint2 tbl_nbr, bool var_size,
+        uint4 beg)
+{
+    static const byte header[9] = {
+        0xbd, 0xaf, 0xfe, 0x20, 0x01, 0x1f, 0xfe, 0x00, 0x01 };
+
+    resp.assign (header, header + sizeof(header));
+    resp.push_back (0x89);
+    resp.push_back (0x01);
+    resp.push_back (0x00);
+    putUint (resp, tbl_nbr, 2);
+    putUint (resp, beg, 4);
+    putUint (resp, RECS_PER_BATCH, 2);
+    putUint (resp, FIRST_TIME + beg - FIRST_RECORD, 4);
+    putUint (resp, 0, 4);
+
+    for (uint4 rec = beg; rec < beg + RECS_PER_BATCH; rec++) {
+        if (var_size) {
+            putUint (resp, 0x2000 | (rec & 0x1fff), 2);       // FP2
+            putUint (resp, 0x3f800000 + rec, 4);              // IEEE4
+            putString (resp, (rec % 3) ? "short" : "longer string");
+            continue;
+        }
+        for (int dim = 0; dim < 4; dim++) {
+            putUint (resp, ((rec + dim) % 7) ? (rec & 0x1fff) : 0x9ffe, 2);
+        }
+        putUint (resp, (rec % 5) ? 0x3f800000 : 0x7fc00000, 4);
+        putUint (resp, rec, 4);                               // UINT4
+        putUint (resp, (uint4)-(int)rec, 4);                  // INT4
+        resp.push_back ((byte)(rec & 1));                     // Bool
+        const char* str = (rec % 2) ? "abc" : "abcdefg";
+        for (unsigned int idx = 0; idx < 8; idx++) {          // ASCII(8)
+            resp.push_back ((idx < strlen(str)) ? str[idx] : 0);
+        }
+        putUint (resp, FIRST_TIME + rec, 4);                  // NSec
+        putUint (resp, 0, 4);
+    }
+}
+
+/**
+ * Store the canned batches of records of a table, counting the heap
+ * allocations of each batch once warmed up. A batch starting a new data
+ * file may allocate.
+ * @return Number of batches found allocating.
+ */
+static int checkTable (TableDataManager& tdm, StoreCheck& bmp5,
+        const string& name, bool var_size)
+{
+    Table& tbl = tdm.getTableRef (name);
+    vector< vector<byte> > responses (NUM_BATCHES);
+    int errors = 0;
+    int checked = 0;
+
+    for (int batch = 0; batch < NUM_BATCHES; batch++) {
+        buildResponse (responses[batch], tbl.TblNum, var_size,
+                FIRST_RECORD + batch*RECS_PER_BATCH);
+    }
+
+    tbl.NextRecord = FIRST_RECORD;
+    tdm.getTableDataWriter()->initWrite (tbl);
+
+    for (int batch = 0; batch < NUM_BATCHES; batch++) {
+        uint4 file_stamp = tdm.getFileStamp (tbl);
+        unsigned long allocs = getAllocationCount ();
+
+        if (bmp5.store (responses[batch], tbl) != SUCCESS) {
+            cout << "alloc_check: failed to store batch " << batch
+                 << " of " << name << endl;
+            errors++;
+            continue;
+        }
+        allocs = getAllocationCount () - allocs;
+
+        if ((batch < WARMUP) || (file_stamp != tdm.getFileStamp (tbl))) {
+            continue;
+        }
+        checked++;
+        if (allocs) {
+            cout << "alloc_check: " << allocs << " heap allocations while "
+                 << "storing batch " << batch << " of " << name << endl;
+            errors++;
+        }
+    }
+    tdm.getTableDataWriter()->finishWrite (tbl);
+
+    if (tbl.NextRecord != FIRST_RECORD + NUM_BATCHES*RECS_PER_BATCH) {
+        cout << "alloc_check: " << name << " stopped at record "
+             << tbl.NextRecord << endl;
+        errors++;
+    }
+    if (checked < NUM_BATCHES/2) {
+        cout << "alloc_check: only " << checked << " batches of " << name
+             << " checked" << endl;
+        errors++;
+    }
+    return errors;
+}
+
+int main (int argc, char* argv[])
+{
+    if (argc != 2) {
+        cout << "Usage: alloc_check <working path>" << endl;
+        return 2;
+    }
+
+    vector<byte> tdf;
+    tdf.push_back (0x01);       // FSL version
+
+    putTable (tdf, "Fixed");
+    putField (tdf, 7, "fp2", 4);
+    putField (tdf, 9, "ieee4", 1);
+    putField (tdf, 3, "uint4", 1);
+    putField (tdf, 6, "int4", 1);
+    putField (tdf, 10, "bool", 1);
+    putField (tdf, 11, "ascii", 8);
+    putField (tdf, 14, "nsec", 1);
+    tdf.push_back (0x00);
+
+    putTable (tdf, "Variable");
+    putField (tdf, 7, "fp2", 1);
+    putField (tdf, 9, "ieee4", 1);
+    putField (tdf, 16, "string", 16);
+    tdf.push_back (0x00);
+
+    string working_path = argv[1];
+    ofstream tdf_fs ((working_path + "/.working/tdf.dat").c_str(),
+            ios_base::out | ios_base::binary);
+    tdf_fs.write ((const char *)&tdf[0], tdf.size());
+    tdf_fs.close();
+
+    // The QC checks are applied while the records are stored
+    DataOutputConfig data_opt;
+    data_opt.WorkingPath = working_path;
+    QcRule rule;
+    rule.TableName = "Fixed";
+    rule.FieldName = "fp2";
+    rule.Checks = QC_BELOW_MIN | QC_ABOVE_MAX | QC_STEP | QC_STUCK;
+    rule.Min = 100;
+    rule.Max = 5000;
+    rule.MaxStep = 10;
+    rule.StuckRecords = 3;
+    data_opt.QcRules.push_back (rule);
+
+    TableDataManager tdm;
+    tdm.setDataOutputConfig (data_opt);
+    if (tdm.BuildTDF () != SUCCESS) {
+        cout << "alloc_check: failed to load the table definitions" << endl;
+        return 1;
+    }
+
+    StoreCheck bmp5;
+    bmp5.setTableDataManager (&tdm);
+
+    int errors = checkTable (tdm, bmp5, "Fixed", false) +
+            checkTable (tdm, bmp5, "Variable", true);
+
+    if (errors) {
+        cout << "alloc_check: " << errors << " failures" << endl;
+        return 1;
+    }
+    cout << "alloc_check: no heap allocations while storing records" << endl;
+    return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file fp2_check.cpp
+ * Checks the decoding of 2-byte final storage numbers (FP2) over all the
+ * 65536 codes, comparing the scalar, per sample and array decoders bit
+ * for bit with a reference. Built by "make test" with and without SSSE3
+ * on x86, so both paths of decodeFinalStorageFloats() are covered.
+ */
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include "pb5.h"
+#include "pb5_decode.h"
+using namespace std;
+
+static const uint4 NUM_CODES = 65536;
+
+/**
+ * Reference decoding of a FP2 code: a sign bit, two bits for the position
+ * of the decimal point and a 13-bit magnitude. Magnitudes above 6999, the
+ * +Inf (0x1fff), -Inf (0x9fff) and NaN (0x9ffe) codes included, decode to
+ * -9999.
+ */
+static float referenceFp2 (uint2 code)
+{
+    static const float divisor[4] = { 1.0f, 10.0f, 100.0f, 1000.0f };
+    float mag = (float)(code & 0x1fff) / divisor[(code >> 13) & 0x03];
+
+    if (mag > 6999.0f) {
+        return -9999.0f;
+    }
+    return (code & 0x8000) ? -mag : mag;
+}
+
+/**
+ * Compare decoded numbers with the reference, reporting the first few
+ * mismatches.
+ * @param name: Decoder the numbers come from.
+ * @param first: Code of the first number.
+ * @return Number of mismatches.
+ */
+static int compare (const char* name, const float* values, uint4 first,
+        uint4 count)
+{
+    int errors = 0;
+
+    for (uint4 idx = 0; idx < count; idx++) {
+        uint2 code = (uint2)(first + idx);
+        uint4 expected = floatToIntBits (referenceFp2 (code));
+        uint4 actual = floatToIntBits (values[idx]);
+
+        if (expected != actual) {
+            if (errors < 10) {
+                cout << name << ": code 0x" << hex << setw(4)
+                     << setfill('0') << code << " decoded as 0x" << setw(8)
+                     << actual << ", expected 0x" << setw(8) << expected
+                     << dec << endl;
+            }
+            errors++;
+        }
+    }
+    return errors;
+}
+
+int main ()
+{
+    vector<byte>  codes (2*NUM_CODES);
+    vector<float> values (NUM_CODES);
+    int errors = 0;
+
+    for (uint4 code = 0; code < NUM_CODES; code++) {
+        codes[2*code] = (byte)(code >> 8);
+        codes[2*code + 1] = (byte)(code & 0xff);
+    }
+
+    for (uint4 code = 0; code < NUM_CODES; code++) {
+        values[code] = GetFinalStorageFloat ((uint2)code);
+    }
+    errors += compare ("GetFinalStorageFloat", &values[0], 0, NUM_CODES);
+
+    for (uint4 code = 0; code < NUM_CODES; code++) {
+        values[code] = Fp2Sample::decode (&codes[2*code]);
+    }
+    errors += compare ("Fp2Sample::decode", &values[0], 0, NUM_CODES);
+
+    // The whole array at once, then from every offset into the first
+    // vector of codes with the remainder left to the scalar tail
+
+    decodeFinalStorageFloats (&codes[0], &values[0], NUM_CODES);
+    errors += compare ("decodeFinalStorageFloats", &values[0], 0, NUM_CODES);
+
+    for (uint4 first = 1; first < 8; first++) {
+        uint4 count = NUM_CODES - first - (first % 4);
+        decodeFinalStorageFloats (&codes[2*first], &values[0], count);
+        errors += compare ("decodeFinalStorageFloats", &values[0], first,
+                count);
+    }
+
+#ifdef __SSSE3__
+    const char* build = "SSSE3";
+#else
+    const char* build = "scalar";
+#endif
+    if (errors) {
+        cout << "fp2_check (" << build << "): " << errors << " mismatches"
+             << endl;
+        return 1;
+    }
+    cout << "fp2_check (" << build << "): " << NUM_CODES
+         << " codes decoded as expected" << endl;
+    return 0;
+}
@@ -0,0 +1,301 @@
+/**
+ * @file missing_check.cpp
+ * Checks that missing samples are recognized in the records stored for a
+ * table: NaN and infinity, which IEEE4 fields decode NaN to, the -9999
+ * that the FP2 NaN and overflow codes decode to, and the configured
+ * sentinel. Each is expected to be flagged by the QC checks as missing,
+ * and nothing else, and to be left out of the statistics aggregated from
+ * the records.
+ */
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cmath>
+#include <string.h>
+#include "pb5.h"
+using namespace std;
+
+static const int   NUM_RECORDS  = 6;
+static const uint4 FIRST_RECORD = 100;
+static const uint4 FIRST_TIME   = 1000000000;  // Seconds since 1990
+
+static const uint4 IEEE4_NAN      = 0x7fc00000;
+static const uint4 IEEE4_NEG_NAN  = 0xffc00000;
+static const uint4 IEEE4_INF      = 0x7f800000;
+static const uint4 IEEE4_NEG_INF  = 0xff800000;
+static const uint4 IEEE4_ONE_HALF = 0x3fc00000;
+static const uint4 IEEE4_MISSING  = 0xc61c3c00;     // -9999
+static const uint4 IEEE4_90       = 0x42b40000;
+static const uint4 IEEE4_999      = 0x4479c000;     // Sentinel of "wd"
+static const uint2 FP2_NAN        = 0x9ffe;
+static const uint2 FP2_INF        = 0x1fff;
+static const uint2 FP2_NEG_INF    = 0x9fff;
+
+/**
+ * Samples of the records of the "Met" table, one record per row.
+ */
+static const struct {
+    uint2 fp2;
+    uint4 ieee4;
+    uint4 ieee4l;
+    uint4 wd;
+} samples[NUM_RECORDS] = {
+    { 0x0064,      IEEE4_ONE_HALF, IEEE4_ONE_HALF, IEEE4_90 },
+    { FP2_NAN,     IEEE4_NAN,      IEEE4_NAN,      IEEE4_90 },
+    { 0x0065,      IEEE4_INF,      IEEE4_NEG_INF,  IEEE4_999 },
+    { FP2_INF,     IEEE4_MISSING,  IEEE4_ONE_HALF, IEEE4_90 },
+    { 0x0066,      IEEE4_ONE_HALF, IEEE4_ONE_HALF, IEEE4_MISSING },
+    { FP2_NEG_INF, IEEE4_NEG_INF,  IEEE4_NEG_NAN,  IEEE4_90 }
+};
+
+/** Records expected to be flagged as missing, per field */
+static const char* expected[] = { "135", "1235", "125", "2" };
+
+/**
+ * Statistics expected for the window of the records, from the samples
+ * that are not missing: the mean, minimum and maximum of "fp2", the mean
+ * of "ieee4", and the wind vector of "ieee4l" and "wd" (records 0 and 3).
+ */
+static const struct {
+    uint4  count;
+    double mean;
+    double min;
+    double max;
+    double sumSin;
+} stats[] = {
+    { 3, 101, 100, 102, 0 },
+    { 2, 1.5, 1.5, 1.5, 0 },
+    { 2, 1.5, 1.5, 1.5, 2 }
+};
+
+/**
+ * Data writer keeping the samples flagged by the QC checks.
+ */
+class QcCapture : public TableDataWriter {
+    public :
+        vector<QcResult> results;
+
+        void initWrite(Table& tblRef) throw (StorageException) {}
+        void processRecordBegin(Table& tblRef, int recordIdx,
+                NSec recordTime) {}
+        void storeBool(const Field& var, bool flag) {}
+        void storeInt(const Field& var, int num) {}
+        void storeFloat(const Field& var, float num) {}
+        void storeString(const Field& var, string& str) {}
+        void storeUint4(const Field& var, uint4 num) {}
+        void storeUint2(const Field& var, uint2 num) {}
+        void processUnimplemented(const Field& var) {}
+        void processRecordEnd(Table& tblRef) {}
+        void finishWrite(Table& tblRef) throw (StorageException) {}
+        void flush(const Table& tblRef) {}
+
+        void processQcResult(Table& tblRef, const RecordBatch& batch,
+                const QcResult& result)
+        {
+            results.push_back(result);
+        }
+};
+
+static void putString (vector<byte>& buf, const char* str)
+{
+    buf.insert (buf.end(), str, str + strlen(str) + 1);
+}
+
+static void putUint (vector<byte>& buf, uint4 num, int len)
+{
+    for (int count = len - 1; count >= 0; count--) {
+        buf.push_back ((byte)(num >> (8*count)));
+    }
+}
+
+static void putUintLsb (vector<byte>& buf, uint4 num, int len)
+{
+    for (int count = 0; count < len; count++) {
+        buf.push_back ((byte)(num >> (8*count)));
+    }
+}
+
+/**
+ * Append the definition of a single sample field to a table definition.
+ */
+static void putField (vector<byte>& tdf, byte type, const char* name)
+{
+    tdf.push_back (type);
+    putString (tdf, name);
+    tdf.push_back (0x00);       // No aliases
+    putString (tdf, "Smp");
+    putString (tdf, "units");
+    putString (tdf, "");
+    putUint (tdf, 1, 4);        // BegIdx
+    putUint (tdf, 1, 4);        // Dimension
+    putUint (tdf, 0, 4);        // No sub-dimensions
+}
+
+/**
+ * Write the table definitions of the check to the working directory.
+ */
+static void writeTDF (const string& working_path)
+{
+    vector<byte> tdf;
+    tdf.push_back (0x01);       // FSL version
+    putString (tdf, "Met");
+    putUint (tdf, 1000, 4);     // Table size
+    tdf.push_back (0x0e);       // Time type
+    putUint (tdf, 0, 8);        // Time into
+    putUint (tdf, 1, 4);        // Interval
+    putUint (tdf, 0, 4);
+    putField (tdf, 7, "fp2");
+    putField (tdf, 9, "ieee4");
+    putField (tdf, 24, "ieee4l");
+    putField (tdf, 9, "wd");
+    tdf.push_back (0x00);
+
+    ofstream tdf_fs ((working_path + "/.working/tdf.dat").c_str(),
+            ios_base::out | ios_base::binary);
+    tdf_fs.write ((const char *)&tdf[0], tdf.size());
+    tdf_fs.close();
+}
+
+/**
+ * Check the samples flagged for a field against the records expected.
+ * @return Number of failures.
+ */
+static int checkField (const vector<QcResult>& results, int column,
+        const char* name)
+{
+    string flagged;
+    int errors = 0;
+
+    for (unsigned int idx = 0; idx < results.size(); idx++) {
+        if (results[idx].Column != column) {
+            continue;
+        }
+        flagged += (char)('0' + results[idx].Record);
+        if (results[idx].Flags != QC_MISSING) {
+            cout << "missing_check: record " << results[idx].Record
+                 << " of " << name << " flagged " << (int)results[idx].Flags
+                 << endl;
+            errors++;
+        }
+    }
+
+    if (flagged != expected[column]) {
+        cout << "missing_check: records \"" << flagged << "\" of " << name
+             << " flagged as missing, expected \"" << expected[column]
+             << "\"" << endl;
+        errors++;
+    }
+    return errors;
+}
+
+/**
+ * Check the window in progress of the derived table, as stored with the
+ * history of the tables.
+ * @return Number of failures.
+ */
+static int checkAggregates (const string& working_path)
+{
+    ifstream state_fs ((working_path + "/.working/aggr.Avg").c_str());
+    string header;
+    uint4  window_end, layout, count;
+    int errors = 0;
+
+    getline (state_fs, header);
+    if (!(state_fs >> window_end >> layout >> count) || (count != 3)) {
+        cout << "missing_check: no window in progress for Avg" << endl;
+        return 1;
+    }
+
+    for (uint4 idx = 0; idx < count; idx++) {
+        Accumulator acc;
+        state_fs >> acc.Count >> acc.Mean >> acc.M2 >> acc.Min >> acc.Max
+                 >> acc.SumSin >> acc.SumCos;
+        if ((acc.Count != stats[idx].count) ||
+                (fabs(acc.Mean - stats[idx].mean) > 1e-6) ||
+                (fabs(acc.Min - stats[idx].min) > 1e-6) ||
+                (fabs(acc.Max - stats[idx].max) > 1e-6) ||
+                (fabs(acc.SumSin - stats[idx].sumSin) > 1e-6)) {
+            cout << "missing_check: window of aggregate " << idx << " holds "
+                 << acc.Count << " samples, mean " << acc.Mean << ", min "
+                 << acc.Min << ", max " << acc.Max << endl;
+            errors++;
+        }
+    }
+    return errors;
+}
+
+int main (int argc, char* argv[])
+{
+    if (argc != 2) {
+        cout << "Usage: missing_check <working path>" << endl;
+        return 2;
+    }
+    string working_path = argv[1];
+    writeTDF (working_path);
+
+    DataOutputConfig data_opt;
+    data_opt.WorkingPath = working_path;
+    const char* fields[] = { "fp2", "ieee4", "ieee4l", "wd" };
+    for (int idx = 0; idx < 4; idx++) {
+        QcRule rule;
+        rule.TableName = "Met";
+        rule.FieldName = fields[idx];
+        if (idx == 3) {
+            rule.Missing = 999;
+        }
+        data_opt.QcRules.push_back (rule);
+    }
+
+    // The records fall within a single window, left in progress
+    AggregateOpt aggr;
+    aggr.TableName = "Met";
+    aggr.Name = "Avg";
+    aggr.Interval = 60;
+    aggr.Fields.resize(3);
+    aggr.Fields[0].FieldName = "fp2";
+    aggr.Fields[0].Stats = AGG_MEAN | AGG_MIN | AGG_MAX;
+    aggr.Fields[1].FieldName = "ieee4";
+    aggr.Fields[1].Stats = AGG_MEAN;
+    aggr.Fields[2].FieldName = "ieee4l";
+    aggr.Fields[2].DirectionField = "wd";
+    aggr.Fields[2].Stats = AGG_WIND;
+    data_opt.Aggregates.push_back (aggr);
+
+    TableDataManager tdm;
+    tdm.setDataOutputConfig (data_opt);
+    if (tdm.BuildTDF () != SUCCESS) {
+        cout << "missing_check: failed to load the table definitions" << endl;
+        return 1;
+    }
+    QcCapture* capture = new QcCapture;
+    tdm.setTableDataWriter (capture);
+
+    vector<byte> data;
+    putUint (data, FIRST_TIME, 4);
+    putUint (data, 0, 4);
+    for (int rec = 0; rec < NUM_RECORDS; rec++) {
+        putUint (data, samples[rec].fp2, 2);
+        putUint (data, samples[rec].ieee4, 4);
+        putUintLsb (data, samples[rec].ieee4l, 4);
+        putUint (data, samples[rec].wd, 4);
+    }
+
+    Table& tbl = tdm.getTableRef ("Met");
+    tbl.NextRecord = FIRST_RECORD;
+    byte* ptr = &data[0];
+    tdm.storeRecords (tbl, &ptr, FIRST_RECORD, NUM_RECORDS, true);
+
+    int errors = 0;
+    for (int idx = 0; idx < 4; idx++) {
+        errors += checkField (capture->results, idx, fields[idx]);
+    }
+    tdm.saveTableStorageHistory ();
+    errors += checkAggregates (working_path);
+
+    if (errors) {
+        cout << "missing_check: " << errors << " failures" << endl;
+        return 1;
+    }
+    cout << "missing_check: missing samples recognized" << endl;
+    return 0;
+}
@@ -14,6 +14,7 @@
  *****************************************************/
 
 #include <iostream>
+#include <sstream>
 #include <iterator>
 #include <map>
 #include <fstream>
@@ -300,6 +301,66 @@ bool InputValidator :: validateInputs()
 
 int byte2int (char c) { return (0x000000ff & (unsigned char)c); }
 
+/**
+ * Function to report a measurement about the data collection, such as the
+ * number of records missing from a table. The metrics are logged to the
+ * "Metrics" category as "name{scope} value", so that they can be routed to
+ * a separate appender and picked up by monitoring tools.
+ *
+ * @param name:  Name of the metric, i.e. record_gaps.
+ * @param scope: What the metric applies to, i.e. the table name.
+ * @param value: Value of the metric.
+ */
+void reportMetric (const string& name, const string& scope, double value)
+{
+    stringstream msg;
+    msg << name << "{" << scope << "} " << value;
+    Category::getInstance("Metrics").info(msg.str());
+}
+
+#ifdef PB5_ALLOC_CHECK
+/*
+ * Allocation checking build: the heap allocation functions of the C library
+ * are wrapped to count the allocations made by the process, operator new
+ * included. The collection loop checks that the count stays the same while
+ * the records of a table are collected once it has warmed up.
+ */
+extern "C" {
+void* __libc_malloc (size_t size);
+void* __libc_calloc (size_t nmemb, size_t size);
+void* __libc_realloc (void* ptr, size_t size);
+
+static unsigned long allocationCount = 0;
+
+void* malloc (size_t size)
+{
+    allocationCount++;
+    return __libc_malloc (size);
+}
+
+void* calloc (size_t nmemb, size_t size)
+{
+    allocationCount++;
+    return __libc_calloc (nmemb, size);
+}
+
+void* realloc (void* ptr, size_t size)
+{
+    allocationCount++;
+    return __libc_realloc (ptr, size);
+}
+}
+
+/**
+ * Function to get the number of heap allocations made by the process so
+ * far, available in the allocation checking build only.
+ */
+unsigned long getAllocationCount ()
+{
+    return allocationCount;
+}
+#endif
+
 
 /**
  * Function to print a description of a signal in the log file.
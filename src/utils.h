@@ -28,6 +28,10 @@ int  open_lockfile (const char *lock_file, const char *process_name);
 int  is_running (const char *StrLockFile);
 int  setup_dir (const string& dirpath);
 char* get_timestamp ();
+void reportMetric (const string& name, const string& scope, double value);
+#ifdef PB5_ALLOC_CHECK
+unsigned long getAllocationCount ();
+#endif
 
 /**
  * A class derived from std::exception for error handling.